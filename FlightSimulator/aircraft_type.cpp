@@ -0,0 +1,197 @@
+#include "aircraft_type.h"
+#include "default_aircraft.h"
+#include "json.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace
+  {
+  jtk::vec3<float> read_vec3(const json::Value& v, const char* what)
+    {
+    const std::vector<json::Value>& a = v.as_array(what);
+    if (a.size() != 3)
+      throw std::runtime_error(std::string(what) + " should have 3 elements");
+    return jtk::vec3<float>(a[0].as_float(what), a[1].as_float(what), a[2].as_float(what));
+    }
+
+  float read_float(const json::Value& object, const char* key, float default_value)
+    {
+    const json::Value* v = object.find(key);
+    return v ? v->as_float(key) : default_value;
+    }
+
+  float check_positive(float value, const std::string& what)
+    {
+    if (!(value > 0.f))
+      throw std::runtime_error(what + " should be positive");
+    return value;
+    }
+
+  float check_non_negative(float value, const std::string& what)
+    {
+    if (!(value >= 0.f))
+      throw std::runtime_error(what + " should not be negative");
+    return value;
+    }
+
+  jtk::vec3<float> read_size(const json::Value& v, const char* what)
+    {
+    const jtk::vec3<float> size = read_vec3(v, what);
+    for (int i = 0; i < 3; ++i)
+      check_positive(size[i], std::string("every element of ") + what);
+    return size;
+    }
+
+  jtk::vec3<float> read_direction(const json::Value& v, const char* what)
+    {
+    const jtk::vec3<float> direction = read_vec3(v, what);
+    const float length = jtk::length(direction);
+    if (!(length > 0.f && length < std::numeric_limits<float>::infinity()))
+      throw std::runtime_error(std::string(what) + " should not be zero");
+    return direction / length;
+    }
+
+  uint32_t parse_input(const std::string& name)
+    {
+    if (name == "pitch")
+      return control_pitch;
+    if (name == "yaw")
+      return control_yaw;
+    if (name == "roll")
+      return control_roll;
+    throw std::runtime_error("unknown control input \"" + name + "\", should be pitch, yaw or roll");
+    }
+  }
+
+AircraftType::AircraftType() : mass(1.f), thrust(0.f), horsepower(0.f), rpm(0.f), propellor_diameter(0.f)
+  {
+  }
+
+std::size_t AircraftType::find_surface(const std::string& surface_name) const
+  {
+  return static_cast<std::size_t>(std::find(surface_names.begin(), surface_names.end(), surface_name) - surface_names.begin());
+  }
+
+void AircraftType::compile()
+  {
+  // keeps the order of the entries of a surface, so that their sum does not depend on the sort
+  std::stable_sort(controls.begin(), controls.end(), [](const ControlMix& a, const ControlMix& b) { return a.surface < b.surface; });
+
+  wings = WingSet(surfaces);
+
+  physics::RigidBodyParams pars;
+  pars.mass = mass;
+  pars.inertia = inertia;
+  body = physics::RigidBody(pars);
+  }
+
+const Airfoil* find_airfoil(const std::string& name)
+  {
+  if (name == "NACA_0012")
+    return &NACA_0012;
+  if (name == "NACA_2412")
+    return &NACA_2412;
+  return nullptr;
+  }
+
+std::shared_ptr<const AircraftType> parse_aircraft_type(const json::Value& definition)
+  {
+  auto type = std::make_shared<AircraftType>();
+  type->name = definition.at("name").as_string("name");
+
+  const json::Value& engine = definition.at("engine");
+  type->thrust = engine.at("thrust").as_float("thrust");
+  type->horsepower = read_float(engine, "horsepower", 1000.0f);
+  type->rpm = read_float(engine, "rpm", 2400.0f);
+  type->propellor_diameter = read_float(engine, "propellor_diameter", 1.8f);
+
+  std::vector<physics::inertia::element> elements;
+  float element_mass = 0.f;
+  for (const json::Value& e : definition.at("inertia").as_array("inertia"))
+    {
+    const float m = check_positive(e.at("mass").as_float("inertia mass"), "inertia mass");
+    elements.push_back(physics::inertia::cube_element(read_vec3(e.at("position"), "inertia position"), read_size(e.at("size"), "inertia size"), m));
+    element_mass += m;
+    }
+  if (elements.empty())
+    throw std::runtime_error("an aircraft needs at least one inertia element");
+  type->inertia = physics::inertia::tensor(elements, true);
+  type->mass = read_float(definition, "mass", element_mass);
+  if (!(type->mass > 0.f))
+    throw std::runtime_error("the mass of an aircraft should be positive");
+
+  for (const json::Value& s : definition.at("surfaces").as_array("surfaces"))
+    {
+    const std::string& name = s.at("name").as_string("surface name");
+    if (type->find_surface(name) != type->surface_names.size())
+      throw std::runtime_error("duplicate surface \"" + name + "\"");
+    const std::string& airfoil_name = s.at("airfoil").as_string("airfoil");
+    const Airfoil* airfoil = find_airfoil(airfoil_name);
+    if (!airfoil)
+      throw std::runtime_error("unknown airfoil \"" + airfoil_name + "\" of surface \"" + name + "\"");
+    const json::Value* normal = s.find("normal");
+    const float span = check_positive(s.at("span").as_float("span"), "span of surface \"" + name + "\"");
+    const float chord = check_positive(s.at("chord").as_float("chord"), "chord of surface \"" + name + "\"");
+    type->surfaces.emplace_back(read_vec3(s.at("position"), "surface position"), span, chord, airfoil,
+      normal ? read_direction(*normal, "surface normal") : physics::UP);
+    type->surface_names.push_back(name);
+    }
+
+  if (const json::Value* controls = definition.find("controls"))
+    {
+    for (const json::Value& c : controls->as_array("controls"))
+      {
+      const std::string& surface_name = c.at("surface").as_string("control surface");
+      const std::size_t surface = type->find_surface(surface_name);
+      if (surface == type->surfaces.size())
+        throw std::runtime_error("control of unknown surface \"" + surface_name + "\"");
+      type->controls.push_back({ static_cast<uint32_t>(surface), parse_input(c.at("input").as_string("control input")), c.at("gain").as_float("control gain") });
+      }
+    }
+
+  if (const json::Value* gear = definition.find("gear"))
+    {
+    if (const json::Value* struts = gear->find("struts"))
+      {
+      for (const json::Value& s : struts->as_array("struts"))
+        {
+        type->gear.add_strut(Strut(read_vec3(s.at("position"), "strut position"),
+          check_positive(s.at("length").as_float("strut length"), "strut length"),
+          check_positive(s.at("stiffness").as_float("strut stiffness"), "strut stiffness"),
+          check_non_negative(s.at("damping").as_float("strut damping"), "strut damping"),
+          check_non_negative(read_float(s, "rolling_friction", 0.02f), "rolling friction"),
+          check_non_negative(read_float(s, "side_friction", 0.8f), "side friction")));
+        }
+      }
+    if (const json::Value* points = gear->find("crash_points"))
+      {
+      for (const json::Value& p : points->as_array("crash_points"))
+        type->gear.add_crash_point(read_vec3(p, "crash point"));
+      }
+    type->gear.set_max_compression_speed(check_positive(read_float(*gear, "max_compression_speed", type->gear.get_max_compression_speed()), "max_compression_speed"));
+    }
+
+  type->compile();
+  return type;
+  }
+
+std::shared_ptr<const AircraftType> load_aircraft_type(const std::string& filename)
+  {
+  const json::Value definition = json::read_file(filename);
+  try
+    {
+    return parse_aircraft_type(definition);
+    }
+  catch (std::exception& e)
+    {
+    throw std::runtime_error(filename + ": " + e.what());
+    }
+  }
+
+std::shared_ptr<const AircraftType> default_aircraft_type()
+  {
+  static const std::shared_ptr<const AircraftType> type = parse_aircraft_type(json::parse(default_aircraft_json));
+  return type;
+  }
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "flightmodel.h"
+#include "landing_gear.h"
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace json
+  {
+  class Value;
+  }
+
+enum ControlInput : uint32_t
+  {
+  control_pitch,
+  control_yaw,
+  control_roll,
+  number_of_control_inputs
+  };
+
+// one entry of the control mixing table: the surface deflects by gain degrees at full input
+struct ControlMix
+  {
+  uint32_t surface;
+  uint32_t input; // ControlInput
+  float gain;
+  };
+
+// Everything about an aircraft that does not change in flight. Aircraft of the same type share one instance, so a
+// fleet of thousands of aircraft of a few dozen types holds the surfaces, the mixing table and the gear only once,
+// and every aircraft only has its AircraftState.
+struct AircraftType
+  {
+  std::string name;
+
+  float mass;                  // kg
+  physics::mat3 inertia;
+
+  float thrust;                // N at full throttle
+  float horsepower;
+  float rpm;
+  float propellor_diameter;    // m
+
+  // the description of the surfaces, as loaded
+  std::vector<Wing> surfaces;
+  std::vector<std::string> surface_names;
+  // sorted by surface, so that the deflection of a surface is the sum over a contiguous run of entries
+  std::vector<ControlMix> controls;
+
+  // runtime layout, compiled from the description by compile()
+  WingSet wings;
+  physics::RigidBody body;     // mass and inertia, at rest at the origin
+  LandingGear gear;
+
+  AircraftType();
+
+  // returns size() of surfaces if there is no surface with this name
+  std::size_t find_surface(const std::string& surface_name) const;
+
+  // builds wings and body from the surfaces, the mass and the inertia, and sorts the controls
+  void compile();
+  };
+
+// nullptr for an unknown name, known are "NACA_0012" and "NACA_2412"
+const Airfoil* find_airfoil(const std::string& name);
+
+// Aircraft description format, lengths in m, masses in kg, angles in degrees, all vectors in body space:
+//   {
+//     "name": "...",
+//     "engine": { "thrust": N, "horsepower": hp, "rpm": rpm, "propellor_diameter": m },
+//     "mass": kg,                          optional, defaults to the sum of the inertia elements
+//     "inertia": [ { "position": [x, y, z], "size": [x, y, z], "mass": kg }, ... ],
+//     "surfaces": [ { "name": "...", "position": [x, y, z], "span": m, "chord": m, "airfoil": "NACA_2412",
+//                     "normal": [x, y, z] }, ... ],           the normal is optional, defaults to up and is normalized
+//     "controls": [ { "surface": "...", "input": "pitch" | "yaw" | "roll", "gain": deg }, ... ],
+//     "gear": { "struts": [ { "position": [x, y, z], "length": m, "stiffness": N/m, "damping": N/(m/s),
+//                             "rolling_friction": mu, "side_friction": mu }, ... ],   frictions are optional
+//               "crash_points": [ [x, y, z], ... ], "max_compression_speed": m/s }    optional
+//   }
+// The inertia elements are cubes, see physics::inertia::cube_element. Masses, sizes, spans, chords, strut lengths and
+// stiffnesses and the max compression speed have to be positive, dampings and frictions must not be negative.
+// Errors throw std::runtime_error.
+std::shared_ptr<const AircraftType> parse_aircraft_type(const json::Value& definition);
+std::shared_ptr<const AircraftType> load_aircraft_type(const std::string& filename);
+
+// the aircraft flown by the simulator, parsed from assets/aircraft/default.json, which is compiled in
+std::shared_ptr<const AircraftType> default_aircraft_type();
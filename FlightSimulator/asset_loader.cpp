@@ -0,0 +1,131 @@
+#include "asset_loader.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+asset_loader::asset_loader(ThreadPool& pool) : m_pool(pool), m_decoded(0), m_uploaded(0)
+  {
+  }
+
+asset_loader::~asset_loader()
+  {
+  // the tasks refer to the jobs
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_decoded_cv.wait(lock, [this] { return m_decoded == m_jobs.size(); });
+  }
+
+asset_loader::handle asset_loader::load(mesh& m, const std::string& filename, float rx, float ry, float rz)
+  {
+  return load([&m, filename, rx, ry, rz] { m.decode_ply_file(filename, rx, ry, rz); },
+    [&m](RenderDoos::render_engine& engine) { m.upload(engine); });
+  }
+
+asset_loader::handle asset_loader::load(texture& t, const std::string& filename)
+  {
+  return load([&t, filename] { t.decode_file(filename); },
+    [&t](RenderDoos::render_engine& engine) { t.upload(engine); });
+  }
+
+asset_loader::handle asset_loader::load(cubemap& c, const std::array<std::string, 6>& filenames)
+  {
+  return load([&c, filenames] { c.decode_files(filenames[0], filenames[1], filenames[2], filenames[3], filenames[4], filenames[5]); },
+    [&c](RenderDoos::render_engine& engine) { c.upload(engine); });
+  }
+
+asset_loader::handle asset_loader::load(std::function<void()> decode, std::function<void(RenderDoos::render_engine&)> upload)
+  {
+  std::unique_ptr<job> j(new job());
+  j->decode = std::move(decode);
+  j->upload = std::move(upload);
+  j->decoded = false;
+  j->uploaded = false;
+  job* p = j.get();
+  const handle h = m_jobs.size();
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(j));
+    }
+  m_pool.submit([this, p]
+    {
+    try
+      {
+      p->decode();
+      }
+    catch (...)
+      {
+      p->error = std::current_exception();
+      }
+    p->decode = nullptr;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    p->decoded = true;
+    ++m_decoded;
+    m_decoded_cv.notify_all();
+    });
+  return h;
+  }
+
+bool asset_loader::is_ready(handle h) const
+  {
+  return m_jobs[h]->uploaded;
+  }
+
+std::size_t asset_loader::poll(RenderDoos::render_engine& engine)
+  {
+  std::vector<job*> decoded;
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& j : m_jobs)
+      {
+      if (j->decoded && !j->uploaded)
+        decoded.push_back(j.get());
+      }
+    }
+  for (job* j : decoded)
+    {
+    j->uploaded = true;
+    ++m_uploaded;
+    if (j->error)
+      std::rethrow_exception(j->error);
+    if (j->upload)
+      j->upload(engine);
+    j->upload = nullptr;
+    }
+  return m_jobs.size() - m_uploaded;
+  }
+
+void asset_loader::wait(RenderDoos::render_engine& engine, handle h)
+  {
+  for (;;)
+    {
+    std::size_t decoded;
+      {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      decoded = m_decoded;
+      }
+    poll(engine);
+    if (m_jobs[h]->uploaded)
+      return;
+    _wait_for_decode(decoded);
+    }
+  }
+
+void asset_loader::wait_all(RenderDoos::render_engine& engine)
+  {
+  for (;;)
+    {
+    std::size_t decoded;
+      {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      decoded = m_decoded;
+      }
+    if (poll(engine) == 0)
+      return;
+    _wait_for_decode(decoded);
+    }
+  }
+
+void asset_loader::_wait_for_decode(std::size_t decoded)
+  {
+  // decoded is the count before the last poll, so a job that finished during the poll does not get lost
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_decoded_cv.wait(lock, [this, decoded] { return m_decoded != decoded; });
+  }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace RenderDoos
+  {
+  class render_engine;
+  }
+
+class ThreadPool;
+struct mesh;
+struct texture;
+struct cubemap;
+
+// Loads assets in two steps: decoding (reading files, PNG and JPG decompression, PLY parsing) runs as a task on a
+// thread pool, the upload to the render engine runs on the render thread, in poll() or wait().
+// Every load returns a handle that poll() and is_ready() report on and wait() blocks on. An exception thrown while
+// decoding is rethrown on the render thread by the poll() or wait() that would have uploaded the asset.
+// The objects that are loaded into must stay alive until they are uploaded, and all calls have to come from the render
+// thread.
+class asset_loader
+  {
+  public:
+    using handle = std::size_t;
+
+    explicit asset_loader(ThreadPool& pool);
+    // waits for the decoding tasks that still run; decoded assets that were not uploaded are not uploaded anymore
+    ~asset_loader();
+
+    asset_loader(const asset_loader&) = delete;
+    asset_loader& operator = (const asset_loader&) = delete;
+
+    handle load(mesh& m, const std::string& filename, float rx, float ry, float rz);
+    handle load(texture& t, const std::string& filename);
+    // front, back, left, right, top, bottom
+    handle load(cubemap& c, const std::array<std::string, 6>& filenames);
+    // decode runs on the thread pool, upload on the render thread, possibly empty
+    handle load(std::function<void()> decode, std::function<void(RenderDoos::render_engine&)> upload);
+
+    // true once the asset is uploaded
+    bool is_ready(handle h) const;
+
+    // uploads the assets that are decoded, and returns the number of assets that are not uploaded yet
+    std::size_t poll(RenderDoos::render_engine& engine);
+    // uploads assets as they are decoded until asset h is uploaded
+    void wait(RenderDoos::render_engine& engine, handle h);
+    void wait_all(RenderDoos::render_engine& engine);
+
+  private:
+    struct job
+      {
+      std::function<void()> decode;
+      std::function<void(RenderDoos::render_engine&)> upload;
+      std::exception_ptr error;
+      bool decoded; // guarded by m_mutex
+      bool uploaded;
+      };
+
+    void _wait_for_decode(std::size_t decoded);
+
+  private:
+    ThreadPool& m_pool;
+    std::vector<std::unique_ptr<job>> m_jobs;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_decoded_cv;
+    std::size_t m_decoded; // number of decoded jobs, guarded by m_mutex
+    std::size_t m_uploaded;
+  };
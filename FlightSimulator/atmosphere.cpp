@@ -0,0 +1,165 @@
+#include "atmosphere.h"
+#include "physics.h"
+
+#include <cmath>
+#include <vector>
+
+namespace
+  {
+  // ISO 2533
+  constexpr double g0 = 9.80665;          // m/s^2
+  constexpr double R = 287.05287;         // specific gas constant of dry air, J/(kg K)
+  constexpr double gamma = 1.4;           // ratio of specific heats
+  constexpr double sea_level_temperature = 288.15;
+  constexpr double sea_level_pressure = 101325.0;
+
+  struct Layer
+    {
+    double base;        // altitude, m
+    double temperature; // at the base, K
+    double lapse;       // K/m
+    };
+
+  const Layer layers[] = {
+    { 0.0, sea_level_temperature, -0.0065 },
+    { 11000.0, 216.65, 0.0 },
+    { 20000.0, 216.65, 0.001 },
+    };
+  constexpr int number_of_layers = sizeof(layers) / sizeof(Layer);
+
+  // exp and log from + - * / only, like physics::math::portable, so that the table is the same with every C runtime
+  // when building with FLIGHTSIM_DETERMINISTIC. The arguments stay in a small range: |x| < 8 and 0.5 < x < 2.
+  double series_exp(double x)
+    {
+    // exp(x) = exp(x / 64)^64, with a Taylor series for |x / 64| < 0.125
+    const double y = x / 64.0;
+    double term = 1.0, sum = 1.0;
+    for (int i = 1; i < 16; ++i)
+      {
+      term *= y / i;
+      sum += term;
+      }
+    for (int i = 0; i < 6; ++i)
+      sum *= sum;
+    return sum;
+    }
+
+  double series_log(double x)
+    {
+    // log(x) = 2 atanh(z) with z = (x - 1) / (x + 1), |z| < 1/3
+    const double z = (x - 1.0) / (x + 1.0);
+    const double z2 = z * z;
+    double power = z, sum = 0.0;
+    for (int i = 1; i < 60; i += 2)
+      {
+      sum += power / i;
+      power *= z2;
+      }
+    return 2.0 * sum;
+    }
+
+  int find_layer(double altitude)
+    {
+    int layer = 0;
+    while (layer + 1 < number_of_layers && altitude >= layers[layer + 1].base)
+      ++layer;
+    return layer;
+    }
+
+  double layer_temperature(int layer, double altitude)
+    {
+    return layers[layer].temperature + layers[layer].lapse * (altitude - layers[layer].base);
+    }
+
+  // hydrostatic equation of an ideal gas over the layer
+  double layer_pressure(int layer, double base_pressure, double altitude)
+    {
+    const Layer& l = layers[layer];
+    if (l.lapse == 0.0)
+      return base_pressure * series_exp(-g0 * (altitude - l.base) / (R * l.temperature));
+    return base_pressure * series_exp(-g0 / (R * l.lapse) * series_log(layer_temperature(layer, altitude) / l.temperature));
+    }
+
+  physics::atmosphere::conditions evaluate(double altitude)
+    {
+    const int layer = find_layer(altitude);
+    double pressure = sea_level_pressure;
+    for (int i = 0; i < layer; ++i)
+      pressure = layer_pressure(i, pressure, layers[i + 1].base);
+    pressure = layer_pressure(layer, pressure, altitude);
+    const double temperature = layer_temperature(layer, altitude);
+
+    physics::atmosphere::conditions c;
+    c.temperature = static_cast<float>(temperature);
+    c.pressure = static_cast<float>(pressure);
+    c.density = static_cast<float>(pressure / (R * temperature));
+    c.speed_of_sound = static_cast<float>(std::sqrt(gamma * R * temperature));
+    return c;
+    }
+
+  std::vector<physics::atmosphere::conditions> make_table()
+    {
+    using namespace physics::atmosphere;
+    const int size = static_cast<int>((max_altitude - min_altitude) / table_spacing) + 1;
+    std::vector<conditions> table(size);
+    for (int i = 0; i < size; ++i)
+      table[i] = evaluate(static_cast<double>(min_altitude) + static_cast<double>(i) * table_spacing);
+    return table;
+    }
+
+  const std::vector<physics::atmosphere::conditions> table = make_table();
+
+  // the interval of table coordinate x, the last one for x at the end of the table
+  int table_interval(float x)
+    {
+    const int i = static_cast<int>(x);
+    return i < static_cast<int>(table.size()) - 2 ? i : static_cast<int>(table.size()) - 2;
+    }
+  }
+
+namespace physics
+  {
+
+  namespace atmosphere
+    {
+
+    conditions exact(float altitude)
+      {
+      return evaluate(static_cast<double>(utils::clamp(altitude, min_altitude, max_altitude)));
+      }
+
+    conditions sample(float altitude)
+      {
+      const float x = density_cache::table_coordinate(altitude);
+      const int i = table_interval(x);
+      const float t = x - static_cast<float>(i);
+      const conditions& a = table[i];
+      const conditions& b = table[i + 1];
+      conditions c;
+      c.temperature = utils::lerp(a.temperature, b.temperature, t);
+      c.pressure = utils::lerp(a.pressure, b.pressure, t);
+      c.density = utils::lerp(a.density, b.density, t);
+      c.speed_of_sound = utils::lerp(a.speed_of_sound, b.speed_of_sound, t);
+      return c;
+      }
+
+    float density(float altitude)
+      {
+      const float x = density_cache::table_coordinate(altitude);
+      const int i = table_interval(x);
+      return utils::lerp(table[i].density, table[i + 1].density, x - static_cast<float>(i));
+      }
+
+    void density_cache::_refresh(float x)
+      {
+      const int i = table_interval(x);
+      lo = static_cast<float>(i);
+      // the last interval also holds the end of the table
+      hi = i + 2 < static_cast<int>(table.size()) ? lo + 1.f : std::numeric_limits<float>::infinity();
+      base = table[i].density;
+      delta = table[i + 1].density - table[i].density;
+      }
+
+    } // namespace atmosphere
+
+  } // namespace physics
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <limits>
+
+namespace physics
+  {
+
+  // International Standard Atmosphere (ISO 2533) from -1 km to 32 km: the troposphere with a lapse rate of 6.5 K/km,
+  // the isothermal tropopause from 11 km, and the first layer of the stratosphere from 20 km, warming by 1 K/km.
+  // Altitudes are in m above mean sea level. The geometric altitude is used as the geopotential altitude, which is
+  // 0.5% off at 32 km.
+  namespace atmosphere
+    {
+
+    struct conditions
+      {
+      float temperature;    // K
+      float pressure;       // Pa
+      float density;        // kg/m^3
+      float speed_of_sound; // m/s
+      };
+
+    constexpr float min_altitude = -1000.f;
+    constexpr float max_altitude = 32000.f;
+    // the layer boundaries fall on table entries, so interpolating the temperature is exact
+    constexpr float table_spacing = 100.f;
+
+    // evaluates the layer formulas with exp and pow, for building the table and checking it
+    conditions exact(float altitude);
+
+    // Linear interpolation in a table of exact() values, without transcendental functions. The relative error of
+    // pressure and density is below 1e-4. Altitudes outside of [min_altitude, max_altitude] are clamped, NaN gives the values at min_altitude.
+    conditions sample(float altitude);
+    float density(float altitude);
+
+    // Air density of one aircraft. The table interval of the last altitude is kept with its end values, and it is
+    // only looked up again when the altitude leaves it, i.e. after a climb or descent of up to table_spacing.
+    // In between a density costs a compare and a multiply-add. The result only depends on the altitude, and not on
+    // where the interval was looked up, so a flight replayed from a keyframe sees the same densities as the recording.
+    // Plain data, so that it can live in AircraftState.
+    struct density_cache
+      {
+      float lo;    // interval in table coordinates, [lo, hi), empty when lo is NaN
+      float hi;
+      float base;  // density at lo
+      float delta; // density difference over the interval
+
+      void clear() { lo = hi = std::numeric_limits<float>::quiet_NaN(); base = delta = 0.f; }
+
+      float density(float altitude)
+        {
+        const float x = table_coordinate(altitude);
+        if (!(x >= lo && x < hi))
+          _refresh(x);
+        return base + (x - lo) * delta;
+        }
+
+      // altitude clamped to the table and scaled to table entries; NaN maps to min_altitude, so that the table
+      // lookups stay in bounds
+      static float table_coordinate(float altitude)
+        {
+        const float a = !(altitude >= min_altitude) ? min_altitude : altitude > max_altitude ? max_altitude : altitude;
+        return (a - min_altitude) * (1.f / table_spacing);
+        }
+
+      private:
+        void _refresh(float x);
+      };
+
+    } // namespace atmosphere
+
+  } // namespace physics
@@ -0,0 +1,183 @@
+// Consistency check of the rigid body integrators.
+//
+// Steps the same tumbling bodies with RigidBodyBatch::update, which runs the widest SIMD kernel of the build, with
+// RigidBodyBatch::update_scalar, and with RigidBody::update, and compares the three after every step. The batch
+// kernels evaluate the same expressions as the scalar kernel, so they should agree with it bit for bit unless the
+// compiler contracts to fused multiply-adds; RigidBody::update groups some products differently and drifts by
+// rounding only.
+//
+// Usage: flightsim_batch_check
+//
+// Returns 1 when a pair leaves its tolerance, and reports the largest difference of every quantity for both pairs.
+
+#include "determinism.h"
+#include "physics.h"
+#include "physics_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+  {
+
+  const physics::seconds dt = 0.002f;
+  const int steps = 2000;
+  // not a multiple of any SIMD width, so that the tail of the kernels is checked too
+  const std::size_t number_of_bodies = 37;
+
+  struct Body
+    {
+    physics::RigidBodyParams params;
+    jtk::vec3<float> force;  // body space, at point
+    jtk::vec3<float> point;
+    jtk::vec3<float> torque; // body space
+    };
+
+  std::vector<Body> make_bodies()
+    {
+    // mt19937 gives the same sequence with every standard library, the distributions do not
+    std::mt19937 rng(2024);
+    auto uniform = [&](float lo, float hi) { return lo + (hi - lo) * static_cast<float>(rng() / 4294967296.0); };
+    auto vec = [&](float lo, float hi) { return jtk::vec3<float>(uniform(lo, hi), uniform(lo, hi), uniform(lo, hi)); };
+
+    std::vector<Body> bodies(number_of_bodies);
+    for (Body& b : bodies)
+      {
+      const float mass = uniform(500.f, 20000.f);
+      const jtk::vec3<float> size = vec(0.5f, 8.f);
+      b.params.mass = mass;
+      std::vector<physics::inertia::element> elements = { physics::inertia::cube_element(vec(-1.f, 1.f), size, mass) };
+      b.params.inertia = physics::inertia::tensor(elements, true);
+      b.params.position = vec(-1000.f, 1000.f);
+      b.params.velocity = vec(-200.f, 200.f);
+      b.params.angular_velocity = vec(-1.5f, 1.5f);
+      float q[4], norm = 0.f;
+      for (float& c : q)
+        {
+        c = uniform(-1.f, 1.f);
+        norm += c * c;
+        }
+      norm = std::sqrt(norm);
+      b.params.orientation = jtk::float4(q[0] / norm, q[1] / norm, q[2] / norm, q[3] / norm);
+      b.params.apply_gravity = true;
+      b.force = vec(-0.5f, 0.5f) * (mass * physics::g);
+      b.point = vec(-3.f, 3.f);
+      b.torque = vec(-0.05f, 0.05f) * mass;
+      }
+    return bodies;
+    }
+
+  struct State
+    {
+    jtk::vec3<float> position, velocity, angular_velocity;
+    jtk::float4 orientation;
+    };
+
+  State get_state(const physics::RigidBodyBatch& batch, std::size_t i)
+    {
+    return { batch.get_position(i), batch.get_velocity(i), batch.get_angular_velocity(i), batch.get_orientation(i) };
+    }
+
+  State get_state(const physics::RigidBody& body)
+    {
+    return { body.get_position(), body.get_velocity(), body.get_angular_velocity(), body.get_orientation() };
+    }
+
+  // largest differences over all bodies and steps
+  struct Difference
+    {
+    float position = 0.f;         // m
+    float orientation = 0.f;      // quaternion components
+    float velocity = 0.f;         // m/s
+    float angular_velocity = 0.f; // rad/s
+
+    void add(const State& a, const State& b)
+      {
+      position = std::max(position, jtk::length(a.position - b.position));
+      velocity = std::max(velocity, jtk::length(a.velocity - b.velocity));
+      angular_velocity = std::max(angular_velocity, jtk::length(a.angular_velocity - b.angular_velocity));
+      for (int j = 0; j < 4; ++j)
+        orientation = std::max(orientation, std::abs(a.orientation[j] - b.orientation[j]));
+      }
+
+    Difference() {}
+    Difference(float position, float orientation, float velocity, float angular_velocity) :
+      position(position), orientation(orientation), velocity(velocity), angular_velocity(angular_velocity) {}
+
+    bool within(const Difference& tolerance) const
+      {
+      return position <= tolerance.position && orientation <= tolerance.orientation && velocity <= tolerance.velocity &&
+        angular_velocity <= tolerance.angular_velocity;
+      }
+    };
+
+  // The bodies fly up to 1.5 km from the origin, where a float step is 1e-4 m; the largest differences seen are 4e-4 m,
+  // 1e-5 in the orientation, 5e-5 m/s and 2e-4 rad/s, with fused multiply-adds. A wrong term in a kernel is off by
+  // meters after a few seconds.
+  const Difference tolerance(0.01f, 1e-4f, 0.01f, 1e-3f);
+#ifdef FLIGHTSIM_DETERMINISTIC
+  // nothing is contracted, so the batch kernels give the result of the scalar kernel exactly
+  const Difference batch_tolerance(0.f, 0.f, 0.f, 0.f);
+#else
+  const Difference batch_tolerance = tolerance;
+#endif
+
+  bool report(const char* name, const Difference& d, const Difference& tolerance)
+    {
+    const bool ok = d.within(tolerance);
+    printf("%-26s %s\n", name, ok ? "ok" : "DIVERGED");
+    printf("  %-22s %12g   tolerance %g\n", "position [m]", d.position, tolerance.position);
+    printf("  %-22s %12g   tolerance %g\n", "orientation", d.orientation, tolerance.orientation);
+    printf("  %-22s %12g   tolerance %g\n", "velocity [m/s]", d.velocity, tolerance.velocity);
+    printf("  %-22s %12g   tolerance %g\n", "ang. vel. [rad/s]", d.angular_velocity, tolerance.angular_velocity);
+    return ok;
+    }
+
+  }
+
+int main()
+  {
+  physics::fp_environment fp;
+
+  const std::vector<Body> bodies = make_bodies();
+  physics::RigidBodyBatch batch, scalar;
+  std::vector<physics::RigidBody> single;
+  for (const Body& b : bodies)
+    {
+    batch.add(b.params);
+    scalar.add(b.params);
+    single.emplace_back(b.params);
+    }
+
+  Difference batch_scalar, scalar_single;
+  for (int step = 0; step < steps; ++step)
+    {
+    for (std::size_t i = 0; i < bodies.size(); ++i)
+      {
+      const Body& b = bodies[i];
+      batch.add_force_at_point(i, b.force, b.point);
+      batch.add_relative_torque(i, b.torque);
+      scalar.add_force_at_point(i, b.force, b.point);
+      scalar.add_relative_torque(i, b.torque);
+      single[i].add_force_at_point(b.force, b.point);
+      single[i].add_relative_torque(b.torque);
+      single[i].update(dt);
+      }
+    batch.update(dt);
+    scalar.update_scalar(dt);
+
+    for (std::size_t i = 0; i < bodies.size(); ++i)
+      {
+      batch_scalar.add(get_state(batch, i), get_state(scalar, i));
+      scalar_single.add(get_state(scalar, i), get_state(single[i]));
+      }
+    }
+
+  printf("%d bodies, %d steps of %g s\n", (int)bodies.size(), steps, dt);
+  bool ok = report("update vs update_scalar", batch_scalar, batch_tolerance);
+  ok = report("update_scalar vs RigidBody", scalar_single, tolerance) && ok;
+  return ok ? 0 : 1;
+  }
@@ -0,0 +1,690 @@
+#define JTK_QBVH_IMPLEMENTATION
+#include "jtk/qbvh.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+// Micro benchmarks of the physics and flight model hot paths.
+//
+// Usage: flightsim_bench [options]
+//   --filter <text>       only run the groups whose name contains text: integrators, airfoil, rigid_body, wings,
+//                         inertia, quaternion, atmosphere, aircraft, world, terrain
+//   --json <file>         write the results as json, for tracking them over time
+//   --compare <file>      compare with the json of an earlier run and fail if a case got slower
+//   --tolerance <x>       relative slowdown that --compare accepts (default 0.1)
+//
+// Every case is identified by its group and parameters, e.g. "aircraft/bodies=64/substeps=4", and reports the best
+// time per operation of a few repeated runs.
+
+#include "aircraft_type.h"
+#include "atmosphere.h"
+#include "flightmodel.h"
+#include "physics.h"
+#include "physics_batch.h"
+#include "terrain.h"
+#include "world.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace
+  {
+
+  struct Result
+    {
+    std::string id;        // group/param=value/...
+    std::string operation; // what one operation is
+    double ns;             // per operation
+    };
+
+  std::vector<Result> results;
+
+  // keeps the optimizer from dropping the benchmarked work
+  volatile float sink;
+
+  void record(const std::string& id, const std::string& operation, double ns)
+    {
+    results.push_back(Result{ id, operation, ns });
+    }
+
+  // Runs setup and then calls fn calls times, repeats times over, and returns the best time per operation in ns, where
+  // one call of fn does operations operations. setup is not timed; it restores the state that fn advances, so that
+  // every repeat simulates the same short stretch of flight.
+  double measure(const std::function<void()>& setup, const std::function<void()>& fn, int calls, double operations, int repeats = 10)
+    {
+    double best = 1e300;
+    for (int r = 0; r < repeats; ++r)
+      {
+      setup();
+      const auto tic = std::chrono::steady_clock::now();
+      for (int c = 0; c < calls; ++c)
+        fn();
+      const auto toc = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::nano>(toc - tic).count() / (calls * operations));
+      }
+    return best;
+    }
+
+  std::vector<physics::inertia::element> default_inertia_elements(float mass)
+    {
+    return {
+      physics::inertia::cube_element({-2.7f,  0.0f, -0.5f}, {3.50f, 0.10f, 6.96f}, mass * 0.25f),
+      physics::inertia::cube_element({-2.0f,  0.0f,  0.0f}, {1.26f, 0.10f, 3.80f}, mass * 0.05f),
+      physics::inertia::cube_element({ 2.0f,  0.0f,  0.0f}, {1.26f, 0.10f, 3.80f}, mass * 0.05f),
+      physics::inertia::cube_element({ 2.7f,  0.0f, -0.5f}, {3.50f, 0.10f, 6.96f}, mass * 0.25f),
+      physics::inertia::cube_element({ 0.0f, -0.1f, -6.6f}, {2.70f, 0.10f, 6.54f}, mass * 0.2f),
+      physics::inertia::cube_element({ 0.0f,  0.0f, -6.6f}, {0.10f, 3.10f, 5.31f}, mass * 0.2f),
+      };
+    }
+
+  const char* integrator_name(physics::integrator method)
+    {
+    switch (method)
+      {
+      case physics::integrator::semi_implicit_euler: return "semi_implicit_euler";
+      case physics::integrator::explicit_euler: return "explicit_euler";
+      case physics::integrator::rk4: return "rk4";
+      case physics::integrator::exponential_map: return "exponential_map";
+      }
+    return "unknown";
+    }
+
+  // torque free tumbling body with the full (non diagonal) inertia tensor of the default aircraft
+  physics::RigidBody make_tumbling_body(physics::integrator method)
+    {
+    const float mass = 10000.0f;
+    std::vector<physics::inertia::element> elements = default_inertia_elements(mass);
+    physics::RigidBodyParams pars;
+    pars.mass = mass;
+    pars.inertia = physics::inertia::tensor(elements, true);
+    pars.velocity = jtk::vec3<float>(0.f, 0.f, 150.f);
+    pars.angular_velocity = jtk::vec3<float>(0.3f, 1.0f, 0.2f);
+    pars.apply_gravity = true;
+    pars.method = method;
+    return physics::RigidBody(pars);
+    }
+
+  float rotational_energy(const physics::RigidBody& body)
+    {
+    const jtk::vec3<float> w = body.get_angular_velocity();
+    return 0.5f * jtk::dot(w, physics::utils::transform_vector(body.get_inertia(), w));
+    }
+
+  // angle in degrees of the rotation between two unit quaternions
+  float orientation_error(const jtk::float4& a, const jtk::float4& b)
+    {
+    float d = std::abs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+    d = physics::utils::min(d, 1.f);
+    return physics::units::degrees(2.f * std::acos(d));
+    }
+
+  void simulate(physics::RigidBody& body, physics::seconds dt, physics::seconds duration)
+    {
+    const int steps = static_cast<int>(duration / dt + 0.5f);
+    for (int i = 0; i < steps; ++i)
+      {
+      body.add_relative_torque(jtk::vec3<float>(0.f));
+      body.update(dt);
+      }
+    }
+
+  void bench_integrators()
+    {
+    const physics::integrator methods[] = {
+      physics::integrator::explicit_euler,
+      physics::integrator::semi_implicit_euler,
+      physics::integrator::exponential_map,
+      physics::integrator::rk4
+      };
+    const physics::seconds steps[] = { 0.002f, 0.01f, 0.02f, 0.05f };
+    const physics::seconds duration = 10.f;
+
+    physics::RigidBody reference = make_tumbling_body(physics::integrator::rk4);
+    simulate(reference, 0.0001f, duration);
+    const float reference_energy = rotational_energy(make_tumbling_body(physics::integrator::rk4));
+    // without aerodynamic forces the linear motion is ballistic, so the exact position is known
+    const physics::RigidBody initial = make_tumbling_body(physics::integrator::rk4);
+    const jtk::vec3<float> reference_position = initial.get_position() + initial.get_velocity() * duration - jtk::vec3<float>(0.f, 0.5f * physics::g * duration * duration, 0.f);
+
+    printf("integrator accuracy after %.1f s of torque free tumbling (reference: rk4 at dt = 0.0001 s, ballistic position)\n", duration);
+    printf("%-22s %8s %14s %14s %14s %12s\n", "integrator", "dt", "orient. [deg]", "position [m]", "energy drift", "ns/step");
+    for (auto method : methods)
+      {
+      // cost does not depend on dt: many steps with a small dt, so the state stays bounded
+      physics::RigidBody timed = make_tumbling_body(method);
+      const int iterations = 1000000;
+      auto tic = std::chrono::steady_clock::now();
+      simulate(timed, 0.0001f, iterations * 0.0001f);
+      auto toc = std::chrono::steady_clock::now();
+      const double ns = std::chrono::duration<double, std::nano>(toc - tic).count() / iterations;
+      record(std::string("integrators/method=") + integrator_name(method), "step", ns);
+
+      for (auto dt : steps)
+        {
+        physics::RigidBody body = make_tumbling_body(method);
+        simulate(body, dt, duration);
+        const float orientation = orientation_error(body.get_orientation(), reference.get_orientation());
+        const float position = jtk::length(body.get_position() - reference_position);
+        const float drift = (rotational_energy(body) - reference_energy) / reference_energy;
+
+        printf("%-22s %8.4f %14.6f %14.6f %14.6e %12.2f\n", integrator_name(method), dt, orientation, position, drift, ns);
+        }
+      }
+    }
+
+  void bench_airfoil()
+    {
+    const std::size_t n = 4096;
+    std::vector<float> alpha(n), cl(n), cd(n);
+    for (std::size_t i = 0; i < n; ++i)
+      alpha[i] = -25.f + 50.f * static_cast<float>(i) / static_cast<float>(n - 1);
+
+    const int iterations = 2000;
+    float checksum = 0.f;
+
+    auto tic = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+      {
+      for (std::size_t i = 0; i < n; ++i)
+        {
+        auto [l, d] = NACA_2412.sample(alpha[i]);
+        cl[i] = l;
+        cd[i] = d;
+        }
+      checksum += cl[it % n];
+      }
+    auto toc = std::chrono::steady_clock::now();
+    const double ns_scalar = std::chrono::duration<double, std::nano>(toc - tic).count() / (double(iterations) * n);
+
+    tic = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+      {
+      NACA_2412.sample(alpha.data(), cl.data(), cd.data(), n);
+      checksum += cl[it % n];
+      }
+    toc = std::chrono::steady_clock::now();
+    const double ns_batch = std::chrono::duration<double, std::nano>(toc - tic).count() / (double(iterations) * n);
+
+    record("airfoil/mode=scalar", "sample", ns_scalar);
+    record("airfoil/mode=batch", "sample", ns_batch);
+    printf("\nairfoil lookup (checksum %f)\n", checksum);
+    printf("%-22s %12.2f ns/sample\n", "scalar", ns_scalar);
+    printf("%-22s %12.2f ns/sample\n", "batch", ns_batch);
+    }
+
+  const std::size_t body_counts[] = { 1, 64, 1024 };
+  const int substep_counts[] = { 1, 4 };
+  const physics::seconds frame = 0.01f; // simulated time per operation, split into substeps
+  const int frames = 100;               // per timed run, one second of flight
+
+  std::string case_id(const char* group, std::size_t bodies, int substeps)
+    {
+    return std::string(group) + "/bodies=" + std::to_string(bodies) + "/substeps=" + std::to_string(substeps);
+    }
+
+  void bench_rigid_bodies()
+    {
+    printf("\nrigid body integration, %.0f ms of simulated time split into substeps\n", frame * 1000.f);
+    printf("%-10s %10s %18s %18s\n", "bodies", "substeps", "RigidBody ns/body", "batch ns/body");
+    for (auto n : body_counts)
+      {
+      for (auto substeps : substep_counts)
+        {
+        const physics::seconds h = frame / static_cast<float>(substeps);
+        const physics::RigidBody initial = make_tumbling_body(physics::integrator::semi_implicit_euler);
+        std::vector<physics::RigidBody> bodies;
+        physics::RigidBodyBatch batch;
+        const jtk::vec3<float> force(0.f, 1000.f, 5000.f), torque(10.f, 0.f, -5.f);
+        const double ns_single = measure([&]
+          {
+          bodies.assign(n, initial);
+          },
+          [&]
+          {
+          for (auto& body : bodies)
+            {
+            for (int k = 0; k < substeps; ++k)
+              {
+              body.add_relative_force(force);
+              body.add_relative_torque(torque);
+              body.update(h);
+              }
+            }
+          sink = bodies[0].get_position().y;
+          }, frames, static_cast<double>(n));
+        const double ns_batch = measure([&]
+          {
+          batch.clear();
+          batch.reserve(n);
+          physics::RigidBodyParams pars;
+          pars.mass = initial.get_mass();
+          pars.inertia = initial.get_inertia();
+          pars.velocity = initial.get_velocity();
+          pars.angular_velocity = initial.get_angular_velocity();
+          pars.apply_gravity = true;
+          for (std::size_t i = 0; i < n; ++i)
+            batch.add(pars);
+          },
+          [&]
+          {
+          for (int k = 0; k < substeps; ++k)
+            {
+            for (std::size_t i = 0; i < n; ++i)
+              {
+              batch.add_relative_force(i, force);
+              batch.add_relative_torque(i, torque);
+              }
+            batch.update(h);
+            }
+          sink = batch.get_position(0).y;
+          }, frames, static_cast<double>(n));
+        record(case_id("rigid_body", n, substeps), "frame of one body", ns_single);
+        record(case_id("rigid_body_batch", n, substeps), "frame of one body", ns_batch);
+        printf("%-10d %10d %18.2f %18.2f\n", (int)n, substeps, ns_single, ns_batch);
+        }
+      }
+    }
+
+  void bench_wings()
+    {
+    printf("\nwing forces of the default aircraft (WingSet::apply_forces and the RigidBody step that consumes them)\n");
+    printf("%-10s %10s %18s\n", "bodies", "substeps", "ns/body");
+    for (auto n : body_counts)
+      {
+      for (auto substeps : substep_counts)
+        {
+        const physics::seconds h = frame / static_cast<float>(substeps);
+        const std::shared_ptr<const AircraftType> type = default_aircraft_type();
+        const Aircraft initial = create_default_aircraft();
+        physics::RigidBody prototype = type->body;
+        prototype.set_position(initial.state.position);
+        prototype.set_velocity(initial.state.velocity);
+        std::vector<physics::RigidBody> bodies;
+        // the elevator of body i deflects by i % 5 - 2 degrees
+        std::vector<SurfaceDeflection> deflection(5 * type->wings.size());
+        for (std::size_t d = 0; d < 5; ++d)
+          deflection[d * type->wings.size() + 4].set(static_cast<float>(d) - 2.f);
+        const float air_density = physics::atmosphere::density(initial.state.position.y);
+        WingScratch scratch;
+        const double ns = measure([&]
+          {
+          bodies.assign(n, prototype);
+          },
+          [&]
+          {
+          for (std::size_t i = 0; i < n; ++i)
+            {
+            for (int k = 0; k < substeps; ++k)
+              {
+              type->wings.apply_forces(bodies[i], deflection.data() + (i % 5) * type->wings.size(), air_density, scratch);
+              bodies[i].update(h);
+              }
+            }
+          sink = bodies[0].get_position().y;
+          }, frames, static_cast<double>(n));
+        record(case_id("wings", n, substeps), "frame of one body", ns);
+        printf("%-10d %10d %18.2f\n", (int)n, substeps, ns);
+        }
+      }
+    }
+
+  void bench_inertia()
+    {
+    const std::vector<physics::inertia::element> elements = default_inertia_elements(10000.f);
+    const double ns = measure([] {}, [&]
+      {
+      for (int i = 0; i < 1000; ++i)
+        {
+        std::vector<physics::inertia::element> copy = elements;
+        sink = physics::inertia::tensor(copy, true).m[0];
+        }
+      }, 10, 1000.0);
+    record("inertia/elements=6", "tensor", ns);
+    printf("\ninertia tensor of the default aircraft (6 elements)\n%-22s %12.2f ns/tensor\n", "tensor", ns);
+    }
+
+  void bench_quaternion()
+    {
+    const std::size_t n = 4096;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::vector<jtk::float4> q(n);
+    std::vector<jtk::vec3<float>> v(n);
+    for (std::size_t i = 0; i < n; ++i)
+      {
+      q[i] = jtk::quaternion_normalize(jtk::float4(unit(rng), unit(rng), unit(rng), unit(rng)));
+      v[i] = jtk::vec3<float>(unit(rng), unit(rng), unit(rng));
+      }
+    // utils::rotate is the quaternion operator * of physics.cpp, behind RigidBody::transform_direction
+    const double ns = measure([] {}, [&]
+      {
+      float sum = 0.f;
+      for (std::size_t i = 0; i < n; ++i)
+        sum += physics::utils::rotate(q[i], v[i]).x;
+      sink = sum;
+      }, 100, static_cast<double>(n));
+    record("quaternion/op=rotate", "rotation", ns);
+    printf("\nquaternion rotation of a vector\n%-22s %12.2f ns/rotation\n", "rotate", ns);
+    }
+
+  void bench_atmosphere()
+    {
+    // aircraft spread over all altitudes, every call climbs by 0.5 m, like 50 m/s at 100 Hz
+    const std::size_t n = 1024;
+    std::vector<float> altitude(n);
+    for (std::size_t i = 0; i < n; ++i)
+      altitude[i] = 30000.f * static_cast<float>(i) / static_cast<float>(n);
+    const int climbs = 100;
+    std::vector<physics::atmosphere::density_cache> caches(n);
+
+    const double ns_exact = measure([] {}, [&]
+      {
+      float sum = 0.f;
+      for (std::size_t i = 0; i < n; ++i)
+        sum += physics::atmosphere::exact(altitude[i]).density;
+      sink = sum;
+      }, 10, static_cast<double>(n));
+    const double ns_table = measure([] {}, [&]
+      {
+      float sum = 0.f;
+      for (int k = 0; k < climbs; ++k)
+        for (std::size_t i = 0; i < n; ++i)
+          sum += physics::atmosphere::density(altitude[i] + 0.5f * k);
+      sink = sum;
+      }, 10, static_cast<double>(n) * climbs);
+    const double ns_cached = measure([&]
+      {
+      for (auto& c : caches)
+        c.clear();
+      },
+      [&]
+      {
+      float sum = 0.f;
+      for (int k = 0; k < climbs; ++k)
+        for (std::size_t i = 0; i < n; ++i)
+          sum += caches[i].density(altitude[i] + 0.5f * k);
+      sink = sum;
+      }, 10, static_cast<double>(n) * climbs);
+
+    record("atmosphere/mode=exact", "density", ns_exact);
+    record("atmosphere/mode=table", "density", ns_table);
+    record("atmosphere/mode=cached", "density", ns_cached);
+    printf("\nair density of %d aircraft climbing 0.5 m per call\n", (int)n);
+    printf("%-22s %12.2f ns/density\n", "exact", ns_exact);
+    printf("%-22s %12.2f ns/density\n", "table", ns_table);
+    printf("%-22s %12.2f ns/density\n", "cached", ns_cached);
+    }
+
+  void bench_aircraft()
+    {
+    printf("\nstep_aircraft of the default aircraft in cruise, states in a flat array\n");
+    printf("%-10s %10s %18s\n", "bodies", "substeps", "ns/body");
+    for (auto n : body_counts)
+      {
+      for (auto substeps : substep_counts)
+        {
+        const physics::seconds h = frame / static_cast<float>(substeps);
+        const Aircraft initial = create_default_aircraft();
+        std::vector<AircraftState> states;
+        AircraftScratch scratch;
+        const double ns = measure([&]
+          {
+          states.assign(n, initial.state);
+          for (std::size_t i = 0; i < n; ++i)
+            states[i].joystick = jtk::vec3<float>(0.1f * static_cast<float>(i % 3), 0.f, -0.05f);
+          },
+          [&]
+          {
+          for (auto& state : states)
+            {
+            for (int k = 0; k < substeps; ++k)
+              step_aircraft(*initial.type, state, h, nullptr, scratch);
+            }
+          sink = states[0].position.y;
+          }, frames, static_cast<double>(n));
+        record(case_id("aircraft", n, substeps), "frame of one aircraft", ns);
+        printf("%-10d %10d %18.2f\n", (int)n, substeps, ns);
+        }
+      }
+    }
+
+  void bench_world()
+    {
+    const std::size_t n = 10000;
+    const int steps = 100;
+    const physics::seconds dt = 0.01f;
+    const Aircraft aircraft = create_default_aircraft();
+
+    printf("\nstepping %d aircraft at %.0f Hz\n", (int)n, 1.f / dt);
+    printf("%-10s %14s %14s %10s\n", "threads", "ms/step", "real time x", "speedup");
+    double single = 0.0;
+    for (std::size_t threads = 1; threads <= std::max<std::size_t>(1, std::thread::hardware_concurrency()); threads *= 2)
+      {
+      ThreadPool pool(threads - 1);
+      World world(pool);
+      world.reserve(n);
+      for (std::size_t i = 0; i < n; ++i)
+        world.add(aircraft);
+
+      auto tic = std::chrono::steady_clock::now();
+      for (int s = 0; s < steps; ++s)
+        world.step(dt);
+      auto toc = std::chrono::steady_clock::now();
+      const double ms = std::chrono::duration<double, std::milli>(toc - tic).count() / steps;
+      if (threads == 1)
+        single = ms;
+      record("world/aircraft=" + std::to_string(n) + "/threads=" + std::to_string(threads), "step of all aircraft", ms * 1e6);
+      printf("%-10d %14.3f %14.2f %10.2f\n", (int)threads, ms, 1000.0 * dt / ms, single / ms);
+      }
+    }
+
+  void bench_terrain()
+    {
+    std::vector<uint16_t> heights;
+    uint32_t w, h;
+    const bool loaded = load_heightmap("assets/textures/terrain/heightmap.png", heights, w, h) && w == h;
+    if (!loaded)
+      {
+      // rolling hills when the bench does not run next to the assets
+      w = h = 1024;
+      heights.resize(w * h);
+      for (uint32_t y = 0; y < h; ++y)
+        for (uint32_t x = 0; x < w; ++x)
+          heights[y * w + x] = (uint16_t)(32767.5f + 32767.f * std::sin(x * 0.0245f) * std::cos(y * 0.0184f));
+      }
+    TerrainField field;
+    field.build(heights.data(), w);
+
+    const std::size_t n = 1 << 16;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-100000.f, 100000.f);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::vector<float> x(n), z(n), out(n);
+    std::vector<TerrainRay> rays(n);
+    for (std::size_t i = 0; i < n; ++i)
+      {
+      x[i] = position(rng);
+      z[i] = position(rng);
+      // radar altimeter like rays, straight down to slanted, from a few hundred meters to a few kilometers up
+      jtk::vec3<float> d(0.5f * unit(rng), -1.f, 0.5f * unit(rng));
+      rays[i].direction = d / jtk::length(d);
+      rays[i].origin = jtk::vec3<float>(x[i], field.height(x[i], z[i]) + 300.f + 1500.f * (unit(rng) + 1.f), z[i]);
+      rays[i].max_distance = 20000.f;
+      }
+
+    const int iterations = 20;
+    float checksum = 0.f;
+    auto tic = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+      {
+      field.height(x.data(), z.data(), out.data(), n);
+      checksum += out[it];
+      }
+    auto toc = std::chrono::steady_clock::now();
+    const double ns_height = std::chrono::duration<double, std::nano>(toc - tic).count() / (double(iterations) * n);
+
+    tic = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+      {
+      for (std::size_t i = 0; i < n; ++i)
+        checksum += field.normal(x[i], z[i]).y;
+      }
+    toc = std::chrono::steady_clock::now();
+    const double ns_normal = std::chrono::duration<double, std::nano>(toc - tic).count() / (double(iterations) * n);
+
+    tic = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+      {
+      field.intersect(rays.data(), n, out.data());
+      checksum += out[it];
+      }
+    toc = std::chrono::steady_clock::now();
+    const double ns_ray = std::chrono::duration<double, std::nano>(toc - tic).count() / (double(iterations) * n);
+
+    record("terrain/query=height", "query", ns_height);
+    record("terrain/query=normal", "query", ns_normal);
+    record("terrain/query=ray", "query", ns_ray);
+    printf("\nterrain queries on a %dx%d %s (checksum %f)\n", (int)w, (int)h, loaded ? "heightmap" : "synthetic heightmap", checksum);
+    printf("%-22s %12.2f ns/query\n", "height", ns_height);
+    printf("%-22s %12.2f ns/query\n", "normal", ns_normal);
+    printf("%-22s %12.2f ns/query\n", "ray", ns_ray);
+    }
+
+  std::string json_string(const std::string& s)
+    {
+    std::string out = "\"";
+    for (char c : s)
+      {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      out += c;
+      }
+    return out + "\"";
+    }
+
+  // one case per line, so that read_json does not need a full json parser
+  void write_json(const std::string& filename)
+    {
+    FILE* f = fopen(filename.c_str(), "w");
+    if (!f)
+      throw std::runtime_error("cannot open " + filename);
+    fprintf(f, "{\n  \"hardware_threads\": %u,\n  \"benchmarks\": [\n", std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < results.size(); ++i)
+      {
+      const Result& r = results[i];
+      fprintf(f, "    {\"id\": %s, \"operation\": %s, \"ns_per_op\": %.3f}%s\n",
+        json_string(r.id).c_str(), json_string(r.operation).c_str(), r.ns, i + 1 < results.size() ? "," : "");
+      }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    }
+
+  std::map<std::string, double> read_json(const std::string& filename)
+    {
+    std::ifstream f(filename);
+    if (!f.is_open())
+      throw std::runtime_error("cannot open " + filename);
+    std::map<std::string, double> ns;
+    std::string line;
+    const std::string id_key = "\"id\": \"";
+    const std::string ns_key = "\"ns_per_op\": ";
+    while (std::getline(f, line))
+      {
+      const auto id = line.find(id_key);
+      const auto value = line.find(ns_key);
+      if (id == std::string::npos || value == std::string::npos)
+        continue;
+      const auto id_begin = id + id_key.size();
+      ns[line.substr(id_begin, line.find('"', id_begin) - id_begin)] = std::atof(line.c_str() + value + ns_key.size());
+      }
+    return ns;
+    }
+
+  // returns the number of cases that are more than tolerance slower than in the baseline
+  int compare(const std::string& filename, double tolerance)
+    {
+    const std::map<std::string, double> baseline = read_json(filename);
+    printf("\ncomparison with %s (tolerance %.0f%%)\n", filename.c_str(), tolerance * 100.0);
+    int regressions = 0;
+    for (const Result& r : results)
+      {
+      auto it = baseline.find(r.id);
+      if (it == baseline.end() || it->second <= 0.0)
+        continue;
+      const double change = r.ns / it->second - 1.0;
+      const bool regression = change > tolerance;
+      regressions += regression ? 1 : 0;
+      printf("%-40s %12.2f %12.2f %+8.1f%%%s\n", r.id.c_str(), it->second, r.ns, change * 100.0, regression ? "  REGRESSION" : "");
+      }
+    return regressions;
+    }
+
+  }
+
+int main(int argc, char** argv)
+  {
+  std::string filter, json, baseline;
+  double tolerance = 0.1;
+  for (int i = 1; i < argc; ++i)
+    {
+    const std::string arg(argv[i]);
+    if (i + 1 >= argc)
+      {
+      fprintf(stderr, "flightsim_bench: missing value for option %s\n", arg.c_str());
+      return 1;
+      }
+    if (arg == "--filter")
+      filter = argv[++i];
+    else if (arg == "--json")
+      json = argv[++i];
+    else if (arg == "--compare")
+      baseline = argv[++i];
+    else if (arg == "--tolerance")
+      tolerance = std::atof(argv[++i]);
+    else
+      {
+      fprintf(stderr, "flightsim_bench: unknown option %s\n", arg.c_str());
+      return 1;
+      }
+    }
+
+  const std::pair<const char*, void(*)()> groups[] = {
+    { "integrators", bench_integrators },
+    { "airfoil", bench_airfoil },
+    { "rigid_body", bench_rigid_bodies },
+    { "wings", bench_wings },
+    { "inertia", bench_inertia },
+    { "quaternion", bench_quaternion },
+    { "atmosphere", bench_atmosphere },
+    { "aircraft", bench_aircraft },
+    { "world", bench_world },
+    { "terrain", bench_terrain },
+    };
+  try
+    {
+    for (const auto& group : groups)
+      {
+      if (std::string(group.first).find(filter) != std::string::npos)
+        group.second();
+      }
+    if (!json.empty())
+      write_json(json);
+    if (!baseline.empty() && compare(baseline, tolerance) > 0)
+      return 1;
+    }
+  catch (std::exception& e)
+    {
+    fprintf(stderr, "flightsim_bench: %s\n", e.what());
+    return 1;
+    }
+  return 0;
+  }
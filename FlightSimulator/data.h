@@ -1,10 +1,10 @@
 #pragma once
 
 #include "flightmodel.h"
-#include <vector>
+#include <array>
 
 // NACA 0012 (n0012-il) Xfoil prediction polar at RE=1,000,000 Ncrit=9
-std::vector<ValueTuple> NACA_0012_data = {
+inline constexpr std::array<ValueTuple, 147> NACA_0012_data = {{
     {-18.500f, -1.2258f, 0.10236f},
     {-18.250f, -1.2456f, 0.09505f},
     {-18.000f, -1.2659f, 0.08782f},
@@ -151,10 +151,10 @@ std::vector<ValueTuple> NACA_0012_data = {
     {17.750f, 1.2880f, 0.08075f},
     {18.000f, 1.2685f, 0.08773f},
     {18.250f, 1.2485f, 0.09493f},
-    {18.500f, 1.2284f, 0.10229f} };
+    {18.500f, 1.2284f, 0.10229f} }};
 
 // NACA 2412 (naca2412-il) Xfoil prediction polar at RE=1,000,000 Ncrit=9
-std::vector<ValueTuple> NACA_2412_data = {
+inline constexpr std::array<ValueTuple, 145> NACA_2412_data = {{
     {-17.500f, -1.1118f, 0.08608f},
     {-17.250f, -1.1738f, 0.07238f},
     {-17.000f, -1.2296f, 0.05928f},
@@ -300,6 +300,6 @@ std::vector<ValueTuple> NACA_2412_data = {
     {18.750f, 1.5083f, 0.08321f},
     {19.000f, 1.4942f, 0.08893f},
     {19.250f, 1.4781f, 0.09506f},
-  };
+  }};
 
 
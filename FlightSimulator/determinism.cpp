@@ -0,0 +1,65 @@
+#include "determinism.h"
+#include "simd.h"
+
+#include <cfenv>
+#include <cstring>
+
+namespace physics
+  {
+
+  fp_environment::fp_environment() : m_rounding(std::fegetround()), m_csr(0)
+    {
+    std::fesetround(FE_TONEAREST);
+#if defined(FLIGHTSIM_SSE2)
+    m_csr = _mm_getcsr();
+    // clear flush-to-zero (bit 15) and denormals-are-zero (bit 6)
+    _mm_setcsr(m_csr & ~((1u << 15) | (1u << 6)));
+#endif
+    }
+
+  fp_environment::~fp_environment()
+    {
+#if defined(FLIGHTSIM_SSE2)
+    _mm_setcsr(m_csr);
+#endif
+    std::fesetround(m_rounding);
+    }
+
+  uint64_t hash(const void* data, std::size_t size, uint64_t h)
+    {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i)
+      {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+      }
+    return h;
+    }
+
+  uint64_t hash(float value, uint64_t h)
+    {
+    // hash the little endian byte order of the bit pattern, so the hash is the same on every platform
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const unsigned char bytes[4] = { (unsigned char)(bits & 0xff), (unsigned char)((bits >> 8) & 0xff), (unsigned char)((bits >> 16) & 0xff), (unsigned char)(bits >> 24) };
+    return hash(bytes, sizeof(bytes), h);
+    }
+
+  uint64_t hash(const RigidBody& body, uint64_t h)
+    {
+    const jtk::vec3<float> p = body.get_position();
+    const jtk::float4 q = body.get_orientation();
+    const jtk::vec3<float> v = body.get_velocity();
+    const jtk::vec3<float> w = body.get_angular_velocity();
+    for (int i = 0; i < 3; ++i)
+      h = hash(p[i], h);
+    for (int i = 0; i < 4; ++i)
+      h = hash(q[i], h);
+    for (int i = 0; i < 3; ++i)
+      h = hash(v[i], h);
+    for (int i = 0; i < 3; ++i)
+      h = hash(w[i], h);
+    return h;
+    }
+
+  } // namespace physics
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "physics.h"
+
+#include <cmath>
+#include <stdint.h>
+
+// Building with FLIGHTSIM_DETERMINISTIC (CMake option of the same name) gives bit-reproducible physics:
+// identical inputs and a fixed dt give identical states across runs, machines and compilers.
+// This needs three things:
+//  - no contraction of a * b + c into fused multiply-adds, which the CMake option takes care of,
+//  - the same rounding and denormal handling in every thread that steps physics, see fp_environment,
+//  - math functions with the same result everywhere. IEEE 754 requires a correctly rounded sqrt,
+//    but sin, cos and asin differ between C runtimes, so the simulation uses physics::math instead.
+
+namespace physics
+  {
+
+  namespace math
+    {
+
+    // only + - * / and sqrt, evaluated in a fixed order, so the result is the same on every IEEE 754 target
+    namespace portable
+      {
+
+      // Cephes sinf/cosf: reduction to [-pi/4, pi/4] in three parts, then a minimax polynomial.
+      // Accurate to a few ulp for |x| < 8192.
+      inline float sin_cos(float x, bool cosine)
+        {
+        constexpr float four_over_pi = 1.27323954473516f;
+        constexpr float dp1 = 0.78515625f;
+        constexpr float dp2 = 2.4187564849853515625e-4f;
+        constexpr float dp3 = 3.77489497744594108e-8f;
+
+        float sign = 1.f;
+        if (x < 0.f)
+          {
+          x = -x;
+          if (!cosine)
+            sign = -1.f;
+          }
+        int j = static_cast<int>(x * four_over_pi);
+        float y = static_cast<float>(j);
+        if (j & 1)
+          {
+          j += 1;
+          y += 1.f;
+          }
+        j &= 7;
+        if (j > 3)
+          {
+          sign = -sign;
+          j -= 4;
+          }
+        if (cosine && j > 1)
+          sign = -sign;
+
+        x = ((x - y * dp1) - y * dp2) - y * dp3;
+        const float z = x * x;
+        const bool use_cosine_polynomial = cosine ? (j == 0 || j == 3) : (j == 1 || j == 2);
+        if (use_cosine_polynomial)
+          y = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.f;
+        else
+          y = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+        return sign * y;
+        }
+
+      inline float sin(float x)
+        {
+        return sin_cos(x, false);
+        }
+
+      inline float cos(float x)
+        {
+        return sin_cos(x, true);
+        }
+
+      // Cephes asinf, accurate to a few ulp on [-1, 1]
+      inline float asin(float x)
+        {
+        const float a = x < 0.f ? -x : x;
+        float z, s;
+        if (a > 0.5f)
+          {
+          z = 0.5f * (1.f - a);
+          s = std::sqrt(z);
+          }
+        else
+          {
+          z = a * a;
+          s = a;
+          }
+        const float p = ((((4.2163199048e-2f * z + 2.4181311049e-2f) * z + 4.5470025998e-2f) * z + 7.4953002686e-2f) * z + 1.6666752422e-1f) * z * s + s;
+        const float r = a > 0.5f ? 1.5707963267948966f - 2.f * p : p;
+        return x < 0.f ? -r : r;
+        }
+
+      } // namespace portable
+
+#if defined(FLIGHTSIM_DETERMINISTIC)
+    inline float sin(float x) { return portable::sin(x); }
+    inline float cos(float x) { return portable::cos(x); }
+    inline float asin(float x) { return portable::asin(x); }
+#else
+    inline float sin(float x) { return std::sin(x); }
+    inline float cos(float x) { return std::cos(x); }
+    inline float asin(float x) { return std::asin(x); }
+#endif
+    // correctly rounded by IEEE 754, hence already portable
+    inline float sqrt(float x) { return std::sqrt(x); }
+
+    } // namespace math
+
+  // Sets round to nearest and disables flush-to-zero and denormals-are-zero for the lifetime of the object,
+  // as drivers and plugins are known to change these. The floating point environment is per thread, so every
+  // thread that steps physics needs its own guard.
+  class fp_environment
+    {
+    public:
+      fp_environment();
+      ~fp_environment();
+
+      fp_environment(const fp_environment&) = delete;
+      fp_environment& operator = (const fp_environment&) = delete;
+
+    private:
+      int m_rounding;
+      uint32_t m_csr;
+    };
+
+  // FNV-1a hash over the bit patterns of the state, for comparing runs
+  constexpr uint64_t hash_seed = 14695981039346656037ull;
+
+  uint64_t hash(const void* data, std::size_t size, uint64_t h = hash_seed);
+  uint64_t hash(float value, uint64_t h = hash_seed);
+  uint64_t hash(const RigidBody& body, uint64_t h = hash_seed);
+
+  } // namespace physics
@@ -1,39 +1,57 @@
 #include "flightmodel.h"
+#include "aircraft_type.h"
+#include "determinism.h"
 #include "data.h"
-#include <cassert>
+#include "simd.h"
 
+#include <cstring>
 
-Airfoil::Airfoil(const std::vector<ValueTuple>& curve_data) : data(curve_data)
+namespace
   {
-  min = curve_data[0].alpha;
-  max = curve_data[curve_data.size() - 1].alpha;
-  }
-
-std::tuple<float, float> Airfoil::sample(float alpha) const
-  {
-  int index = static_cast<int>(physics::utils::scale(alpha, min, max, 0, static_cast<float>(data.size() - 1)));
-  index = physics::utils::clamp(index, 0, static_cast<int>(data.size() - 1U));
-  if (!(0 <= index && index < data.size()))
+  template <class V>
+  std::size_t sample_range(const Airfoil& airfoil, const float* alpha, float* cl, float* cd, std::size_t begin, std::size_t end)
     {
-    printf("alpha = %f, index = %d, size = %d\n", alpha, index, (int)data.size());
-    assert(0);
+    const V lo(airfoil.min);
+    const V inverse_step(airfoil.inverse_step);
+    const V last(static_cast<float>(Airfoil::table_size - 1));
+    const V last_segment(static_cast<float>(Airfoil::table_size - 2));
+    std::size_t i = begin;
+    for (; i + V::width <= end; i += V::width)
+      {
+      // clamping t also takes care of alpha outside [min, max], and the operand order maps a NaN alpha to 0, so the
+      // gather stays inside the table
+      V t = simd::min(simd::max((V::loadu(alpha + i) - lo) * inverse_step, V(0.f)), last);
+      V index = simd::min(simd::truncate(t), last_segment);
+      V f = t - index;
+      V cl0 = simd::gather(airfoil.cl, index);
+      V cd0 = simd::gather(airfoil.cd, index);
+      V cl1 = simd::gather(airfoil.cl + 1, index);
+      V cd1 = simd::gather(airfoil.cd + 1, index);
+      (cl0 + (cl1 - cl0) * f).storeu(cl + i);
+      (cd0 + (cd1 - cd0) * f).storeu(cd + i);
+      }
+    return i;
     }
-  return { data[index].cl, data[index].cd };
   }
 
-Airfoil NACA_0012(NACA_0012_data);
-Airfoil NACA_2412(NACA_2412_data);
-
-Engine::Engine(float thrust) : thrust(thrust)
+std::tuple<float, float> Airfoil::sample(float alpha) const
   {
+  // utils::max returns its second operand for a NaN alpha, like sample_range
+  const float t = physics::utils::min(physics::utils::max((alpha - min) * inverse_step, 0.f), static_cast<float>(table_size - 1));
+  const int index = physics::utils::min(static_cast<int>(t), table_size - 2);
+  const float f = t - static_cast<float>(index);
+  return { physics::utils::lerp(cl[index], cl[index + 1], f), physics::utils::lerp(cd[index], cd[index + 1], f) };
   }
 
-void Engine::apply_forces(physics::RigidBody& rigid_body)
+void Airfoil::sample(const float* alpha, float* cl_out, float* cd_out, std::size_t n) const
   {
-  float force = thrust * throttle;
-  rigid_body.add_relative_force({ 0.0f, 0.0f, force });
+  std::size_t i = sample_range<simd::widest>(*this, alpha, cl_out, cd_out, 0, n);
+  sample_range<simd::lane1>(*this, alpha, cl_out, cd_out, i, n);
   }
 
+constexpr Airfoil NACA_0012(NACA_0012_data);
+constexpr Airfoil NACA_2412(NACA_2412_data);
+
 Wing::Wing(const jtk::vec3<float>& position, float area, const Airfoil* aero, const jtk::vec3<float>& normal)
   : position(position),
   area(area),
@@ -50,96 +68,213 @@ Wing::Wing(const jtk::vec3<float>& position, float wingspan, float chord, const
   {
   }
 
-void Wing::apply_forces(physics::RigidBody& rigid_body)
+WingSet::WingSet()
+  {
+  }
+
+WingSet::WingSet(const std::vector<Wing>& wings)
+  {
+  for (const Wing& wing : wings)
+    add(wing);
+  }
+
+std::size_t WingSet::add(const Wing& wing)
   {
-  jtk::vec3<float> local_velocity = rigid_body.get_point_velocity(position);
-  float speed = jtk::length(local_velocity);
+  const std::size_t i = size();
+  // the surface hinges around the axis perpendicular to the flight direction and its normal,
+  // so for a positive deflection the normal rotates towards hinge x normal
+  const jtk::vec3<float> hinge = jtk::normalize(jtk::cross(physics::FORWARD, wing.normal));
+  const jtk::vec3<float> tangent = jtk::cross(hinge, wing.normal);
+  for (int j = 0; j < 3; ++j)
+    {
+    m_position[j].push_back(wing.position[j]);
+    m_normal[j].push_back(wing.normal[j]);
+    m_tangent[j].push_back(tangent[j]);
+    }
+  m_area.push_back(wing.area);
+  m_lift_multiplier.push_back(wing.lift_multiplier);
+  m_drag_multiplier.push_back(wing.drag_multiplier);
+  m_airfoil.push_back(wing.airfoil);
 
-  if (speed <= 0.0f)
+  if (!m_runs.empty() && m_runs.back().airfoil == wing.airfoil)
+    m_runs.back().end = i + 1;
+  else
+    m_runs.push_back({ wing.airfoil, i, i + 1 });
+  return i;
+  }
+
+void SurfaceDeflection::set(float deflection)
+  {
+  // bitwise, so that -0 and NaN also keep their rotation
+  if (std::memcmp(&degrees, &deflection, sizeof(float)) == 0)
     return;
+  degrees = deflection;
+  const float angle = physics::units::radians(deflection);
+  cosine = physics::math::cos(angle);
+  sine = physics::math::sin(angle);
+  }
 
-  jtk::vec3<float> wing_normal = normal;
+void WingSet::apply_forces(physics::RigidBody& rigid_body, const SurfaceDeflection* deflection, float air_density, WingScratch& scratch) const
+  {
+  const std::size_t n = size();
+  for (int j = 0; j < 3; ++j)
+    {
+    scratch.deflected_normal[j].resize(n);
+    scratch.drag_direction[j].resize(n);
+    }
+  scratch.dynamic_pressure.resize(n);
+  scratch.alpha_sine.resize(n);
+  scratch.alpha.resize(n);
+  scratch.cl.resize(n);
+  scratch.cd.resize(n);
 
-  if (abs(deflection) > physics::epsilon)
+  for (std::size_t i = 0; i < n; ++i)
     {
-    // set rotation of wing    
-    auto axis = jtk::normalize(jtk::cross(physics::FORWARD, normal));    
-    jtk::float4x4 rot = jtk::make_rotation(physics::ORIGIN, axis, physics::units::radians(deflection));
-    wing_normal = physics::utils::transform_vector(rot, normal);
+    if (deflection && deflection[i].degrees != 0.f)
+      {
+      // Rodrigues' rotation around the hinge, which is perpendicular to the normal
+      const float c = deflection[i].cosine;
+      const float s = deflection[i].sine;
+      for (int j = 0; j < 3; ++j)
+        scratch.deflected_normal[j][i] = m_normal[j][i] * c + m_tangent[j][i] * s;
+      }
+    else
+      {
+      for (int j = 0; j < 3; ++j)
+        scratch.deflected_normal[j][i] = m_normal[j][i];
+      }
     }
 
-  // drag acts in the opposite direction of velocity
-  jtk::vec3<float> drag_direction = jtk::normalize(-local_velocity);
+  const jtk::vec3<float> v = rigid_body.inverse_transform_direction(rigid_body.get_velocity());
+  const jtk::vec3<float> w = rigid_body.get_angular_velocity();
 
-  // lift is always perpendicular to drag
-  jtk::vec3<float> lift_direction
-    = jtk::normalize(jtk::cross(jtk::cross(drag_direction, wing_normal), drag_direction));
+  // airflow at every surface in body space
+  for (std::size_t i = 0; i < n; ++i)
+    {
+    const float px = m_position[0][i], py = m_position[1][i], pz = m_position[2][i];
+    const float lx = v.x + w.y * pz - w.z * py;
+    const float ly = v.y + w.z * px - w.x * pz;
+    const float lz = v.z + w.x * py - w.y * px;
+    const float speed2 = lx * lx + ly * ly + lz * lz;
+    // a surface at rest gets zero drag direction and dynamic pressure, and hence no force
+    const float inv_speed = speed2 > 0.f ? 1.f / physics::math::sqrt(speed2) : 0.f;
 
-  // angle between wing and air flow
-  float angle_of_attack = physics::units::degrees(std::asin(jtk::dot(drag_direction, wing_normal)));
+    // drag acts in the opposite direction of velocity
+    const float dx = -lx * inv_speed, dy = -ly * inv_speed, dz = -lz * inv_speed;
+    scratch.drag_direction[0][i] = dx;
+    scratch.drag_direction[1][i] = dy;
+    scratch.drag_direction[2][i] = dz;
+    scratch.dynamic_pressure[i] = 0.5f * speed2 * air_density * m_area[i];
+
+    // angle between wing and air flow
+    const float sine = physics::utils::clamp(dx * scratch.deflected_normal[0][i] + dy * scratch.deflected_normal[1][i] + dz * scratch.deflected_normal[2][i], -1.f, 1.f);
+    scratch.alpha_sine[i] = sine;
+    scratch.alpha[i] = physics::units::degrees(physics::math::asin(sine));
+    }
 
   // sample our aerodynamic data
-  auto [lift_coefficient, drag_coefficient] = airfoil->sample(angle_of_attack);
+  for (const AirfoilRun& run : m_runs)
+    run.airfoil->sample(scratch.alpha.data() + run.begin, scratch.cl.data() + run.begin, scratch.cd.data() + run.begin, run.end - run.begin);
+
+  jtk::vec3<float> force(0.f);
+  jtk::vec3<float> torque(0.f);
+  for (std::size_t i = 0; i < n; ++i)
+    {
+    const jtk::vec3<float> drag_direction(scratch.drag_direction[0][i], scratch.drag_direction[1][i], scratch.drag_direction[2][i]);
+    const jtk::vec3<float> normal(scratch.deflected_normal[0][i], scratch.deflected_normal[1][i], scratch.deflected_normal[2][i]);
 
-  float air_density = physics::rho;
+    // lift is always perpendicular to drag: (d x n) x d = n - d (d.n), with length cos(alpha)
+    const float sine = scratch.alpha_sine[i];
+    const float inv_cosine = 1.f / physics::math::sqrt(physics::utils::max(1.f - sine * sine, physics::epsilon));
+    const jtk::vec3<float> lift_direction = (normal - drag_direction * sine) * inv_cosine;
 
-  float tmp = 0.5f * physics::sq(speed) * air_density * area;
-  jtk::vec3<float> lift = lift_direction * lift_coefficient * lift_multiplier * tmp;
-  jtk::vec3<float> drag = drag_direction * drag_coefficient * drag_multiplier * tmp;
+    const float q = scratch.dynamic_pressure[i];
+    const jtk::vec3<float> f = lift_direction * (scratch.cl[i] * m_lift_multiplier[i] * q) + drag_direction * (scratch.cd[i] * m_drag_multiplier[i] * q);
+    const jtk::vec3<float> p(m_position[0][i], m_position[1][i], m_position[2][i]);
+    force = force + f;
+    torque = torque + jtk::cross(p, f);
+    }
 
-  // apply forces
-  rigid_body.add_force_at_point(lift + drag, position);
+  rigid_body.add_relative_force(force);
+  rigid_body.add_relative_torque(torque);
   }
 
-Aircraft::Aircraft(float mass, float thrust, jtk::matf9 inertia, std::vector<Wing> wings) : 
-  elements(wings), engine(thrust)
+AircraftState::AircraftState() :
+  position(0.f), orientation(0.f, 0.f, 0.f, 1.f), velocity(0.f), angular_velocity(0.f), joystick(0.f), throttle(0.5f), flags(0)
   {
-  physics::RigidBodyParams pars;
-  pars.mass = mass;
-  pars.inertia = inertia;
-  rigid_body = physics::RigidBody(pars);
+  atmosphere.clear();
   }
 
-void Aircraft::update(physics::seconds dt)
+jtk::vec3<float> AircraftState::transform_direction(const jtk::vec3<float>& direction) const
   {
-  Wing& la = elements[1];
-  Wing& ra = elements[2];
-  Wing& el = elements[4];
-  Wing& ru = elements[5];
-  
-  float pitch = joystick.x;
-  float yaw = joystick.y;  
-  float roll = joystick.z;
-  float max_elevator_deflection = 5.0f, max_aileron_deflection = 15.0f, max_rudder_deflection = 5.0f;
-  float aileron_deflection = roll * max_aileron_deflection;
+  return physics::utils::rotate(orientation, direction);
+  }
 
-  la.deflection = +aileron_deflection;
-  ra.deflection = -aileron_deflection;
-  el.deflection = -(pitch * max_elevator_deflection);
-  ru.deflection = yaw * max_rudder_deflection;
+void step_aircraft(const AircraftType& type, AircraftState& state, physics::seconds dt, const TerrainField* terrain, AircraftScratch& scratch)
+  {
+  // the wreck stays where it came down
+  if (state.is_crashed())
+    return;
 
-  for (Wing& wing : elements)
+  // the mixing table is sorted by surface, every run of entries sums to the deflection of one surface
+  scratch.deflection.assign(type.wings.size(), SurfaceDeflection());
+  const float input[number_of_control_inputs] = { state.joystick.x, state.joystick.y, state.joystick.z };
+  const std::vector<ControlMix>& controls = type.controls;
+  std::size_t run = 0;
+  for (std::size_t i = 0; i < controls.size(); ++run)
     {
-    wing.apply_forces(rigid_body);
+    const uint32_t surface = controls[i].surface;
+    float deflection = input[controls[i].input] * controls[i].gain;
+    for (++i; i < controls.size() && controls[i].surface == surface; ++i)
+      deflection += input[controls[i].input] * controls[i].gain;
+    if (run < max_kept_deflections)
+      {
+      state.deflection[run].set(deflection);
+      scratch.deflection[surface] = state.deflection[run];
+      }
+    else
+      scratch.deflection[surface].set(deflection);
     }
 
-  engine.apply_forces(rigid_body);
+  // the type holds a body at rest with the mass and inertia, only the kinematic state comes from the aircraft
+  physics::RigidBody body = type.body;
+  body.set_position(state.position);
+  body.set_orientation(state.orientation);
+  body.set_velocity(state.velocity);
+  body.set_angular_velocity(state.angular_velocity);
 
-  if ((log_timer += dt) > 0.5f)
-    {
-    log_timer = 0;
-#if 0
-    printf(
-      "%.2f km/h, thr: %.2f, alt: %.2f m,  ang. vel: %.2f, %.2f, %.2f\n",
-      physics::units::kilometer_per_hour(jtk::length(rigid_body.get_velocity())),
-      engine.throttle,
-      rigid_body.get_position().y,
-      rigid_body.get_angular_velocity().x,
-      rigid_body.get_angular_velocity().y,
-      rigid_body.get_angular_velocity().z
-    );
-#endif
-    }
+  // world height is altitude above mean sea level
+  type.wings.apply_forces(body, scratch.deflection.data(), state.atmosphere.density(state.position.y), scratch.wings);
+  body.add_relative_force({ 0.0f, 0.0f, type.thrust * state.throttle });
+  type.gear.integrate(body, dt, terrain, state.flags);
 
-  rigid_body.update(dt);
-  }
\ No newline at end of file
+  state.position = body.get_position();
+  state.orientation = body.get_orientation();
+  state.velocity = body.get_velocity();
+  state.angular_velocity = body.get_angular_velocity();
+  }
+
+Aircraft::Aircraft(std::shared_ptr<const AircraftType> type) : type(type)
+  {
+  }
+
+void Aircraft::update(physics::seconds dt, const TerrainField* terrain)
+  {
+  step_aircraft(*type, state, dt, terrain, scratch);
+  }
+
+Aircraft create_default_aircraft()
+  {
+  return create_default_aircraft(default_aircraft_type());
+  }
+
+Aircraft create_default_aircraft(std::shared_ptr<const AircraftType> type)
+  {
+  jtk::vec3<float> position = jtk::vec3<float>(0.0f, 4000.0f, 0.0f);
+  jtk::vec3<float> velocity = jtk::vec3<float>(0.0f, 0.0f, physics::units::meter_per_second(600.0f));
+
+  Aircraft aircraft(type);
+  aircraft.state.position = position;
+  aircraft.state.velocity = velocity;
+  return aircraft;
+  }
@@ -1,36 +1,67 @@
 #pragma once
 
+#include <memory>
+#include <stdint.h>
+#include <type_traits>
 #include <vector>
+#include "atmosphere.h"
+#include "landing_gear.h"
 #include "physics.h"
+#include "simd.h"
 
 struct ValueTuple
   {
   float alpha, cl, cd;
   };
 
+// Polar resampled on a uniform grid of table_size angles between the first and last measured alpha,
+// so that a lookup is a multiply, a truncation and a linear interpolation.
 struct Airfoil
   {
+  static constexpr int table_size = 256;
+
   float min, max;
-  std::vector<ValueTuple> data;
+  float inverse_step; // table entries per degree
+  alignas(64) float cl[table_size];
+  alignas(64) float cd[table_size];
+
+  // curve_data (std::array or std::vector) must be sorted by alpha, but need not be uniformly spaced.
+  // With a constexpr polar the table is built at compile time.
+  template <class Polar>
+  constexpr Airfoil(const Polar& curve_data);
 
-  Airfoil(const std::vector<ValueTuple>& curve_data);
+  // alpha in degrees, clamped to [min, max]
   std::tuple<float, float> sample(float alpha) const;
-  };
 
-extern Airfoil NACA_0012;
-extern Airfoil NACA_2412;
+  // sample n angles of attack at once
+  void sample(const float* alpha, float* cl_out, float* cd_out, std::size_t n) const;
+  };
 
-struct Engine
+template <class Polar>
+constexpr Airfoil::Airfoil(const Polar& curve_data) :
+  min(curve_data[0].alpha),
+  max(curve_data[curve_data.size() - 1].alpha),
+  inverse_step(static_cast<float>(table_size - 1) / (curve_data[curve_data.size() - 1].alpha - curve_data[0].alpha)),
+  cl{},
+  cd{}
   {
-  float throttle = 0.5f;
-  float thrust = 10000.0f;
-  float horsepower = 1000.0f;
-  float rpm = 2400.0f;
-  float propellor_diameter = 1.8f;
+  // the measured polars have gaps, so interpolate between the enclosing samples instead of assuming uniform spacing
+  std::size_t segment = 0;
+  for (int i = 0; i < table_size; ++i)
+    {
+    const float alpha = i == table_size - 1 ? max : min + static_cast<float>(i) / inverse_step;
+    while (segment + 2 < curve_data.size() && curve_data[segment + 1].alpha < alpha)
+      ++segment;
+    const ValueTuple& a = curve_data[segment];
+    const ValueTuple& b = curve_data[segment + 1];
+    const float t = physics::utils::clamp((alpha - a.alpha) / (b.alpha - a.alpha), 0.f, 1.f);
+    cl[i] = physics::utils::lerp(a.cl, b.cl, t);
+    cd[i] = physics::utils::lerp(a.cd, b.cd, t);
+    }
+  }
 
-  Engine(float thrust);
-  void apply_forces(physics::RigidBody& rigid_body);
-  };
+extern const Airfoil NACA_0012;
+extern const Airfoil NACA_2412;
 
 struct Wing
   {
@@ -41,22 +72,130 @@ struct Wing
   jtk::vec3<float> normal;
   float lift_multiplier = 1.0f;
   float drag_multiplier = 1.0f;
-  physics::degrees deflection = 0.0f;
 
   Wing(const jtk::vec3<float> & position, float area, const Airfoil* aero, const jtk::vec3<float>& normal = physics::UP);
   Wing(const jtk::vec3<float> & position, float wingspan, float chord, const Airfoil* aero, const jtk::vec3<float>& normal = physics::UP);
-  void apply_forces(physics::RigidBody& rigid_body);
   };
 
-struct Aircraft
+// The deflection of a surface in degrees with the cosine and sine of its rotation. set() only evaluates them
+// again when the deflection changes, so a surface that holds its deflection costs no trig.
+struct SurfaceDeflection
+  {
+  float degrees = 0.f;
+  float cosine = 1.f;
+  float sine = 0.f;
+
+  void set(float deflection);
+  };
+
+// per step buffers of WingSet::apply_forces, reused between steps and aircraft so that a step does not allocate
+struct WingScratch
   {
-  Engine engine;
-  std::vector<Wing> elements;
-  physics::RigidBody rigid_body;
-  jtk::vec3<float> joystick; // roll, yaw, pitch
+  simd::aligned_vector<float> deflected_normal[3];
+  simd::aligned_vector<float> drag_direction[3];
+  simd::aligned_vector<float> dynamic_pressure;
+  simd::aligned_vector<float> alpha_sine;
+  simd::aligned_vector<float> alpha;
+  simd::aligned_vector<float> cl;
+  simd::aligned_vector<float> cd;
+  };
+
+// All lifting surfaces of an aircraft type in structure-of-arrays form. The geometry is immutable once built and
+// shared by all aircraft of the type; the deflections come with every call, with their rotations already evaluated,
+// so that an aircraft can keep them from step to step, see AircraftState::deflection.
+// apply_forces transforms the body velocity once, evaluates every surface in one pass,
+// and commits a single force and torque to the rigid body.
+class WingSet
+  {
+  public:
+    WingSet();
+    WingSet(const std::vector<Wing>& wings);
+
+    // returns the index of the new surface
+    std::size_t add(const Wing& wing);
+    std::size_t size() const { return m_airfoil.size(); }
 
-  float log_timer = 1.0f;
+    void set_lift_multiplier(std::size_t i, float multiplier) { m_lift_multiplier[i] = multiplier; }
+    void set_drag_multiplier(std::size_t i, float multiplier) { m_drag_multiplier[i] = multiplier; }
+
+    // deflection holds size() entries, or is nullptr for none. air_density in kg/m^3, see physics::atmosphere.
+    void apply_forces(physics::RigidBody& rigid_body, const SurfaceDeflection* deflection, float air_density, WingScratch& scratch) const;
+
+  private:
+    // consecutive surfaces with the same airfoil are sampled in one batch
+    struct AirfoilRun
+      {
+      const Airfoil* airfoil;
+      std::size_t begin, end;
+      };
+
+    simd::aligned_vector<float> m_position[3];
+    simd::aligned_vector<float> m_normal[3];    // undeflected
+    simd::aligned_vector<float> m_tangent[3];   // direction the normal rotates to for a positive deflection
+    simd::aligned_vector<float> m_area;
+    simd::aligned_vector<float> m_lift_multiplier;
+    simd::aligned_vector<float> m_drag_multiplier;
+    std::vector<const Airfoil*> m_airfoil;
+    std::vector<AirfoilRun> m_runs;
+  };
 
-  Aircraft(float mass, float thrust, jtk::matf9 inertia, std::vector<Wing> wings);
-  void update(physics::seconds dt);
-  };
\ No newline at end of file
+struct AircraftType;
+
+// control surfaces of a type whose deflection AircraftState keeps, further ones evaluate their rotation every step
+constexpr std::size_t max_kept_deflections = 4;
+
+// Everything about one aircraft that changes in flight, about 140 bytes of plain data next to the shared
+// AircraftType. Fleets keep their states in flat arrays, and a snapshot of an aircraft is a memcpy.
+struct AircraftState
+  {
+  jtk::vec3<float> position;
+  jtk::float4 orientation;
+  jtk::vec3<float> velocity;
+  jtk::vec3<float> angular_velocity;
+  jtk::vec3<float> joystick; // pitch, yaw, roll in [-1, 1]
+  float throttle;            // [0, 1]
+  uint32_t flags;            // GearFlags
+  // air density around the altitude of the last step; derived from the position, so keyframes need not store it
+  physics::atmosphere::density_cache atmosphere;
+  // deflections of the first controlled surfaces, in the order of AircraftType::controls; derived from the controls,
+  // so keyframes need not store them either
+  SurfaceDeflection deflection[max_kept_deflections];
+
+  AircraftState();
+
+  bool is_crashed() const { return (flags & gear_crashed) != 0; }
+  bool is_on_ground() const { return (flags & gear_on_ground) != 0; }
+
+  // transform direction from body space to world space
+  jtk::vec3<float> transform_direction(const jtk::vec3<float>& direction) const;
+  };
+
+static_assert(std::is_trivially_copyable<AircraftState>::value, "AircraftState should be copyable with memcpy");
+
+// per step buffers of step_aircraft, one per thread
+struct AircraftScratch
+  {
+  WingScratch wings;
+  std::vector<SurfaceDeflection> deflection;
+  };
+
+// Steps the aircraft by dt. terrain may be nullptr for a flat ground at height 0, it is shared and only read.
+void step_aircraft(const AircraftType& type, AircraftState& state, physics::seconds dt, const TerrainField* terrain, AircraftScratch& scratch);
+
+// A single aircraft with its own scratch buffers, for the simulator and tools that fly one aircraft at a time.
+// World keeps only the states of its aircraft.
+struct Aircraft
+  {
+  std::shared_ptr<const AircraftType> type;
+  AircraftState state;
+  AircraftScratch scratch;
+
+  // the aircraft at rest at the origin
+  Aircraft(std::shared_ptr<const AircraftType> type);
+  // terrain may be nullptr for a flat ground at height 0, it is shared and only read
+  void update(physics::seconds dt, const TerrainField* terrain = nullptr);
+  };
+// the aircraft flown by the simulator, at 4000 m altitude and 600 km/h
+Aircraft create_default_aircraft();
+// an aircraft of the given type at the same altitude and speed
+Aircraft create_default_aircraft(std::shared_ptr<const AircraftType> type);
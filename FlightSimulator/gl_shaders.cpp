@@ -109,10 +109,13 @@ uniform sampler2D Heightmap;
 uniform sampler2D Normalmap;
 uniform sampler2D Colormap;
 uniform sampler2D Noise;
+uniform vec4 Jitter; // subpixel offset of the rays in xy
+uniform sampler2D MaxHeightmap; // HeightPyramid, levels side by side
 
 out vec4 FragColor;
 
-#define MAX_DEPTH 80
+#define MAX_DEPTH 800
+#define MAX_HEIGHT 5.0
 
 float fbm( vec2 p )
 {
@@ -185,17 +188,102 @@ vec3 calcNormal( in vec3 pos, float t )
 #endif
 }
 
+// maximum terrain height in the cell of the given level of the pyramid
+float maxHeight( int level, vec2 cell, int size )
+{
+  int offset = 2*size - 2*(size >> level);
+  return texelFetch( MaxHeightmap, ivec2(offset + int(cell.x), int(cell.y)), 0 ).x*MAX_HEIGHT;
+}
+
+// first sign change of map between t0 and t1, within a single texel
+float refine( in vec3 ro, in vec3 rd, float t0, float t1 )
+{
+  float h0 = map( ro+rd*t0 );
+  if( h0 < 0.0 ) return t0;
+  const int steps = 4;
+  float dt = (t1-t0)/float(steps);
+  for( int i=1; i<=steps; i++ )
+  {
+    float t = t0 + dt*float(i);
+    if( map( ro+rd*t ) < 0.0 )
+    {
+      float a = t-dt;
+      float b = t;
+      for( int j=0; j<5; j++ )
+      {
+        float m = 0.5*(a+b);
+        if( map( ro+rd*m ) < 0.0 ) b = m; else a = m;
+      }
+      return b;
+    }
+  }
+  return -1.0;
+}
+
+// Maximum mipmap traversal: a cell whose maximum stays below the ray is skipped as a whole and the next cell is
+// tested one level coarser, otherwise the ray descends a level. Only texels at level 0 are marched.
 float intersect( in vec3 ro, in vec3 rd )
 {
-    const float precis = 0.001;
-    float t = 0.0;
-    for( int i=0; i<256; i++ )
+  int size = textureSize( MaxHeightmap, 0 ).y;
+  int top = int( log2( float(size) ) + 0.5 );
+  float fsize = float(size);
+
+  // the ray in texel coordinates of the heightmap, see scalePosition
+  vec2 qo = (ro.xz*0.005 + 0.5)*fsize;
+  vec2 qd = rd.xz*0.005*fsize;
+  vec2 dir = vec2( qd.x >= 0.0 ? 1.0 : -1.0, qd.y >= 0.0 ? 1.0 : -1.0 );
+  vec2 inv = dir / max( abs(qd), vec2(1e-8) );
+
+  // outside the map and below its lowest point the ground is flat at height 0
+  float t_ground = rd.y < 0.0 ? -ro.y/rd.y : -1.0;
+  if( t_ground > MAX_DEPTH ) t_ground = -1.0;
+
+  // clip against the box of the map, between height 0 and MAX_HEIGHT
+  float tmin = 0.0;
+  float tmax = MAX_DEPTH;
+  if( rd.y < 0.0 )
+  {
+    tmin = max( tmin, (MAX_HEIGHT-ro.y)/rd.y );
+    tmax = min( tmax, -ro.y/rd.y );
+  }
+  else if( ro.y >= MAX_HEIGHT ) return -1.0;
+  else if( rd.y > 0.0 ) tmax = min( tmax, (MAX_HEIGHT-ro.y)/rd.y );
+  vec2 t0 = (vec2(0.0)-qo)*inv;
+  vec2 t1 = (vec2(fsize)-qo)*inv;
+  tmin = max( tmin, max( min(t0.x, t1.x), min(t0.y, t1.y) ) );
+  tmax = min( tmax, min( max(t0.x, t1.x), max(t0.y, t1.y) ) );
+
+  int level = top;
+  float t = tmin;
+  for( int i=0; i<256 && t<tmax; i++ )
+  {
+    float cell_size = float(1 << level);
+    // a nudge in the direction of travel, so that a ray on the border of two cells is in the next one
+    vec2 cell = clamp( floor( (qo + qd*t + dir*1e-3)/cell_size ), vec2(0.0), vec2(float(size >> level) - 1.0) );
+    float h = maxHeight( level, cell, size );
+    vec2 bound = (cell + max(dir, vec2(0.0)))*cell_size;
+    vec2 tb = (bound - qo)*inv;
+    float t_exit = min( min(tb.x, tb.y), tmax );
+    float y = ro.y + rd.y*t;
+    if( min( y, ro.y + rd.y*t_exit ) > h )
+    {
+      t = t_exit;
+      level = min( level+1, top );
+      continue;
+    }
+    // the ray comes down to the maximum within this cell
+    if( y > h ) t = (h-ro.y)/rd.y;
+    if( level > 0 )
     {
-        float h = map( ro+rd*t );
-        if( abs(h)<precis || t>MAX_DEPTH ) break;
-        t += h*0.5;
+      level--;
+      continue;
     }
-    return (t>MAX_DEPTH)?-1.0:t;
+    float th = refine( ro, rd, t, t_exit );
+    if( th >= 0.0 ) return th;
+    t = t_exit;
+    level = min( level+1, top );
+  }
+  return t_ground;
 }
 
 void mainImage( out vec4 fragColor, in vec2 fragCoord )
@@ -291,7 +379,7 @@ void mainImage( out vec4 fragColor, in vec2 fragCoord )
 
 void main() 
   {
-  mainImage(FragColor, gl_FragCoord.xy);
+  mainImage(FragColor, gl_FragCoord.xy + Jitter.xy);
   }
 )");
   }
@@ -335,6 +423,67 @@ void main()
 )");
   }
 
+std::string get_temporal_upsample_material_vertex_shader()
+  {
+  return std::string(R"(#version 330 core
+layout (location = 0) in vec3 vPosition;
+//layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec2 vTexCoord;
+uniform mat4 Projection; // columns
+uniform mat4 Camera; // columns
+out vec2 TexCoord;
+
+void main() 
+  {
+  gl_Position = Projection*Camera*vec4(vPosition.xyz,1);
+  TexCoord = vTexCoord;
+  }
+)");
+  }
+
+std::string get_temporal_upsample_material_fragment_shader()
+  {
+  return std::string(R"(#version 330 core
+out vec4 FragColor;
+in vec2 TexCoord;
+uniform mat4 Reprojection; // current to previous camera space
+uniform vec4 Jitter; // xy: jitter of the current frame in pixels, zw: size of the current texture
+uniform vec4 Params; // x: aspect ratio, y: weight of the history
+uniform sampler2D Tex0; // current, low resolution
+uniform sampler2D Tex1; // history, full resolution
+
+void main()
+  {
+  vec2 texel = 1.0 / Jitter.zw;
+  // the rays of the current frame were shifted by the jitter, so its image is shifted the other way
+  vec2 uv = TexCoord - Jitter.xy * texel;
+  vec4 current = texture(Tex0, uv);
+  vec4 n0 = texture(Tex0, uv + vec2(texel.x, 0.0));
+  vec4 n1 = texture(Tex0, uv - vec2(texel.x, 0.0));
+  vec4 n2 = texture(Tex0, uv + vec2(0.0, texel.y));
+  vec4 n3 = texture(Tex0, uv - vec2(0.0, texel.y));
+  vec4 lo = min(current, min(min(n0, n1), min(n2, n3)));
+  vec4 hi = max(current, max(max(n0, n1), max(n2, n3)));
+
+  // same ray as the terrain shader, in the camera space of the previous frame
+  vec2 s = (-1.0 + 2.0 * TexCoord) * vec2(Params.x, 1.0);
+  vec3 d = (Reprojection * vec4(s, 2.0, 0.0)).xyz;
+  float weight = 0.0;
+  vec4 history = current;
+  if (d.z > 0.0)
+    {
+    vec2 previous = (2.0 * d.xy / d.z / vec2(Params.x, 1.0) + 1.0) * 0.5;
+    if (previous.x >= 0.0 && previous.x <= 1.0 && previous.y >= 0.0 && previous.y <= 1.0)
+      {
+      history = clamp(texture(Tex1, previous), lo, hi);
+      weight = Params.y;
+      }
+    }
+  FragColor = mix(current, history, weight);
+  }
+)");
+  }
+
 std::string get_font_material_vertex_shader()
   {
   return std::string(R"(#version 330 core
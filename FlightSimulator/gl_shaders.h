@@ -14,6 +14,9 @@ std::string get_terrain_material_fragment_shader();
 std::string get_blit_material_vertex_shader();
 std::string get_blit_material_fragment_shader();
 
+std::string get_temporal_upsample_material_vertex_shader();
+std::string get_temporal_upsample_material_fragment_shader();
+
 std::string get_font_material_vertex_shader();
 std::string get_font_material_fragment_shader();
 
@@ -0,0 +1,359 @@
+// Golden trajectory regression checks of the flight model.
+//
+// Flies the default aircraft through a library of scripted manoeuvres and compares the trajectories with golden
+// files that an earlier, trusted build wrote. Run it before and after changes to the physics or the flight model,
+// like SIMD, batching or integrator work, that should keep the flight behavior.
+//
+// Usage: flightsim_golden [options]
+//   --golden <dir>              directory with the golden files <manoeuvre>.csv (default golden)
+//   --update                    write the golden files instead of comparing with them
+//   --filter <text>             only fly the manoeuvres whose name contains text
+//   --list                      print the manoeuvres and exit
+//   --tol-position <m>          tolerances per quantity, see Tolerances for the defaults
+//   --tol-orientation <deg>
+//   --tol-velocity <m/s>
+//   --tol-angular-velocity <deg/s>
+//
+// Returns 1 when a trajectory leaves the tolerance of its golden file, and reports for every quantity the largest
+// error, when it happened, and when the error first exceeded the tolerance.
+
+#define JTK_QBVH_IMPLEMENTATION
+#include "jtk/qbvh.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#include "determinism.h"
+#include "flightmodel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+  {
+
+  const physics::seconds dt = 0.002f;       // the step of the simulator
+  const int steps_per_sample = 10;          // golden files hold the state every 20 ms
+
+  struct Input
+    {
+    physics::seconds time;
+    float pitch, yaw, roll, throttle;
+    };
+
+  struct Manoeuvre
+    {
+    const char* name;
+    const char* description;
+    physics::seconds duration;
+    float altitude;        // m, above the flat ground at height 0
+    float speed;           // m/s, level flight along the forward axis
+    std::vector<Input> inputs;
+    };
+
+  // The inputs hold until the next input. Each manoeuvre stresses other parts of the flight model: the elevator,
+  // the ailerons and the rudder on their own, the airfoil tables at high angles of attack, and the landing gear.
+  std::vector<Manoeuvre> manoeuvres()
+    {
+    const float cruise_altitude = 4000.f;
+    const float cruise_speed = physics::units::meter_per_second(600.f);
+    return {
+      { "cruise", "hands off at half throttle", 60.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 0.5f } } },
+      { "pitch_doublet", "elevator up for 1 s, down for 1 s", 20.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 0.5f }, { 2.f, 0.5f, 0.f, 0.f, 0.5f }, { 3.f, -0.5f, 0.f, 0.f, 0.5f }, { 4.f, 0.f, 0.f, 0.f, 0.5f } } },
+      { "roll_step", "ailerons for 2.5 s, then neutral", 20.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 0.5f }, { 2.f, 0.f, 0.f, 0.6f, 0.5f }, { 4.5f, 0.f, 0.f, 0.f, 0.5f } } },
+      { "yaw_pulse", "full rudder for 1 s", 20.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 0.5f }, { 2.f, 0.f, 1.f, 0.f, 0.5f }, { 3.f, 0.f, 0.f, 0.f, 0.5f } } },
+      { "loop", "full elevator at full throttle", 20.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 1.f }, { 1.f, 1.f, 0.f, 0.f, 1.f }, { 15.f, 0.f, 0.f, 0.f, 1.f } } },
+      { "barrel_roll", "elevator and ailerons together", 20.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 0.8f }, { 1.f, 0.4f, 0.f, 0.8f, 0.8f }, { 9.f, 0.f, 0.f, 0.f, 0.8f } } },
+      { "spiral_dive", "idle throttle, banked and nose down", 40.f, cruise_altitude, cruise_speed,
+        { { 0.f, 0.f, 0.f, 0.f, 0.f }, { 1.f, -0.2f, 0.f, 0.5f, 0.f }, { 5.f, -0.2f, 0.f, 0.f, 0.f } } },
+      { "touchdown", "idle throttle from 3 m at 60 m/s, touchdown and roll out", 30.f, 3.f, 60.f,
+        { { 0.f, 0.f, 0.f, 0.f, 0.f } } },
+      };
+    }
+
+  struct Sample
+    {
+    physics::seconds time;
+    jtk::vec3<float> position;
+    jtk::float4 orientation;
+    jtk::vec3<float> velocity;
+    jtk::vec3<float> angular_velocity;
+    float throttle;
+    bool crashed;
+    };
+
+  void apply(const Input& input, AircraftState& state)
+    {
+    state.joystick = jtk::vec3<float>(input.pitch, input.yaw, input.roll);
+    state.throttle = input.throttle;
+    }
+
+  Sample sample(physics::seconds time, const AircraftState& state)
+    {
+    Sample s;
+    s.time = time;
+    s.position = state.position;
+    s.orientation = state.orientation;
+    s.velocity = state.velocity;
+    s.angular_velocity = state.angular_velocity;
+    s.throttle = state.throttle;
+    s.crashed = state.is_crashed();
+    return s;
+    }
+
+  std::vector<Sample> fly(const Manoeuvre& m)
+    {
+    physics::fp_environment fp;
+    Aircraft aircraft = create_default_aircraft();
+    aircraft.state.position = jtk::vec3<float>(0.f, m.altitude, 0.f);
+    aircraft.state.velocity = physics::FORWARD * m.speed;
+
+    const int64_t steps = static_cast<int64_t>(std::ceil(m.duration / dt - 1e-3f));
+    std::size_t next_input = 0;
+    std::vector<Sample> trajectory;
+    trajectory.reserve(static_cast<std::size_t>(steps / steps_per_sample + 2));
+    for (int64_t step = 0; step <= steps; ++step)
+      {
+      const physics::seconds time = static_cast<float>(step) * dt;
+      for (; next_input < m.inputs.size() && m.inputs[next_input].time <= time; ++next_input)
+        apply(m.inputs[next_input], aircraft.state);
+      if (step % steps_per_sample == 0 || step == steps)
+        trajectory.push_back(sample(time, aircraft.state));
+      if (step == steps)
+        break;
+      aircraft.update(dt);
+      }
+    return trajectory;
+    }
+
+  std::string golden_filename(const std::string& dir, const Manoeuvre& m)
+    {
+    return dir + "/" + m.name + ".csv";
+    }
+
+  void write_golden(const std::string& filename, const Manoeuvre& m, const std::vector<Sample>& trajectory)
+    {
+    FILE* f = fopen(filename.c_str(), "w");
+    if (!f)
+      throw std::runtime_error("cannot create golden file " + filename);
+    // %.9g round trips every float, so the golden file holds the exact states
+    fprintf(f, "# %s: %s, dt %.9g\n", m.name, m.description, dt);
+    fprintf(f, "time,px,py,pz,qx,qy,qz,qw,vx,vy,vz,wx,wy,wz,throttle,crashed\n");
+    for (const Sample& s : trajectory)
+      {
+      fprintf(f, "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%d\n",
+        s.time, s.position.x, s.position.y, s.position.z,
+        s.orientation[0], s.orientation[1], s.orientation[2], s.orientation[3],
+        s.velocity.x, s.velocity.y, s.velocity.z,
+        s.angular_velocity.x, s.angular_velocity.y, s.angular_velocity.z,
+        s.throttle, s.crashed ? 1 : 0);
+      }
+    fclose(f);
+    }
+
+  std::vector<Sample> read_golden(const std::string& filename)
+    {
+    std::ifstream f(filename);
+    if (!f.is_open())
+      throw std::runtime_error("cannot open golden file " + filename + ", write it with --update on a trusted build");
+    std::vector<Sample> trajectory;
+    std::string line;
+    int line_nr = 0;
+    while (std::getline(f, line))
+      {
+      ++line_nr;
+      if (line.empty() || line[0] == '#' || line[0] == 't')
+        continue;
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::stringstream ss(line);
+      Sample s;
+      int crashed;
+      if (!(ss >> s.time >> s.position.x >> s.position.y >> s.position.z
+              >> s.orientation[0] >> s.orientation[1] >> s.orientation[2] >> s.orientation[3]
+              >> s.velocity.x >> s.velocity.y >> s.velocity.z
+              >> s.angular_velocity.x >> s.angular_velocity.y >> s.angular_velocity.z
+              >> s.throttle >> crashed))
+        throw std::runtime_error("syntax error in golden file " + filename + " on line " + std::to_string(line_nr));
+      s.crashed = crashed != 0;
+      trajectory.push_back(s);
+      }
+    return trajectory;
+    }
+
+  // Largest errors that still count as the same flight. Bit-identical builds have no error at all; these leave room
+  // for a different summation order or instruction selection, which make chaotic manoeuvres drift slowly.
+  struct Tolerances
+    {
+    float position = 1.f;         // m
+    float orientation = 1.f;      // deg
+    float velocity = 0.5f;        // m/s
+    float angular_velocity = 2.f; // deg/s
+    };
+
+  enum quantity
+    {
+    q_position,
+    q_orientation,
+    q_velocity,
+    q_angular_velocity,
+    q_crashed,
+    number_of_quantities
+    };
+
+  const char* quantity_names[number_of_quantities] = { "position [m]", "orientation [deg]", "velocity [m/s]", "ang. vel. [deg/s]", "crashed" };
+
+  struct Divergence
+    {
+    float max_error = 0.f;
+    physics::seconds max_error_time = 0.f;
+    physics::seconds diverged_time = -1.f; // first time over the tolerance, -1 if never
+    };
+
+  // angle of the rotation between two unit quaternions, in degrees; atan2 of the relative rotation stays exact for
+  // small angles, where acos of the dot product cannot resolve less than a few hundredths of a degree
+  float angle_between(const jtk::float4& a, const jtk::float4& b)
+    {
+    const double w = (double)a[3] * b[3] + (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+    const double x = (double)b[3] * a[0] - (double)a[3] * b[0] - ((double)b[1] * a[2] - (double)b[2] * a[1]);
+    const double y = (double)b[3] * a[1] - (double)a[3] * b[1] - ((double)b[2] * a[0] - (double)b[0] * a[2]);
+    const double z = (double)b[3] * a[2] - (double)a[3] * b[2] - ((double)b[0] * a[1] - (double)b[1] * a[0]);
+    return physics::units::degrees(static_cast<float>(2.0 * std::atan2(std::sqrt(x * x + y * y + z * z), std::fabs(w))));
+    }
+
+  // returns false if a quantity left its tolerance
+  bool compare(const Manoeuvre& m, const std::vector<Sample>& golden, const std::vector<Sample>& trajectory, const Tolerances& tol)
+    {
+    if (golden.size() != trajectory.size() || golden.back().time != trajectory.back().time)
+      throw std::runtime_error(std::string("golden file of ") + m.name + " has another duration or sample rate, write it again with --update");
+
+    const float tolerance[number_of_quantities] = { tol.position, tol.orientation, tol.velocity, tol.angular_velocity, 0.5f };
+    Divergence div[number_of_quantities];
+    for (std::size_t i = 0; i < golden.size(); ++i)
+      {
+      const Sample& g = golden[i];
+      const Sample& s = trajectory[i];
+      const float error[number_of_quantities] = {
+        jtk::length(s.position - g.position),
+        angle_between(s.orientation, g.orientation),
+        jtk::length(s.velocity - g.velocity),
+        physics::units::degrees(jtk::length(s.angular_velocity - g.angular_velocity)),
+        s.crashed != g.crashed ? 1.f : 0.f
+        };
+      for (int q = 0; q < number_of_quantities; ++q)
+        {
+        // a nan error counts as diverged
+        if (!(error[q] <= div[q].max_error))
+          {
+          div[q].max_error = error[q];
+          div[q].max_error_time = g.time;
+          }
+        if (div[q].diverged_time < 0.f && !(error[q] <= tolerance[q]))
+          div[q].diverged_time = g.time;
+        }
+      }
+
+    bool ok = true;
+    for (int q = 0; q < number_of_quantities; ++q)
+      ok = ok && div[q].diverged_time < 0.f;
+    printf("%-16s %s\n", m.name, ok ? "ok" : "DIVERGED");
+    for (int q = 0; q < number_of_quantities; ++q)
+      {
+      printf("  %-20s %12.6f at %7.2f s   tolerance %8.3f", quantity_names[q], div[q].max_error, div[q].max_error_time, tolerance[q]);
+      if (div[q].diverged_time >= 0.f)
+        printf("   exceeded at %7.2f s", div[q].diverged_time);
+      printf("\n");
+      }
+    return ok;
+    }
+
+  }
+
+int main(int argc, char** argv)
+  {
+  std::string dir = "golden";
+  std::string filter;
+  bool update = false;
+  bool list = false;
+  Tolerances tol;
+  try
+    {
+    for (int i = 1; i < argc; ++i)
+      {
+      const std::string arg(argv[i]);
+      if (arg == "--update")
+        {
+        update = true;
+        continue;
+        }
+      if (arg == "--list")
+        {
+        list = true;
+        continue;
+        }
+      if (i + 1 >= argc)
+        throw std::runtime_error("missing value for option " + arg);
+      const char* value = argv[++i];
+      if (arg == "--golden")
+        dir = value;
+      else if (arg == "--filter")
+        filter = value;
+      else if (arg == "--tol-position")
+        tol.position = (float)std::atof(value);
+      else if (arg == "--tol-orientation")
+        tol.orientation = (float)std::atof(value);
+      else if (arg == "--tol-velocity")
+        tol.velocity = (float)std::atof(value);
+      else if (arg == "--tol-angular-velocity")
+        tol.angular_velocity = (float)std::atof(value);
+      else
+        throw std::runtime_error("unknown option " + arg);
+      }
+
+    int flown = 0, diverged = 0;
+    for (const Manoeuvre& m : manoeuvres())
+      {
+      if (!filter.empty() && std::string(m.name).find(filter) == std::string::npos)
+        continue;
+      if (list)
+        {
+        printf("%-16s %5.0f s  %s\n", m.name, m.duration, m.description);
+        continue;
+        }
+      ++flown;
+      const std::vector<Sample> trajectory = fly(m);
+      if (update)
+        {
+        write_golden(golden_filename(dir, m), m, trajectory);
+        printf("%-16s written to %s\n", m.name, golden_filename(dir, m).c_str());
+        }
+      else if (!compare(m, read_golden(golden_filename(dir, m)), trajectory, tol))
+        ++diverged;
+      }
+    if (flown == 0 && !list)
+      throw std::runtime_error("no manoeuvre matches " + filter);
+    if (diverged > 0)
+      {
+      printf("%d of %d manoeuvres diverged from their golden trajectories\n", diverged, flown);
+      return 1;
+      }
+    }
+  catch (std::exception& e)
+    {
+    fprintf(stderr, "flightsim_golden: %s\n", e.what());
+    return 1;
+    }
+  return 0;
+  }
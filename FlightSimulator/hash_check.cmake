@@ -0,0 +1,21 @@
+# Flies the same jittered fleet with FlightSimulatorHeadless on one and on four threads and fails unless both runs
+# print the same state hash. Run by ctest as
+#   cmake -DHEADLESS=<path of FlightSimulatorHeadless> -P hash_check.cmake
+# The jitter is large enough that some aircraft crash, so the crash flags are part of the comparison.
+
+set(FLEET --aircraft 300 --duration 30 --jitter-speed 40 --jitter-angle 60 --hash)
+
+foreach(threads 1 4)
+  execute_process(COMMAND ${HEADLESS} ${FLEET} --threads ${threads}
+    OUTPUT_VARIABLE hash_${threads}
+    RESULT_VARIABLE result
+    OUTPUT_STRIP_TRAILING_WHITESPACE)
+  if (NOT result EQUAL 0)
+    message(FATAL_ERROR "FlightSimulatorHeadless failed with ${threads} threads: ${result}")
+  endif (NOT result EQUAL 0)
+  message(STATUS "${threads} threads: ${hash_${threads}}")
+endforeach(threads)
+
+if (NOT hash_1 STREQUAL hash_4)
+  message(FATAL_ERROR "the state hash depends on the number of threads: ${hash_1} with 1 thread, ${hash_4} with 4")
+endif (NOT hash_1 STREQUAL hash_4)
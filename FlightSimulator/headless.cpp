@@ -0,0 +1,443 @@
+// Runs the flight model without window or graphics context, e.g. for batch runs on servers.
+//
+// Usage: FlightSimulatorHeadless [options]
+//   --aircraft <n>        number of aircraft (default 1)
+//   --type <file>         aircraft definition, see aircraft_type.h; repeat for a mixed fleet, in which aircraft i
+//                         gets type i modulo the number of types (default: the aircraft of the simulator)
+//   --threads <n>         number of threads that step the aircraft (default: all cores)
+//   --duration <s>        simulated time in seconds (default 60)
+//   --dt <s>              physics time step in seconds (default 0.002)
+//   --script <file>       control inputs, see below
+//   --output <file>       trajectory csv file (default stdout)
+//   --output-rate <hz>    trajectory samples per simulated second (default 10)
+//   --seed <n>            seed for the initial state jitter (default 0)
+//   --jitter-speed <m/s>  standard deviation of the initial airspeed
+//   --jitter-angle <deg>  standard deviation of the initial pitch, yaw and roll
+//   --terrain <file>      heightmap of the ground, see TerrainField (default: flat ground at height 0)
+//   --hash                print an FNV-1a hash of the final state of all aircraft; trajectories are then only
+//                         written with --output
+//   --record <file>       flight recording of aircraft 0, see FlightRecorder
+//   --replay <file>       replay a flight recording instead of flying scripted aircraft; --duration then defaults
+//                         to the rest of the recording and the recorded time step replaces --dt; the first --type
+//                         has to be the aircraft type of the recording
+//   --seek <s>            start the replay at this time (default 0)
+//   --speed <x>           replay at x times real time (default 0: as fast as possible)
+//
+// A script line has the form
+//   time pitch yaw roll throttle [aircraft]
+// with the controls in [-1, 1] and the throttle in [0, 1]. The controls hold from the given time on, until the
+// next line for the same aircraft. Without aircraft index the line applies to all aircraft. Lines starting with #
+// are comments.
+
+#define JTK_QBVH_IMPLEMENTATION
+#include "jtk/qbvh.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#include "aircraft_type.h"
+#include "determinism.h"
+#include "flightmodel.h"
+#include "recorder.h"
+#include "terrain.h"
+#include "world.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+  {
+
+  struct ControlEvent
+    {
+    physics::seconds time;
+    float pitch, yaw, roll, throttle;
+    int aircraft; // -1 for all aircraft
+    };
+
+  struct Options
+    {
+    int aircraft = 1;
+    int threads = 0;
+    physics::seconds duration = 60.f;
+    bool duration_set = false;
+    physics::seconds dt = 0.002f;
+    std::vector<std::string> types;
+    std::string script;
+    std::string output;
+    std::string terrain;
+    std::string record;
+    std::string replay;
+    physics::seconds seek = 0.f;
+    float speed = 0.f;
+    float output_rate = 10.f;
+    uint32_t seed = 0;
+    float jitter_speed = 0.f;
+    physics::degrees jitter_angle = 0.f;
+    bool hash = false;
+    };
+
+  Options parse_options(int argc, char** argv)
+    {
+    Options opts;
+    for (int i = 1; i < argc; ++i)
+      {
+      const std::string arg(argv[i]);
+      if (arg == "--hash")
+        {
+        opts.hash = true;
+        continue;
+        }
+      if (i + 1 >= argc)
+        throw std::runtime_error("missing value for option " + arg);
+      const char* value = argv[++i];
+      if (arg == "--aircraft")
+        opts.aircraft = std::atoi(value);
+      else if (arg == "--threads")
+        opts.threads = std::atoi(value);
+      else if (arg == "--duration")
+        {
+        opts.duration = (float)std::atof(value);
+        opts.duration_set = true;
+        }
+      else if (arg == "--dt")
+        opts.dt = (float)std::atof(value);
+      else if (arg == "--type")
+        opts.types.push_back(value);
+      else if (arg == "--script")
+        opts.script = value;
+      else if (arg == "--output")
+        opts.output = value;
+      else if (arg == "--terrain")
+        opts.terrain = value;
+      else if (arg == "--record")
+        opts.record = value;
+      else if (arg == "--replay")
+        opts.replay = value;
+      else if (arg == "--seek")
+        opts.seek = (float)std::atof(value);
+      else if (arg == "--speed")
+        opts.speed = (float)std::atof(value);
+      else if (arg == "--output-rate")
+        opts.output_rate = (float)std::atof(value);
+      else if (arg == "--seed")
+        opts.seed = (uint32_t)std::strtoul(value, nullptr, 10);
+      else if (arg == "--jitter-speed")
+        opts.jitter_speed = (float)std::atof(value);
+      else if (arg == "--jitter-angle")
+        opts.jitter_angle = (float)std::atof(value);
+      else
+        throw std::runtime_error("unknown option " + arg);
+      }
+    if (opts.aircraft <= 0)
+      throw std::runtime_error("number of aircraft should be positive");
+    if (opts.threads < 0)
+      throw std::runtime_error("number of threads should not be negative");
+    if (opts.dt <= 0.f)
+      throw std::runtime_error("time step should be positive");
+    if (opts.output_rate <= 0.f)
+      throw std::runtime_error("output rate should be positive");
+    if (opts.seek < 0.f || opts.speed < 0.f)
+      throw std::runtime_error("replay time and speed should not be negative");
+    return opts;
+    }
+
+  std::vector<ControlEvent> read_script(const std::string& filename)
+    {
+    std::vector<ControlEvent> events;
+    std::ifstream f(filename);
+    if (!f.is_open())
+      throw std::runtime_error("cannot open script " + filename);
+    std::string line;
+    int line_nr = 0;
+    while (std::getline(f, line))
+      {
+      ++line_nr;
+      const auto first = line.find_first_not_of(" \t\r");
+      if (first == std::string::npos || line[first] == '#')
+        continue;
+      std::stringstream ss(line);
+      ControlEvent e;
+      if (!(ss >> e.time >> e.pitch >> e.yaw >> e.roll >> e.throttle))
+        throw std::runtime_error("syntax error in script " + filename + " on line " + std::to_string(line_nr));
+      if (!(ss >> e.aircraft))
+        e.aircraft = -1;
+      events.push_back(e);
+      }
+    // events with the same time keep their order in the file
+    std::stable_sort(events.begin(), events.end(), [](const ControlEvent& a, const ControlEvent& b) { return a.time < b.time; });
+    return events;
+    }
+
+  jtk::float4 axis_angle(const jtk::vec3<float>& axis, float angle)
+    {
+    const float s = physics::math::sin(angle * 0.5f);
+    return jtk::float4(axis.x * s, axis.y * s, axis.z * s, physics::math::cos(angle * 0.5f));
+    }
+
+  // std::normal_distribution differs between standard libraries, but std::mt19937 does not.
+  // The sum of 12 uniform samples minus 6 has mean 0 and variance 1.
+  float standard_normal(std::mt19937& rng)
+    {
+    float sum = 0.f;
+    for (int i = 0; i < 12; ++i)
+      sum += static_cast<float>(rng() >> 8) * (1.f / 16777216.f);
+    return sum - 6.f;
+    }
+
+  // every type is loaded once and shared by all its aircraft
+  std::vector<std::shared_ptr<const AircraftType>> load_types(const Options& opts)
+    {
+    std::vector<std::shared_ptr<const AircraftType>> types;
+    for (const std::string& filename : opts.types)
+      types.push_back(load_aircraft_type(filename));
+    if (types.empty())
+      types.push_back(default_aircraft_type());
+    return types;
+    }
+
+  void create_fleet(World& fleet, const Options& opts)
+    {
+    const std::vector<std::shared_ptr<const AircraftType>> types = load_types(opts);
+    fleet.reserve(opts.aircraft);
+    std::mt19937 rng(opts.seed);
+    for (int i = 0; i < opts.aircraft; ++i)
+      {
+      Aircraft aircraft = create_default_aircraft(types[i % types.size()]);
+      // always draw, so that aircraft i gets the same initial state regardless of the jitter settings of the others
+      const float speed = standard_normal(rng) * opts.jitter_speed;
+      const float pitch = physics::units::radians(standard_normal(rng) * opts.jitter_angle);
+      const float yaw = physics::units::radians(standard_normal(rng) * opts.jitter_angle);
+      const float roll = physics::units::radians(standard_normal(rng) * opts.jitter_angle);
+      jtk::float4 q = jtk::quaternion_multiply(axis_angle(physics::UP, yaw), jtk::quaternion_multiply(axis_angle(physics::RIGHT, pitch), axis_angle(physics::FORWARD, roll)));
+      q = jtk::quaternion_normalize(q);
+      aircraft.state.orientation = q;
+      const jtk::vec3<float> velocity = aircraft.state.velocity;
+      const float airspeed = jtk::length(velocity);
+      aircraft.state.velocity = physics::utils::rotate(q, jtk::normalize(velocity) * (airspeed + speed));
+      fleet.add(aircraft);
+      }
+    }
+
+  void write_header(FILE* f)
+    {
+    fprintf(f, "aircraft,time,px,py,pz,qx,qy,qz,qw,vx,vy,vz,wx,wy,wz,throttle\n");
+    }
+
+  void write_state(FILE* f, int index, physics::seconds time, const AircraftState& state)
+    {
+    const jtk::vec3<float>& p = state.position;
+    const jtk::float4& q = state.orientation;
+    const jtk::vec3<float>& v = state.velocity;
+    const jtk::vec3<float>& w = state.angular_velocity;
+    fprintf(f, "%d,%.4f,%.4f,%.4f,%.4f,%.6f,%.6f,%.6f,%.6f,%.4f,%.4f,%.4f,%.5f,%.5f,%.5f,%.3f\n",
+      index, time, p.x, p.y, p.z, q[0], q[1], q[2], q[3], v.x, v.y, v.z, w.x, w.y, w.z, state.throttle);
+    }
+
+  void apply(const ControlEvent& e, AircraftState& state)
+    {
+    state.joystick = jtk::vec3<float>(
+      physics::utils::clamp(e.pitch, -1.f, 1.f),
+      physics::utils::clamp(e.yaw, -1.f, 1.f),
+      physics::utils::clamp(e.roll, -1.f, 1.f));
+    state.throttle = physics::utils::clamp(e.throttle, 0.f, 1.f);
+    }
+
+  // returns false without terrain file
+  bool load_terrain(const Options& opts, TerrainField& terrain)
+    {
+    if (opts.terrain.empty())
+      return false;
+    std::vector<uint16_t> heights;
+    uint32_t w, h;
+    if (!load_heightmap(opts.terrain, heights, w, h))
+      throw std::runtime_error("cannot read heightmap " + opts.terrain);
+    if (w != h)
+      throw std::runtime_error("heightmap " + opts.terrain + " should be square");
+    terrain.build(heights.data(), w);
+    return true;
+    }
+
+  FILE* open_output(const Options& opts)
+    {
+    FILE* out = opts.hash ? nullptr : stdout;
+    if (!opts.output.empty())
+      {
+      out = fopen(opts.output.c_str(), "w");
+      if (!out)
+        throw std::runtime_error("cannot open output file " + opts.output);
+      }
+    return out;
+    }
+
+  void print_hash(const AircraftState* states, std::size_t n)
+    {
+    uint64_t h = physics::hash_seed;
+    for (std::size_t i = 0; i < n; ++i)
+      {
+      const AircraftState& s = states[i];
+      for (int j = 0; j < 3; ++j)
+        h = physics::hash(s.position[j], h);
+      for (int j = 0; j < 4; ++j)
+        h = physics::hash(s.orientation[j], h);
+      for (int j = 0; j < 3; ++j)
+        h = physics::hash(s.velocity[j], h);
+      for (int j = 0; j < 3; ++j)
+        h = physics::hash(s.angular_velocity[j], h);
+      for (int j = 0; j < 3; ++j)
+        h = physics::hash(s.joystick[j], h);
+      h = physics::hash(s.throttle, h);
+      // crashed and on ground, which the pose alone does not tell apart
+      h = physics::hash(&s.flags, sizeof(s.flags), h);
+      }
+    printf("%016llx\n", (unsigned long long)h);
+    }
+
+  void replay(const Options& opts)
+    {
+    physics::fp_environment fp;
+    FlightReplay recording;
+    if (!recording.open(opts.replay))
+      throw std::runtime_error("cannot read flight recording " + opts.replay);
+    TerrainField terrain;
+    const TerrainField* ground = load_terrain(opts, terrain) ? &terrain : nullptr;
+    FILE* out = open_output(opts);
+
+    const physics::seconds dt = recording.get_step();
+    const uint64_t first = std::min(recording.get_steps(), static_cast<uint64_t>(std::llround(opts.seek / dt)));
+    uint64_t last = recording.get_steps();
+    if (opts.duration_set)
+      last = std::min(last, first + static_cast<uint64_t>(std::ceil(opts.duration / dt - 1e-3f)));
+    const uint64_t output_interval = std::max<uint64_t>(1, static_cast<uint64_t>(std::round(1.f / (opts.output_rate * dt))));
+
+    const std::shared_ptr<const AircraftType> type = load_types(opts)[0];
+    if (!recording.get_aircraft_type().empty() && recording.get_aircraft_type() != type->name)
+      throw std::runtime_error("flight recording " + opts.replay + " was made with aircraft type \"" + recording.get_aircraft_type() +
+        "\", not \"" + type->name + "\", see --type");
+    Aircraft aircraft = create_default_aircraft(type);
+    recording.seek(aircraft, first, ground);
+
+    const auto start = std::chrono::steady_clock::now();
+    if (out)
+      write_header(out);
+    for (uint64_t step = first; step <= last; ++step)
+      {
+      if (out && (step % output_interval == 0 || step == last))
+        write_state(out, 0, static_cast<float>(step) * dt, aircraft.state);
+      if (step == last)
+        break;
+      recording.advance(aircraft, ground);
+
+      if (opts.speed > 0.f)
+        {
+        // wall clock time at which this step is due, sleeping only when ahead by a few ms
+        const std::chrono::duration<double> due(static_cast<double>(step + 1 - first) * dt / opts.speed);
+        const auto ahead = start + due - std::chrono::steady_clock::now();
+        if (ahead > std::chrono::milliseconds(5))
+          std::this_thread::sleep_for(ahead);
+        }
+      }
+
+    if (out && out != stdout)
+      fclose(out);
+    if (aircraft.state.is_crashed())
+      fprintf(stderr, "the aircraft crashed\n");
+    if (recording.get_max_divergence() > 0.f)
+      fprintf(stderr, "replay diverged up to %.3f m from the recorded keyframes\n", recording.get_max_divergence());
+    if (opts.hash)
+      print_hash(&aircraft.state, 1);
+    }
+
+  void run(const Options& opts)
+    {
+    physics::fp_environment fp;
+    const std::vector<ControlEvent> events = opts.script.empty() ? std::vector<ControlEvent>() : read_script(opts.script);
+    ThreadPool pool(opts.threads > 0 ? static_cast<std::size_t>(opts.threads - 1) : ThreadPool::default_workers());
+    World fleet(pool);
+    create_fleet(fleet, opts);
+    TerrainField terrain;
+    if (load_terrain(opts, terrain))
+      fleet.set_terrain(&terrain);
+    FlightRecorder recorder;
+    if (!opts.record.empty() && !recorder.open(opts.record, opts.dt, fleet.get_type(0).name))
+      throw std::runtime_error("cannot create flight recording " + opts.record);
+
+    FILE* out = open_output(opts);
+
+    const int64_t steps = static_cast<int64_t>(std::ceil(opts.duration / opts.dt - 1e-3f));
+    const int64_t output_interval = std::max<int64_t>(1, static_cast<int64_t>(std::round(1.f / (opts.output_rate * opts.dt))));
+    std::size_t next_event = 0;
+
+    if (out)
+      write_header(out);
+    for (int64_t step = 0; step <= steps; ++step)
+      {
+      // time as a product instead of a running sum, so that long runs do not drift
+      const physics::seconds time = static_cast<float>(step) * opts.dt;
+      for (; next_event < events.size() && events[next_event].time <= time; ++next_event)
+        {
+        const ControlEvent& e = events[next_event];
+        if (e.aircraft < 0)
+          {
+          for (std::size_t i = 0; i < fleet.size(); ++i)
+            apply(e, fleet[i]);
+          }
+        else if (e.aircraft < opts.aircraft)
+          apply(e, fleet[e.aircraft]);
+        }
+
+      if (out && (step % output_interval == 0 || step == steps))
+        {
+        for (int i = 0; i < opts.aircraft; ++i)
+          write_state(out, i, time, fleet[i]);
+        }
+
+      if (step == steps)
+        break;
+
+      recorder.record(fleet[0]);
+      fleet.step(opts.dt);
+      }
+
+    if (out && out != stdout)
+      fclose(out);
+
+    std::size_t crashed = 0;
+    for (std::size_t i = 0; i < fleet.size(); ++i)
+      crashed += fleet[i].is_crashed() ? 1 : 0;
+    if (crashed > 0)
+      fprintf(stderr, "%d of %d aircraft crashed\n", (int)crashed, (int)fleet.size());
+
+    if (opts.hash)
+      print_hash(fleet.data(), fleet.size());
+    }
+
+  }
+
+int main(int argc, char** argv)
+  {
+  try
+    {
+    const Options opts = parse_options(argc, argv);
+    if (opts.replay.empty())
+      run(opts);
+    else
+      replay(opts);
+    }
+  catch (std::exception& e)
+    {
+    fprintf(stderr, "FlightSimulatorHeadless: %s\n", e.what());
+    return 1;
+    }
+  return 0;
+  }
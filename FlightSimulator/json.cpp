@@ -0,0 +1,323 @@
+#include "json.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace json
+  {
+
+  namespace
+    {
+    const char* type_name(Value::Type type)
+      {
+      switch (type)
+        {
+        case Value::Type::null: return "null";
+        case Value::Type::boolean: return "a boolean";
+        case Value::Type::number: return "a number";
+        case Value::Type::string: return "a string";
+        case Value::Type::array: return "an array";
+        case Value::Type::object: return "an object";
+        }
+      return "";
+      }
+
+    [[noreturn]] void type_error(const char* what, Value::Type expected, Value::Type actual)
+      {
+      throw std::runtime_error(std::string(what) + " should be " + type_name(expected) + " instead of " + type_name(actual));
+      }
+
+    void append_utf8(std::string& s, uint32_t c)
+      {
+      if (c < 0x80)
+        s += static_cast<char>(c);
+      else if (c < 0x800)
+        {
+        s += static_cast<char>(0xc0 | (c >> 6));
+        s += static_cast<char>(0x80 | (c & 0x3f));
+        }
+      else if (c < 0x10000)
+        {
+        s += static_cast<char>(0xe0 | (c >> 12));
+        s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        s += static_cast<char>(0x80 | (c & 0x3f));
+        }
+      else
+        {
+        s += static_cast<char>(0xf0 | (c >> 18));
+        s += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+        s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        s += static_cast<char>(0x80 | (c & 0x3f));
+        }
+      }
+    }
+
+  // recursive descent over the text, see https://www.json.org
+  class Parser
+    {
+    public:
+      Parser(const std::string& text) : m_text(text), m_pos(0)
+        {
+        }
+
+      Value parse_document()
+        {
+        Value v = parse_value(0);
+        skip_whitespace();
+        if (m_pos != m_text.size())
+          error("unexpected characters after the document");
+        return v;
+        }
+
+    private:
+      // deeper documents are surely broken, and would otherwise overflow the stack
+      static constexpr int max_depth = 256;
+
+      [[noreturn]] void error(const std::string& message) const
+        {
+        int line = 1;
+        for (std::size_t i = 0; i < m_pos && i < m_text.size(); ++i)
+          line += m_text[i] == '\n' ? 1 : 0;
+        throw std::runtime_error("json error on line " + std::to_string(line) + ": " + message);
+        }
+
+      void skip_whitespace()
+        {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+          ++m_pos;
+        }
+
+      char peek()
+        {
+        skip_whitespace();
+        if (m_pos >= m_text.size())
+          error("unexpected end of the document");
+        return m_text[m_pos];
+        }
+
+      void expect(char c)
+        {
+        if (peek() != c)
+          error(std::string("expected '") + c + "'");
+        ++m_pos;
+        }
+
+      bool match_word(const char* word)
+        {
+        const std::size_t n = std::char_traits<char>::length(word);
+        if (m_text.compare(m_pos, n, word) != 0)
+          return false;
+        m_pos += n;
+        return true;
+        }
+
+      Value parse_value(int depth)
+        {
+        if (depth > max_depth)
+          error("too deeply nested");
+        Value v;
+        const char c = peek();
+        if (c == '{')
+          {
+          v.m_type = Value::Type::object;
+          ++m_pos;
+          if (peek() == '}')
+            {
+            ++m_pos;
+            return v;
+            }
+          for (;;)
+            {
+            if (peek() != '"')
+              error("expected a member name");
+            std::string key = parse_string();
+            expect(':');
+            v.m_members.emplace_back(std::move(key), parse_value(depth + 1));
+            if (peek() == ',')
+              {
+              ++m_pos;
+              continue;
+              }
+            expect('}');
+            return v;
+            }
+          }
+        if (c == '[')
+          {
+          v.m_type = Value::Type::array;
+          ++m_pos;
+          if (peek() == ']')
+            {
+            ++m_pos;
+            return v;
+            }
+          for (;;)
+            {
+            v.m_elements.push_back(parse_value(depth + 1));
+            if (peek() == ',')
+              {
+              ++m_pos;
+              continue;
+              }
+            expect(']');
+            return v;
+            }
+          }
+        if (c == '"')
+          {
+          v.m_type = Value::Type::string;
+          v.m_string = parse_string();
+          return v;
+          }
+        if (match_word("true") || match_word("false"))
+          {
+          v.m_type = Value::Type::boolean;
+          v.m_bool = c == 't';
+          return v;
+          }
+        if (match_word("null"))
+          return v;
+        if (c == '-' || (c >= '0' && c <= '9'))
+          {
+          const char* begin = m_text.c_str() + m_pos;
+          char* end = nullptr;
+          v.m_type = Value::Type::number;
+          v.m_number = std::strtod(begin, &end);
+          if (end == begin)
+            error("malformed number");
+          m_pos += static_cast<std::size_t>(end - begin);
+          return v;
+          }
+        error(std::string("unexpected character '") + c + "'");
+        }
+
+      std::string parse_string()
+        {
+        std::string s;
+        ++m_pos; // opening quote
+        for (;;)
+          {
+          if (m_pos >= m_text.size())
+            error("unterminated string");
+          const char c = m_text[m_pos++];
+          if (c == '"')
+            return s;
+          if (c != '\\')
+            {
+            s += c;
+            continue;
+            }
+          if (m_pos >= m_text.size())
+            error("unterminated string");
+          const char e = m_text[m_pos++];
+          switch (e)
+            {
+            case '"': s += '"'; break;
+            case '\\': s += '\\'; break;
+            case '/': s += '/'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'n': s += '\n'; break;
+            case 'r': s += '\r'; break;
+            case 't': s += '\t'; break;
+            case 'u':
+              {
+              if (m_pos + 4 > m_text.size())
+                error("malformed unicode escape");
+              const uint32_t c16 = static_cast<uint32_t>(std::strtoul(m_text.substr(m_pos, 4).c_str(), nullptr, 16));
+              m_pos += 4;
+              append_utf8(s, c16);
+              break;
+              }
+            default:
+              error(std::string("unknown escape '\\") + e + "'");
+            }
+          }
+        }
+
+    private:
+      const std::string& m_text;
+      std::size_t m_pos;
+    };
+
+  Value::Value() : m_type(Type::null), m_bool(false), m_number(0.0)
+    {
+    }
+
+  bool Value::as_bool(const char* what) const
+    {
+    if (m_type != Type::boolean)
+      type_error(what, Type::boolean, m_type);
+    return m_bool;
+    }
+
+  double Value::as_number(const char* what) const
+    {
+    if (m_type != Type::number)
+      type_error(what, Type::number, m_type);
+    return m_number;
+    }
+
+  const std::string& Value::as_string(const char* what) const
+    {
+    if (m_type != Type::string)
+      type_error(what, Type::string, m_type);
+    return m_string;
+    }
+
+  std::size_t Value::size() const
+    {
+    return m_type == Type::array ? m_elements.size() : m_type == Type::object ? m_members.size() : 0;
+    }
+
+  const std::vector<Value>& Value::as_array(const char* what) const
+    {
+    if (m_type != Type::array)
+      type_error(what, Type::array, m_type);
+    return m_elements;
+    }
+
+  const Value* Value::find(const std::string& key) const
+    {
+    for (const auto& member : m_members)
+      {
+      if (member.first == key)
+        return &member.second;
+      }
+    return nullptr;
+    }
+
+  const Value& Value::at(const std::string& key) const
+    {
+    const Value* v = find(key);
+    if (!v)
+      throw std::runtime_error("missing member \"" + key + "\"");
+    return *v;
+    }
+
+  Value parse(const std::string& text)
+    {
+    return Parser(text).parse_document();
+    }
+
+  Value read_file(const std::string& filename)
+    {
+    std::ifstream f(filename, std::ios::binary);
+    if (!f.is_open())
+      throw std::runtime_error("cannot open " + filename);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    try
+      {
+      return parse(ss.str());
+      }
+    catch (std::exception& e)
+      {
+      throw std::runtime_error(filename + ": " + e.what());
+      }
+    }
+
+  }
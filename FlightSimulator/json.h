@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal json reader for configuration files, like the aircraft definitions. Parses the whole document into a tree
+// of values; objects keep the order of their members. Errors throw std::runtime_error with the line number.
+namespace json
+  {
+
+  class Value
+    {
+    public:
+      enum class Type
+        {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object
+        };
+
+      Value();
+
+      Type get_type() const { return m_type; }
+      bool is_null() const { return m_type == Type::null; }
+      bool is_number() const { return m_type == Type::number; }
+      bool is_string() const { return m_type == Type::string; }
+      bool is_array() const { return m_type == Type::array; }
+      bool is_object() const { return m_type == Type::object; }
+
+      // throw if the value has another type; what names the value in the error message
+      bool as_bool(const char* what = "value") const;
+      double as_number(const char* what = "value") const;
+      float as_float(const char* what = "value") const { return static_cast<float>(as_number(what)); }
+      const std::string& as_string(const char* what = "value") const;
+
+      // number of elements of an array or members of an object, 0 otherwise
+      std::size_t size() const;
+      // element of an array
+      const Value& operator [] (std::size_t i) const { return m_elements[i]; }
+      const std::vector<Value>& as_array(const char* what = "value") const;
+
+      // member of an object, nullptr if there is none
+      const Value* find(const std::string& key) const;
+      // member of an object, throws if there is none
+      const Value& at(const std::string& key) const;
+      const std::vector<std::pair<std::string, Value>>& members() const { return m_members; }
+
+    private:
+      friend class Parser;
+
+      Type m_type;
+      bool m_bool;
+      double m_number;
+      std::string m_string;
+      std::vector<Value> m_elements;
+      std::vector<std::pair<std::string, Value>> m_members;
+    };
+
+  Value parse(const std::string& text);
+
+  // throws if the file cannot be read
+  Value read_file(const std::string& filename);
+
+  }
@@ -0,0 +1,145 @@
+#include "landing_gear.h"
+#include "terrain.h"
+
+#include <cmath>
+
+namespace
+  {
+  // below this speed friction grows linearly with the slip, so that a wheel at rest does not jitter
+  constexpr float slip_speed = 0.2f; // m/s
+
+  // struts about parallel to the ground have no contact
+  constexpr float min_contact_cosine = 0.1f;
+
+  float ground_height(const TerrainField* terrain, float x, float z)
+    {
+    return terrain ? terrain->height(x, z) : 0.f;
+    }
+  }
+
+Strut::Strut(const jtk::vec3<float>& position, float length, float stiffness, float damping, float rolling_friction, float side_friction) :
+  position(position), length(length), stiffness(stiffness), damping(damping), rolling_friction(rolling_friction), side_friction(side_friction)
+  {
+  }
+
+LandingGear::LandingGear() : m_reach(0.f), m_max_step(0.001f), m_max_compression_speed(5.f)
+  {
+  }
+
+std::size_t LandingGear::add_strut(const Strut& strut)
+  {
+  m_struts.push_back(strut);
+  m_reach = physics::utils::max(m_reach, jtk::length(strut.position) + strut.length);
+  return m_struts.size() - 1;
+  }
+
+void LandingGear::add_crash_point(const jtk::vec3<float>& position)
+  {
+  m_crash_points.push_back(position);
+  m_reach = physics::utils::max(m_reach, jtk::length(position));
+  }
+
+void LandingGear::integrate(physics::RigidBody& body, physics::seconds dt, const TerrainField* terrain, uint32_t& flags) const
+  {
+  if (flags & gear_crashed)
+    return;
+
+  if (!_near_ground(body, dt, terrain))
+    {
+    flags &= ~gear_on_ground;
+    body.update(dt);
+    return;
+    }
+
+  const int substeps = physics::utils::max(1, static_cast<int>(std::ceil(dt / m_max_step)));
+  const physics::seconds h = dt / static_cast<float>(substeps);
+  // RigidBody::update clears the accumulated forces, so they are added again for every sub-step
+  const jtk::vec3<float> force = body.get_force();
+  const jtk::vec3<float> torque = body.get_torque();
+  for (int i = 0; i < substeps; ++i)
+    {
+    if (i > 0)
+      {
+      body.add_force(force);
+      body.add_relative_torque(torque);
+      }
+    if (!_add_contact_forces(body, terrain, flags))
+      {
+      _crash(body, flags);
+      return;
+      }
+    body.update(h);
+    }
+  }
+
+bool LandingGear::_near_ground(const physics::RigidBody& body, physics::seconds dt, const TerrainField* terrain) const
+  {
+  const jtk::vec3<float> p = body.get_position();
+  // within m_reach of the center of mass the ground can rise by another m_reach on slopes up to 45 degrees
+  const float margin = 2.f * m_reach + jtk::length(body.get_velocity()) * dt;
+  return p.y - ground_height(terrain, p.x, p.z) < margin;
+  }
+
+bool LandingGear::_add_contact_forces(physics::RigidBody& body, const TerrainField* terrain, uint32_t& flags) const
+  {
+  const jtk::vec3<float> position = body.get_position();
+  if (position.y < ground_height(terrain, position.x, position.z))
+    return false;
+  for (const auto& point : m_crash_points)
+    {
+    const jtk::vec3<float> p = position + body.transform_direction(point);
+    if (p.y < ground_height(terrain, p.x, p.z))
+      return false;
+    }
+
+  const jtk::vec3<float> down = body.transform_direction(physics::DOWN);
+  const jtk::vec3<float> forward = body.transform_direction(physics::FORWARD);
+  flags &= ~gear_on_ground;
+  for (const Strut& strut : m_struts)
+    {
+    const jtk::vec3<float> attachment = position + body.transform_direction(strut.position);
+    const jtk::vec3<float> wheel = attachment + down * strut.length;
+    const jtk::vec3<float> ground(wheel.x, ground_height(terrain, wheel.x, wheel.z), wheel.z);
+    const jtk::vec3<float> normal = terrain ? terrain->normal(wheel.x, wheel.z) : physics::UP;
+    const float cosine = jtk::dot(down, normal);
+    if (cosine > -min_contact_cosine)
+      continue;
+    // distance along the strut from the attachment point to the ground plane under the wheel
+    const float extension = jtk::dot(ground - attachment, normal) / cosine;
+    const float compression = strut.length - extension;
+    if (compression <= 0.f)
+      continue;
+    if (compression >= strut.length)
+      return false;
+    flags |= gear_on_ground;
+
+    const jtk::vec3<float> contact = strut.position + physics::DOWN * extension;
+    const jtk::vec3<float> velocity = body.transform_direction(body.get_point_velocity(contact));
+    const float compression_speed = jtk::dot(velocity, normal) / cosine;
+    if (compression_speed > m_max_compression_speed)
+      return false;
+    const float normal_force = physics::utils::max(0.f, strut.stiffness * compression + strut.damping * compression_speed);
+    jtk::vec3<float> force = normal * normal_force;
+
+    // the wheel rolls along the projection of the nose direction on the ground
+    jtk::vec3<float> along = forward - normal * jtk::dot(forward, normal);
+    const float along_length = jtk::length(along);
+    if (along_length > physics::epsilon)
+      {
+      along = along / along_length;
+      const jtk::vec3<float> across = jtk::cross(normal, along);
+      const float slip_along = physics::utils::clamp(jtk::dot(velocity, along) / slip_speed, -1.f, 1.f);
+      const float slip_across = physics::utils::clamp(jtk::dot(velocity, across) / slip_speed, -1.f, 1.f);
+      force = force - along * (strut.rolling_friction * normal_force * slip_along) - across * (strut.side_friction * normal_force * slip_across);
+      }
+    body.add_force_at_point(body.inverse_transform_direction(force), contact);
+    }
+  return true;
+  }
+
+void LandingGear::_crash(physics::RigidBody& body, uint32_t& flags) const
+  {
+  flags |= gear_crashed;
+  body.set_velocity(jtk::vec3<float>(0.f));
+  body.set_angular_velocity(jtk::vec3<float>(0.f));
+  }
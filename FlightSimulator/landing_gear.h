@@ -0,0 +1,75 @@
+#pragma once
+
+#include "physics.h"
+
+#include <stdint.h>
+#include <vector>
+
+class TerrainField;
+
+// per aircraft state of the gear, see AircraftState
+enum GearFlags : uint32_t
+  {
+  gear_on_ground = 1,
+  gear_crashed = 2
+  };
+
+// A leg of the landing gear: a spring-damper along the down axis of the body, with a wheel at its end.
+struct Strut
+  {
+  jtk::vec3<float> position; // attachment point in body space
+  float length;              // uncompressed, m
+  float stiffness;           // N/m
+  float damping;             // N/(m/s)
+  float rolling_friction;    // friction coefficient along the wheel
+  float side_friction;       // friction coefficient across the wheel
+
+  Strut(const jtk::vec3<float>& position, float length, float stiffness, float damping, float rolling_friction = 0.02f, float side_friction = 0.8f);
+  };
+
+// Ground contact of an aircraft type: struts with wheel friction, and points of the airframe that should never touch the
+// ground, like the wing tips and the tail. The aircraft crashes when such a point or the center of mass goes below the
+// ground, when a strut is compressed over its full length, or when a strut is compressed faster than the struts can
+// take. Ground heights come from a TerrainField, or from a flat ground at height 0 without one.
+// Contact forces are stiff compared to the flight dynamics, so near the ground integrate() splits the step into
+// sub-steps of at most max_step, in which only the contact forces are recomputed and the other forces of the step
+// stay constant. Away from the ground a step costs a single height query.
+// The gear itself is immutable in flight and shared by all aircraft of a type; whether an aircraft is on the ground
+// or crashed lives in the GearFlags of its state.
+class LandingGear
+  {
+  public:
+    LandingGear();
+
+    // returns the index of the new strut
+    std::size_t add_strut(const Strut& strut);
+    // position in body space
+    void add_crash_point(const jtk::vec3<float>& position);
+
+    std::size_t size() const { return m_struts.size(); }
+    const Strut& get_strut(std::size_t i) const { return m_struts[i]; }
+
+    void set_max_step(physics::seconds max_step) { m_max_step = max_step; }
+    physics::seconds get_max_step() const { return m_max_step; }
+
+    // m/s, roughly the sink rate at touchdown
+    void set_max_compression_speed(float speed) { m_max_compression_speed = speed; }
+    float get_max_compression_speed() const { return m_max_compression_speed; }
+
+    // Steps the rigid body by dt with the forces added to it so far and the contact forces, and updates the GearFlags
+    // in flags. After a crash the body is brought to rest and no longer stepped.
+    void integrate(physics::RigidBody& body, physics::seconds dt, const TerrainField* terrain, uint32_t& flags) const;
+
+  private:
+    bool _near_ground(const physics::RigidBody& body, physics::seconds dt, const TerrainField* terrain) const;
+    // adds the contact forces to the body and sets gear_on_ground in flags, returns false on a crash
+    bool _add_contact_forces(physics::RigidBody& body, const TerrainField* terrain, uint32_t& flags) const;
+    void _crash(physics::RigidBody& body, uint32_t& flags) const;
+
+  private:
+    std::vector<Strut> m_struts;
+    std::vector<jtk::vec3<float>> m_crash_points;
+    float m_reach; // largest distance of a wheel or crash point to the center of mass
+    physics::seconds m_max_step;
+    float m_max_compression_speed;
+  };
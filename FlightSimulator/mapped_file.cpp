@@ -0,0 +1,117 @@
+#include "mapped_file.h"
+#include "determinism.h"
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+uint64_t hash_file_stamp(const std::string& filename, uint64_t h)
+  {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return 0;
+  const uint64_t size = static_cast<uint64_t>(st.st_size);
+  const int64_t modified = static_cast<int64_t>(st.st_mtime);
+  h = physics::hash(&size, sizeof(size), h);
+  h = physics::hash(&modified, sizeof(modified), h);
+  // 0 means no file
+  return h ? h : 1;
+  }
+
+mapped_file::mapped_file() : m_data(nullptr), m_size(0)
+#if defined(_WIN32)
+  , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+  {
+  }
+
+mapped_file::~mapped_file()
+  {
+  close();
+  }
+
+#if defined(_WIN32)
+
+bool mapped_file::open(const std::string& filename)
+  {
+  close();
+  m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+    close();
+    return false;
+    }
+  m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping)
+    {
+    close();
+    return false;
+    }
+  m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!m_data)
+    {
+    close();
+    return false;
+    }
+  m_size = static_cast<std::size_t>(size.QuadPart);
+  return true;
+  }
+
+void mapped_file::close()
+  {
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  if (m_file != INVALID_HANDLE_VALUE)
+    CloseHandle(m_file);
+  m_data = nullptr;
+  m_size = 0;
+  m_mapping = nullptr;
+  m_file = INVALID_HANDLE_VALUE;
+  }
+
+#else
+
+bool mapped_file::open(const std::string& filename)
+  {
+  close();
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+    ::close(fd);
+    return false;
+    }
+  void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+  // the whole file is copied front to back right after opening
+  madvise(p, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL | MADV_WILLNEED);
+  m_data = static_cast<const uint8_t*>(p);
+  m_size = static_cast<std::size_t>(st.st_size);
+  return true;
+  }
+
+void mapped_file::close()
+  {
+  if (m_data)
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+  m_data = nullptr;
+  m_size = 0;
+  }
+
+#endif
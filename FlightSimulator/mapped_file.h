@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Hash of the size and modification time of a file, combined with h. Identifies the version of a source file that a
+// cache was baked from without reading it. Returns 0 if the file does not exist.
+uint64_t hash_file_stamp(const std::string& filename, uint64_t h);
+
+// Read-only memory mapping of a whole file. The pages are loaded on first access, so a file that is copied once into
+// its destination is read straight from the page cache without an intermediate buffer.
+class mapped_file
+  {
+  public:
+    mapped_file();
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator = (const mapped_file&) = delete;
+
+    // returns false if the file does not exist, is empty or cannot be mapped
+    bool open(const std::string& filename);
+    void close();
+
+    const uint8_t* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+  private:
+    const uint8_t* m_data;
+    std::size_t m_size;
+#if defined(_WIN32)
+    void* m_file;
+    void* m_mapping;
+#endif
+  };
@@ -1,4 +1,7 @@
 #include "material.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 #include <string>
 
 #include "gl_shaders.h"
@@ -204,16 +207,20 @@ terrain_material::terrain_material()
   proj_handle = -1;
   cam_handle = -1;
   res_handle = -1;
+  jitter_handle = -1;
   texture_heightmap = -1;
   texture_normalmap = -1;
   texture_colormap = -1;
   texture_noise = -1;
+  texture_max_heightmap = -1;
   heightmap_handle = -1;
   normalmap_handle = -1;
   colormap_handle = -1;
   noise_handle = -1;
+  max_heightmap_handle = -1;
   res_w = 800;
   res_h = 450;
+  jitter[0] = jitter[1] = jitter[2] = jitter[3] = 0.f;
   }
 
 terrain_material::~terrain_material()
@@ -228,10 +235,12 @@ void terrain_material::destroy(RenderDoos::render_engine* engine)
   engine->remove_uniform(proj_handle);
   engine->remove_uniform(cam_handle);
   engine->remove_uniform(res_handle);
+  engine->remove_uniform(jitter_handle);
   engine->remove_uniform(heightmap_handle);
   engine->remove_uniform(normalmap_handle);
   engine->remove_uniform(colormap_handle);
   engine->remove_uniform(noise_handle);
+  engine->remove_uniform(max_heightmap_handle);
   }
 
 void terrain_material::set_texture_heightmap(int32_t id)
@@ -260,6 +269,17 @@ void terrain_material::set_resolution(uint32_t w, uint32_t h)
   res_h = h;
   }
 
+void terrain_material::set_jitter(float x, float y)
+  {
+  jitter[0] = x;
+  jitter[1] = y;
+  }
+
+void terrain_material::set_texture_max_heightmap(int32_t id)
+  {
+  texture_max_heightmap = id;
+  }
+
 void terrain_material::compile(RenderDoos::render_engine* engine)
   {
   if (engine->get_renderer_type() == RenderDoos::renderer_type::METAL)
@@ -280,6 +300,8 @@ void terrain_material::compile(RenderDoos::render_engine* engine)
   normalmap_handle = engine->add_uniform("Normalmap", RenderDoos::uniform_type::sampler, 1);
   colormap_handle = engine->add_uniform("Colormap", RenderDoos::uniform_type::sampler, 1);
   noise_handle = engine->add_uniform("Noise", RenderDoos::uniform_type::sampler, 1);
+  jitter_handle = engine->add_uniform("Jitter", RenderDoos::uniform_type::vec4, 1);
+  max_heightmap_handle = engine->add_uniform("MaxHeightmap", RenderDoos::uniform_type::sampler, 1);
   }
 
 void terrain_material::bind(RenderDoos::render_engine* engine, float* projection, float* camera_space, float* /*light_dir*/)
@@ -297,11 +319,15 @@ void terrain_material::bind(RenderDoos::render_engine* engine, float* projection
   engine->set_uniform(colormap_handle, (void*)&tex);
   tex = 3;
   engine->set_uniform(noise_handle, (void*)&tex);
+  engine->set_uniform(jitter_handle, (void*)jitter);
+  tex = 4;
+  engine->set_uniform(max_heightmap_handle, (void*)&tex);
 
   engine->bind_texture_to_channel(texture_heightmap, 0, TEX_WRAP_REPEAT | TEX_FILTER_LINEAR);
   engine->bind_texture_to_channel(texture_normalmap, 1, TEX_WRAP_REPEAT | TEX_FILTER_LINEAR);
   engine->bind_texture_to_channel(texture_colormap, 2, TEX_WRAP_REPEAT | TEX_FILTER_LINEAR);
   engine->bind_texture_to_channel(texture_noise, 3, TEX_WRAP_REPEAT | TEX_FILTER_LINEAR);
+  engine->bind_texture_to_channel(texture_max_heightmap, 4, TEX_WRAP_CLAMP_TO_EDGE | TEX_FILTER_NEAREST);
 
   engine->bind_uniform(shader_program_handle, proj_handle);
   engine->bind_uniform(shader_program_handle, cam_handle);
@@ -310,6 +336,8 @@ void terrain_material::bind(RenderDoos::render_engine* engine, float* projection
   engine->bind_uniform(shader_program_handle, normalmap_handle);
   engine->bind_uniform(shader_program_handle, colormap_handle);
   engine->bind_uniform(shader_program_handle, noise_handle);
+  engine->bind_uniform(shader_program_handle, jitter_handle);
+  engine->bind_uniform(shader_program_handle, max_heightmap_handle);
   }
 
 
@@ -394,6 +422,129 @@ void blit_material::bind(RenderDoos::render_engine* engine, float* projection, f
   }
 
 
+temporal_upsample_material::temporal_upsample_material()
+  {
+  vs_handle = -1;
+  fs_handle = -1;
+  shader_program_handle = -1;
+  current_tex_handle = -1;
+  history_tex_handle = -1;
+  vp_handle = -1;
+  cam_handle = -1;
+  reprojection_handle = -1;
+  jitter_handle = -1;
+  params_handle = -1;
+  tex0_handle = -1;
+  tex1_handle = -1;
+  for (int i = 0; i < 16; ++i)
+    reprojection[i] = (i % 5 == 0) ? 1.f : 0.f;
+  jitter[0] = jitter[1] = 0.f;
+  jitter[2] = jitter[3] = 1.f;
+  history_weight = 0.f;
+  }
+
+temporal_upsample_material::~temporal_upsample_material()
+  {
+  }
+
+void temporal_upsample_material::set_textures(int32_t current_texture, int32_t history_texture)
+  {
+  current_tex_handle = (current_texture >= 0 && current_texture < MAX_TEXTURE) ? current_texture : -1;
+  history_tex_handle = (history_texture >= 0 && history_texture < MAX_TEXTURE) ? history_texture : -1;
+  }
+
+void temporal_upsample_material::set_reprojection(const float* camera, const float* previous_camera)
+  {
+  // rotation from the current to the previous camera space: transpose(previous) * current, column major
+  for (int c = 0; c < 3; ++c)
+    {
+    for (int r = 0; r < 3; ++r)
+      reprojection[c * 4 + r] = previous_camera[r * 4] * camera[c * 4] + previous_camera[r * 4 + 1] * camera[c * 4 + 1] + previous_camera[r * 4 + 2] * camera[c * 4 + 2];
+    reprojection[c * 4 + 3] = 0.f;
+    }
+  reprojection[12] = reprojection[13] = reprojection[14] = 0.f;
+  reprojection[15] = 1.f;
+  }
+
+void temporal_upsample_material::set_jitter(float x, float y, uint32_t w, uint32_t h)
+  {
+  jitter[0] = x;
+  jitter[1] = y;
+  jitter[2] = (float)w;
+  jitter[3] = (float)h;
+  }
+
+void temporal_upsample_material::set_history_weight(float weight)
+  {
+  history_weight = weight;
+  }
+
+void temporal_upsample_material::destroy(RenderDoos::render_engine* engine)
+  {
+  engine->remove_program(shader_program_handle);
+  engine->remove_shader(vs_handle);
+  engine->remove_shader(fs_handle);
+  engine->remove_uniform(vp_handle);
+  engine->remove_uniform(cam_handle);
+  engine->remove_uniform(reprojection_handle);
+  engine->remove_uniform(jitter_handle);
+  engine->remove_uniform(params_handle);
+  engine->remove_uniform(tex0_handle);
+  engine->remove_uniform(tex1_handle);
+  }
+
+void temporal_upsample_material::compile(RenderDoos::render_engine* engine)
+  {
+  using namespace RenderDoos;
+  if (engine->get_renderer_type() == renderer_type::METAL)
+    {
+    vs_handle = engine->add_shader(nullptr, SHADER_VERTEX, "temporal_upsample_material_vertex_shader");
+    fs_handle = engine->add_shader(nullptr, SHADER_FRAGMENT, "temporal_upsample_material_fragment_shader");
+    }
+  else if (engine->get_renderer_type() == renderer_type::OPENGL)
+    {
+    vs_handle = engine->add_shader(get_temporal_upsample_material_vertex_shader().c_str(), SHADER_VERTEX, nullptr);
+    fs_handle = engine->add_shader(get_temporal_upsample_material_fragment_shader().c_str(), SHADER_FRAGMENT, nullptr);
+    }
+  shader_program_handle = engine->add_program(vs_handle, fs_handle);
+  vp_handle = engine->add_uniform("Projection", uniform_type::mat4, 1);
+  cam_handle = engine->add_uniform("Camera", uniform_type::mat4, 1);
+  reprojection_handle = engine->add_uniform("Reprojection", uniform_type::mat4, 1);
+  jitter_handle = engine->add_uniform("Jitter", uniform_type::vec4, 1);
+  params_handle = engine->add_uniform("Params", uniform_type::vec4, 1);
+  tex0_handle = engine->add_uniform("Tex0", uniform_type::sampler, 1);
+  tex1_handle = engine->add_uniform("Tex1", uniform_type::sampler, 1);
+  }
+
+void temporal_upsample_material::bind(RenderDoos::render_engine* engine, float* projection, float* camera_space, float* /*light_dir*/)
+  {
+  using namespace RenderDoos;
+
+  engine->bind_program(shader_program_handle);
+
+  // the current texture has the aspect ratio of the screen, up to rounding
+  float params[4] = { jitter[2] / jitter[3], history_weight, 0.f, 0.f };
+  engine->set_uniform(vp_handle, (void*)projection);
+  engine->set_uniform(cam_handle, (void*)camera_space);
+  engine->set_uniform(reprojection_handle, (void*)reprojection);
+  engine->set_uniform(jitter_handle, (void*)jitter);
+  engine->set_uniform(params_handle, (void*)params);
+  int32_t tex = 0;
+  engine->set_uniform(tex0_handle, (void*)&tex);
+  tex = 1;
+  engine->set_uniform(tex1_handle, (void*)&tex);
+  engine->bind_uniform(shader_program_handle, vp_handle);
+  engine->bind_uniform(shader_program_handle, cam_handle);
+  engine->bind_uniform(shader_program_handle, reprojection_handle);
+  engine->bind_uniform(shader_program_handle, jitter_handle);
+  engine->bind_uniform(shader_program_handle, params_handle);
+  engine->bind_uniform(shader_program_handle, tex0_handle);
+  engine->bind_uniform(shader_program_handle, tex1_handle);
+  engine->bind_texture_to_channel(current_tex_handle, 0, TEX_WRAP_CLAMP_TO_EDGE | TEX_FILTER_LINEAR);
+  engine->bind_texture_to_channel(history_tex_handle, 1, TEX_WRAP_CLAMP_TO_EDGE | TEX_FILTER_LINEAR);
+  }
+
+
 font_material::font_material()
   {
   vs_handle = -1;
@@ -403,6 +554,8 @@ font_material::font_material()
   height_handle = -1;
   geometry_id = -1;
   atlas_texture_id = -1;
+  glyph_capacity = 2048;
+  glyph_count = 0;
   }
 
 font_material::~font_material()
@@ -531,6 +684,25 @@ void font_material::compile(RenderDoos::render_engine* engine)
   width_handle = engine->add_uniform("width", RenderDoos::uniform_type::integer, 1);
   height_handle = engine->add_uniform("height", RenderDoos::uniform_type::integer, 1);
   _init_font(engine);
+  vertices.resize(glyph_capacity * 4);
+  glyph_count = 0;
+  geometry_id = engine->add_geometry(VERTEX_2_2_3);
+
+  // the buffers are sized for the full capacity once; the quad indices never change, so they are written only here
+  text_vert_t* vp;
+  uint32_t* ip;
+  engine->geometry_begin(geometry_id, glyph_capacity * 4, glyph_capacity * 6, (float**)&vp, (void**)&ip);
+  memset(vp, 0, sizeof(text_vert_t) * 4 * glyph_capacity);
+  for (uint32_t i = 0; i < glyph_capacity; ++i)
+    {
+    *ip++ = i * 4;
+    *ip++ = i * 4 + 1;
+    *ip++ = i * 4 + 2;
+    *ip++ = i * 4 + 1;
+    *ip++ = i * 4 + 2;
+    *ip++ = i * 4 + 3;
+    }
+  engine->geometry_end(geometry_id);
   }
 
 void font_material::bind(RenderDoos::render_engine* engine, float* projection, float* camera_space, float* light_dir)
@@ -576,15 +748,19 @@ namespace
     }
   }
 
-void font_material::prepare_text(RenderDoos::render_engine* engine, const char* text, float x, float y, float sx, float sy, uint32_t clr)
+void font_material::set_capacity(uint32_t max_glyphs)
   {
-  if (geometry_id >= 0)
-    engine->remove_geometry(geometry_id);
+  glyph_capacity = max_glyphs;
+  }
 
-  const float x_orig = x;
+void font_material::clear_text()
+  {
+  glyph_count = 0;
+  }
 
-  std::vector<text_vert_t> verts(6 * strlen(text));
-  int n = 0;
+float font_material::add_text(const char* text, float x, float y, float sx, float sy, uint32_t clr)
+  {
+  const float x_orig = x;
 
   char_info_t* c = char_info;
 
@@ -592,59 +768,76 @@ void font_material::prepare_text(RenderDoos::render_engine* engine, const char*
   float green = ((clr >> 8) & 255) / 255.f;
   float blue = ((clr >> 16) & 255) / 255.f;
 
+  const float line_height = c['@'].bh * sy;
+
   const char* p;
   for (p = text; *p; ++p)
     {
     if (*p == 10)
       {
-      y -= c['@'].bh*sy;
+      y -= line_height;
       x = x_orig;
       continue;
       }
-    float x2 = x + c[*p].bl * sx;
-    float y2 = -y - c[*p].bt * sy;
-    float w = c[*p].bw * sx;
-    float h = c[*p].bh * sy;
+    // the atlas only holds the printable ascii characters
+    const unsigned char ch = (unsigned char)*p;
+    if (ch < 32 || ch >= 128)
+      continue;
+    float x2 = x + c[ch].bl * sx;
+    float y2 = -y - c[ch].bt * sy;
+    float w = c[ch].bw * sx;
+    float h = c[ch].bh * sy;
 
     // Advance cursor to start of next char
-    x += c[*p].ax * sx;
-    y += c[*p].ay * sy;
+    x += c[ch].ax * sx;
+    y += c[ch].ay * sy;
 
     // Skip 0 pixel glyphs
     if (!w || !h)
       continue;
 
-    verts[n++] = (text_vert_t)make_text_vert(x2, -y2, c[*p].tx, c[*p].ty, red, green, blue);
-    verts[n++] = (text_vert_t)make_text_vert(x2 + w, -y2, c[*p].tx + c[*p].bw / atlas_width, c[*p].ty, red, green, blue);
-    verts[n++] = (text_vert_t)make_text_vert(x2, -y2 - h, c[*p].tx, c[*p].ty + c[*p].bh / atlas_height, red, green, blue);
-    verts[n++] = (text_vert_t)make_text_vert(x2 + w, -y2, c[*p].tx + c[*p].bw / atlas_width, c[*p].ty, red, green, blue);
-    verts[n++] = (text_vert_t)make_text_vert(x2, -y2 - h, c[*p].tx, c[*p].ty + c[*p].bh / atlas_height, red, green, blue);
-    verts[n++] = (text_vert_t)make_text_vert(x2 + w, -y2 - h, c[*p].tx + c[*p].bw / atlas_width, c[*p].ty + c[*p].bh / atlas_height, red, green, blue);
+    if (glyph_count == glyph_capacity)
+      break;
+
+    const float s0 = c[ch].tx;
+    const float t0 = c[ch].ty;
+    const float s1 = c[ch].tx + c[ch].bw / atlas_width;
+    const float t1 = c[ch].ty + c[ch].bh / atlas_height;
+    text_vert_t* v = vertices.data() + glyph_count * 4;
+    v[0] = make_text_vert(x2, -y2, s0, t0, red, green, blue);
+    v[1] = make_text_vert(x2 + w, -y2, s1, t0, red, green, blue);
+    v[2] = make_text_vert(x2, -y2 - h, s0, t1, red, green, blue);
+    v[3] = make_text_vert(x2 + w, -y2 - h, s1, t1, red, green, blue);
+    ++glyph_count;
     }
+  return y - line_height;
+  }
 
-  geometry_id = engine->add_geometry(VERTEX_2_2_3);
+float font_material::add_textf(float x, float y, float sx, float sy, uint32_t clr, const char* format, ...)
+  {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return add_text(buffer, x, y, sx, sy, clr);
+  }
 
+void font_material::upload_text(RenderDoos::render_engine* engine)
+  {
+  // same sizes as in compile, so the engine keeps its buffers and the indices; only the glyphs of this frame are
+  // written, render_text draws no further
   text_vert_t* vp;
   uint32_t* ip;
-
-  engine->geometry_begin(geometry_id, verts.size(), verts.size(), (float**)&vp, (void**)&ip);
-  memcpy(vp, verts.data(), sizeof(float) * 7 * verts.size());
-  for (uint32_t i = 0; i < verts.size()/6; ++i)
-    {
-    *ip++ = i * 6;
-    *ip++ = i * 6 + 1;
-    *ip++ = i * 6 + 2;
-    *ip++ = i * 6 + 3;
-    *ip++ = i * 6 + 4;
-    *ip++ = i * 6 + 5;
-    }
+  engine->geometry_begin(geometry_id, glyph_capacity * 4, glyph_capacity * 6, (float**)&vp, (void**)&ip);
+  memcpy(vp, vertices.data(), sizeof(text_vert_t) * 4 * glyph_count);
   engine->geometry_end(geometry_id);
-  //engine->geometry_draw(geometry_id);
   }
 
 void font_material::render_text(RenderDoos::render_engine* engine)
   {
-  engine->geometry_draw(geometry_id);
+  if (glyph_count > 0)
+    engine->geometry_draw(geometry_id, glyph_count * 6, 0);
   }
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 
 #include "ft2build.h"
 #include FT_FREETYPE_H
@@ -79,6 +80,10 @@ class terrain_material : public material
     void set_texture_colormap(int32_t id);
     void set_texture_noise(int32_t id);
     void set_resolution(uint32_t w, uint32_t h);
+    // subpixel offset of the rays in pixels, in [-0.5, 0.5], for temporal_upsample_material
+    void set_jitter(float x, float y);
+    // HeightPyramid packed by texture::init_from_height_pyramid, lets the raymarch skip over low terrain
+    void set_texture_max_heightmap(int32_t id);
 
     uint32_t get_resolution_width() const { return res_w; }
     uint32_t get_resolution_height() const { return res_h; }
@@ -86,10 +91,42 @@ class terrain_material : public material
   private:
     int32_t vs_handle, fs_handle;
     int32_t shader_program_handle;
-    int32_t proj_handle, res_handle, cam_handle;
-    int32_t texture_heightmap, texture_normalmap, texture_colormap, texture_noise;
-    int32_t heightmap_handle, normalmap_handle, colormap_handle, noise_handle;
+    int32_t proj_handle, res_handle, cam_handle, jitter_handle;
+    int32_t texture_heightmap, texture_normalmap, texture_colormap, texture_noise, texture_max_heightmap;
+    int32_t heightmap_handle, normalmap_handle, colormap_handle, noise_handle, max_heightmap_handle;
     uint32_t res_w, res_h;
+    float jitter[4];
+  };
+
+// Reconstructs the full resolution terrain from the jittered, lower resolution raymarch of terrain_material and the
+// reprojected result of the previous frame. The terrain is kilometers away, so the reprojection only accounts for the
+// rotation of the camera. History that does not fit the neighbourhood of the current sample is clamped.
+class temporal_upsample_material : public material
+  {
+  public:
+    temporal_upsample_material();
+    virtual ~temporal_upsample_material();
+
+    void set_textures(int32_t current_texture, int32_t history_texture);
+    // camera matrices as passed to terrain_material::bind, of this frame and of the previous one
+    void set_reprojection(const float* camera, const float* previous_camera);
+    // jitter of terrain_material and the size of the current texture in pixels
+    void set_jitter(float x, float y, uint32_t w, uint32_t h);
+    // 0 ignores the history, e.g. on the first frame
+    void set_history_weight(float weight);
+
+    virtual void compile(RenderDoos::render_engine* engine);
+    virtual void bind(RenderDoos::render_engine* engine, float* projection, float* camera_space, float* light_dir);
+    virtual void destroy(RenderDoos::render_engine* engine);
+
+  private:
+    int32_t vs_handle, fs_handle;
+    int32_t shader_program_handle;
+    int32_t current_tex_handle, history_tex_handle;
+    int32_t vp_handle, cam_handle, reprojection_handle, jitter_handle, params_handle, tex0_handle, tex1_handle; // uniforms
+    float reprojection[16];
+    float jitter[4];
+    float history_weight;
   };
 
 class blit_material : public material
@@ -148,9 +185,19 @@ class font_material : public material
     virtual void bind(RenderDoos::render_engine* engine, float* projection, float* camera_space, float* light_dir);
     virtual void destroy(RenderDoos::render_engine* engine);
 
-    void prepare_text(RenderDoos::render_engine* engine, const char* text, float x, float y, float sx, float sy, uint32_t clr);
+    // Text is drawn in batches: clear_text, any number of add_text calls, upload_text outside of a render pass, then
+    // render_text draws all runs with a single draw call. The geometry has room for a fixed number of glyphs; its
+    // indices are written once by compile, and upload_text only writes the vertices of the glyphs that are drawn.
+    // Glyphs beyond the capacity are dropped.
+    void set_capacity(uint32_t max_glyphs); // before compile
+    void clear_text();
+    // returns the y coordinate of the line below the text
+    float add_text(const char* text, float x, float y, float sx, float sy, uint32_t clr);
+    // printf style formatting into a fixed size buffer, longer text is cut off
+    float add_textf(float x, float y, float sx, float sy, uint32_t clr, const char* format, ...);
+    void upload_text(RenderDoos::render_engine* engine);
     void render_text(RenderDoos::render_engine* engine);
-    
+
   private:
 
     void _init_font(RenderDoos::render_engine* engine);
@@ -161,6 +208,10 @@ class font_material : public material
     int32_t width_handle, height_handle;
     int32_t geometry_id;
 
+    std::vector<text_vert_t> vertices; // 4 per glyph, reserved for glyph_capacity glyphs
+    uint32_t glyph_capacity;
+    uint32_t glyph_count;
+
     int32_t atlas_texture_id;
 
     int32_t atlas_width;
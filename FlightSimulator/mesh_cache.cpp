@@ -0,0 +1,133 @@
+#include "mesh_cache.h"
+#include "determinism.h"
+
+#include "RenderDoos/render_engine.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+  {
+  constexpr char magic[4] = { 'F', 'S', 'M', 'C' };
+  // bump when the baked layout or the way meshes are baked changes
+  constexpr uint32_t version = 1;
+
+  struct header
+    {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t vertex_size;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t reserved[9];
+    };
+
+  static_assert(sizeof(header) == 64, "the vertex data should start 64 byte aligned");
+
+  uint64_t payload_size(const header& h)
+    {
+    return uint64_t(h.vertex_count) * h.vertex_size + uint64_t(h.index_count) * sizeof(uint32_t);
+    }
+  }
+
+uint64_t mesh_cache_key(const std::string& ply_filename, float rx, float ry, float rz)
+  {
+  uint64_t h = physics::hash(&version, sizeof(version));
+  h = physics::hash(rx, h);
+  h = physics::hash(ry, h);
+  h = physics::hash(rz, h);
+  return hash_file_stamp(ply_filename, h);
+  }
+
+baked_mesh::baked_mesh() : m_vertex_data(nullptr), m_index_data(nullptr), m_vertex_count(0), m_index_count(0)
+  {
+  }
+
+bool baked_mesh::map(const std::string& filename, uint64_t key)
+  {
+  clear();
+  if (key == 0 || !m_file.open(filename))
+    return false;
+  header h;
+  if (m_file.size() >= sizeof(header))
+    memcpy(&h, m_file.data(), sizeof(h));
+  if (m_file.size() < sizeof(header) || memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version || h.key != key ||
+    h.vertex_size != sizeof(RenderDoos::vertex_standard) || m_file.size() != sizeof(header) + payload_size(h))
+    {
+    m_file.close();
+    return false;
+    }
+  m_vertex_data = reinterpret_cast<const RenderDoos::vertex_standard*>(m_file.data() + sizeof(header));
+  m_index_data = reinterpret_cast<const uint32_t*>(m_vertex_data + h.vertex_count);
+  m_vertex_count = h.vertex_count;
+  m_index_count = h.index_count;
+  return true;
+  }
+
+void baked_mesh::assign(std::vector<RenderDoos::vertex_standard>&& vertices, std::vector<uint32_t>&& indices)
+  {
+  clear();
+  m_vertices = std::move(vertices);
+  m_indices = std::move(indices);
+  m_vertex_data = m_vertices.data();
+  m_index_data = m_indices.data();
+  m_vertex_count = static_cast<uint32_t>(m_vertices.size());
+  m_index_count = static_cast<uint32_t>(m_indices.size());
+  }
+
+bool baked_mesh::write(const std::string& filename, uint64_t key) const
+  {
+  header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.key = key;
+  h.vertex_size = sizeof(RenderDoos::vertex_standard);
+  h.vertex_count = m_vertex_count;
+  h.index_count = m_index_count;
+
+  // written under a temporary name, so that a reader never maps a partially written cache
+  const std::string tmp_filename = filename + ".tmp";
+  FILE* f = fopen(tmp_filename.c_str(), "wb");
+  if (!f)
+    return false;
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  ok = ok && fwrite(m_vertex_data, sizeof(RenderDoos::vertex_standard), m_vertex_count, f) == m_vertex_count;
+  ok = ok && fwrite(m_index_data, sizeof(uint32_t), m_index_count, f) == m_index_count;
+  ok = (fclose(f) == 0) && ok;
+  if (ok)
+    {
+    // rename does not replace an existing file on Windows
+    remove(filename.c_str());
+    ok = rename(tmp_filename.c_str(), filename.c_str()) == 0;
+    }
+  if (!ok)
+    remove(tmp_filename.c_str());
+  return ok;
+  }
+
+int32_t baked_mesh::upload(RenderDoos::render_engine& engine) const
+  {
+  if (m_vertex_count == 0)
+    return -1;
+  const int32_t geometry_id = engine.add_geometry(VERTEX_STANDARD);
+  float* vp;
+  void* ip;
+  engine.geometry_begin(geometry_id, m_vertex_count, m_index_count, &vp, &ip);
+  memcpy(vp, m_vertex_data, std::size_t(m_vertex_count) * sizeof(RenderDoos::vertex_standard));
+  memcpy(ip, m_index_data, std::size_t(m_index_count) * sizeof(uint32_t));
+  engine.geometry_end(geometry_id);
+  return geometry_id;
+  }
+
+void baked_mesh::clear()
+  {
+  m_file.close();
+  m_vertices = std::vector<RenderDoos::vertex_standard>();
+  m_indices = std::vector<uint32_t>();
+  m_vertex_data = nullptr;
+  m_index_data = nullptr;
+  m_vertex_count = 0;
+  m_index_count = 0;
+  }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include "RenderDoos/types.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace RenderDoos
+  {
+  class render_engine;
+  }
+
+// Baked meshes: the vertex and index buffers exactly as they are handed to the render engine, so loading a mesh is a
+// single copy from a memory mapped file into geometry_begin.
+//
+// Layout: a 64 byte header, vertex_count RenderDoos::vertex_standard, index_count uint32_t indices.
+// The header stores a key of the source (see mesh_cache_key). A cache file with another key, another version or vertex
+// size, or a size that does not match the header, is ignored and baked again.
+
+// Key of a PLY file together with the rotation applied while loading. It covers the size and modification time of the
+// file, so an unchanged cache is validated without reading the PLY. Returns 0 if the file does not exist.
+uint64_t mesh_cache_key(const std::string& ply_filename, float rx, float ry, float rz);
+
+// Vertex and index buffers laid out for geometry_begin, either mapped from a cache file or baked in memory.
+// Filling the buffers does not touch the render engine, only upload does.
+class baked_mesh
+  {
+  public:
+    baked_mesh();
+
+    // returns false if filename is not a valid cache for key
+    bool map(const std::string& filename, uint64_t key);
+    void assign(std::vector<RenderDoos::vertex_standard>&& vertices, std::vector<uint32_t>&& indices);
+    // returns false if the file could not be written
+    bool write(const std::string& filename, uint64_t key) const;
+
+    // Adds a VERTEX_STANDARD geometry to the engine with the buffers.
+    // Returns the geometry id, or -1 if the buffers are empty.
+    int32_t upload(RenderDoos::render_engine& engine) const;
+    void clear();
+
+    uint32_t vertex_count() const { return m_vertex_count; }
+    uint32_t index_count() const { return m_index_count; }
+
+  private:
+    mapped_file m_file;
+    std::vector<RenderDoos::vertex_standard> m_vertices;
+    std::vector<uint32_t> m_indices;
+    // into m_file or the vectors
+    const RenderDoos::vertex_standard* m_vertex_data;
+    const uint32_t* m_index_data;
+    uint32_t m_vertex_count, m_index_count;
+  };
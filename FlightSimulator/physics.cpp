@@ -1,4 +1,5 @@
 #include "physics.h"
+#include "determinism.h"
 
 
 namespace
@@ -10,6 +11,26 @@ namespace
     jtk::vec3<float> uuv(jtk::cross(quatvector, uv));
     return v + ((uv * q[3]) + uuv) * 2.f;
     }
+
+  // time derivative of orientation q for body space angular velocity w
+  jtk::float4 orientation_derivative(const jtk::float4& q, const jtk::vec3<float>& w)
+    {
+    return jtk::quaternion_multiply(q, jtk::float4(w.x, w.y, w.z, 0)) * 0.5f;
+    }
+
+  // unit quaternion for the rotation over rotation vector r (axis times angle)
+  jtk::float4 exponential_map(const jtk::vec3<float>& r)
+    {
+    const float angle = jtk::length(r);
+    if (angle < 1e-4f)
+      {
+      // Taylor expansion of sin(angle/2)/angle and cos(angle/2)
+      const float s = 0.5f - angle * angle / 48.f;
+      return jtk::float4(r.x * s, r.y * s, r.z * s, 1.f - angle * angle / 8.f);
+      }
+    const float s = physics::math::sin(0.5f * angle) / angle;
+    return jtk::float4(r.x * s, r.y * s, r.z * s, physics::math::cos(0.5f * angle));
+    }
   }
 
 namespace physics
@@ -37,11 +58,9 @@ namespace physics
       return I;
       }
 
-    jtk::matf9 tensor(const jtk::vec3<float>& moment_of_inertia)
+    mat3 tensor(const jtk::vec3<float>& moment_of_inertia)
       {
-      jtk::matf9 t(3, 3);
-      t << moment_of_inertia.x, 0.f, 0.f, 0.f, moment_of_inertia.y, 0.f, 0.f, 0.f, moment_of_inertia.z;
-      return t;
+      return diagonal(moment_of_inertia.x, moment_of_inertia.y, moment_of_inertia.z);
       }
 
     element cube_element(const jtk::vec3<float>& position, const jtk::vec3<float>& size, float mass)
@@ -54,10 +73,8 @@ namespace physics
       return e;
       }
 
-    jtk::matf9 tensor(std::vector<element>& elements, bool precomputed_offset)
+    mat3 tensor(std::vector<element>& elements, bool precomputed_offset)
       {
-      jtk::matf9 t(3, 3);
-
       float Ixx = 0, Iyy = 0, Izz = 0;
       float Ixy = 0, Ixz = 0, Iyz = 0;
 
@@ -91,10 +108,10 @@ namespace physics
         Iyz += element.mass * (offset.y * offset.z);
         }
 
-      t << Ixx, -Ixy, -Ixz,
+      return make_mat3(
+        Ixx, -Ixy, -Ixz,
         -Ixy, Iyy, -Iyz,
-        -Ixz, -Iyz, Izz;
-      return t;
+        -Ixz, -Iyz, Izz);
       }
 
     } // namespace inertia
@@ -122,14 +139,9 @@ namespace physics
       return res;
       }
 
-    jtk::vec3<float> transform_vector(const jtk::matf9& pose, const jtk::vec3<float>& pt)
+    jtk::vec3<float> rotate(const jtk::float4& q, const jtk::vec3<float>& v)
       {
-      jtk::vec3<float> res(
-        pose(0, 0) * pt[0] + pose(0, 1) * pt[1] + pose(0, 2) * pt[2],
-        pose(1, 0) * pt[0] + pose(1, 1) * pt[1] + pose(1, 2) * pt[2],
-        pose(2, 0) * pt[0] + pose(2, 1) * pt[1] + pose(2, 2) * pt[2]
-      );
-      return res;
+      return q * v;
       }
 
     } // namespace utils
@@ -143,6 +155,7 @@ namespace physics
     angular_velocity = jtk::vec3<float>(0);
     apply_gravity = true;
     orientation = jtk::float4(0, 0, 0, 1);
+    method = integrator::semi_implicit_euler;
     }
 
   RigidBody::RigidBody()
@@ -156,7 +169,9 @@ namespace physics
     m_angular_velocity = jtk::vec3<float>(0);
     m_apply_gravity = true;
     m_orientation = jtk::float4(0, 0, 0, 1);
-    jtk::invert(m_inertia_inverse, m_inertia);
+    m_inertia_inverse = invert(m_inertia);
+    m_diagonal_inertia = m_inertia.is_diagonal();
+    m_integrator = integrator::semi_implicit_euler;
     }
 
   RigidBody::RigidBody(const RigidBodyParams& params)
@@ -170,7 +185,9 @@ namespace physics
     m_angular_velocity = params.angular_velocity;
     m_apply_gravity = params.apply_gravity;
     m_orientation = params.orientation;
-    jtk::invert(m_inertia_inverse, m_inertia);
+    m_inertia_inverse = invert(m_inertia);
+    m_diagonal_inertia = m_inertia.is_diagonal();
+    m_integrator = params.method;
     }
 
   jtk::vec3<float> RigidBody::get_point_velocity(const jtk::vec3<float>& point) const
@@ -199,10 +216,21 @@ namespace physics
     return jtk::quaternion_inverse(m_orientation)*direction;
     }
 
-  void RigidBody::set_inertia(const jtk::matf9& inertia_tensor)
+  void RigidBody::set_inertia(const mat3& inertia_tensor)
     {
     m_inertia = inertia_tensor;
-    jtk::invert(m_inertia_inverse, m_inertia);
+    m_inertia_inverse = invert(m_inertia);
+    m_diagonal_inertia = m_inertia.is_diagonal();
+    }
+
+  mat3 RigidBody::get_inertia() const
+    {
+    return m_inertia;
+    }
+
+  float RigidBody::get_mass() const
+    {
+    return m_mass;
     }
 
   void RigidBody::add_force(const jtk::vec3<float>& force)
@@ -250,6 +278,11 @@ namespace physics
     return m_angular_velocity;
     }
 
+  jtk::float4 RigidBody::get_orientation() const
+    {
+    return m_orientation;
+    }
+
   void RigidBody::set_position(const jtk::vec3<float>& pos)
     {
     m_position = pos;
@@ -265,23 +298,121 @@ namespace physics
     m_angular_velocity = vel;
     }
 
-  void RigidBody::update(seconds dt)
+  void RigidBody::set_orientation(const jtk::float4& orientation)
+    {
+    m_orientation = orientation;
+    }
+
+  void RigidBody::set_integrator(integrator method)
+    {
+    m_integrator = method;
+    }
+
+  integrator RigidBody::get_integrator() const
+    {
+    return m_integrator;
+    }
+
+  jtk::vec3<float> RigidBody::_linear_acceleration() const
     {
     jtk::vec3<float> acceleration = m_force / m_mass;
 
     if (m_apply_gravity)
       acceleration.y -= g;
 
-    m_velocity = m_velocity + acceleration * dt;
+    return acceleration;
+    }
+
+  jtk::vec3<float> RigidBody::_angular_acceleration(const jtk::vec3<float>& angular_velocity) const
+    {
+    if (m_diagonal_inertia)
+      {
+      return utils::transform_vector_diagonal(m_inertia_inverse,
+        m_torque - jtk::cross(angular_velocity, utils::transform_vector_diagonal(m_inertia, angular_velocity)));
+      }
+    return utils::transform_vector(m_inertia_inverse,
+      m_torque - jtk::cross(angular_velocity, utils::transform_vector(m_inertia, angular_velocity)));
+    }
+
+  void RigidBody::_integrate_semi_implicit_euler(seconds dt)
+    {
+    m_velocity = m_velocity + _linear_acceleration() * dt;
     m_position = m_position + m_velocity * dt;
 
+    m_angular_velocity = m_angular_velocity + _angular_acceleration(m_angular_velocity) * dt;
 
-    m_angular_velocity = m_angular_velocity + utils::transform_vector(m_inertia_inverse,
-      m_torque - jtk::cross(m_angular_velocity, utils::transform_vector(m_inertia, m_angular_velocity))) * dt;    
+    m_orientation = m_orientation + orientation_derivative(m_orientation, m_angular_velocity) * dt;
+    m_orientation = jtk::quaternion_normalize(m_orientation);
+    }
+
+  void RigidBody::_integrate_explicit_euler(seconds dt)
+    {
+    m_position = m_position + m_velocity * dt;
+    m_velocity = m_velocity + _linear_acceleration() * dt;
 
-    m_orientation = m_orientation + jtk::quaternion_multiply(m_orientation, jtk::float4(m_angular_velocity.x, m_angular_velocity.y, m_angular_velocity.z, 0)) * (0.5f * dt);
+    m_orientation = m_orientation + orientation_derivative(m_orientation, m_angular_velocity) * dt;
     m_orientation = jtk::quaternion_normalize(m_orientation);
 
+    m_angular_velocity = m_angular_velocity + _angular_acceleration(m_angular_velocity) * dt;
+    }
+
+  void RigidBody::_integrate_rk4(seconds dt)
+    {
+    const float half_dt = 0.5f * dt;
+
+    // the linear part has a constant acceleration, so rk4 reduces to the exact solution
+    const jtk::vec3<float> acceleration = _linear_acceleration();
+    m_position = m_position + m_velocity * dt + acceleration * (half_dt * dt);
+    m_velocity = m_velocity + acceleration * dt;
+
+    const jtk::float4 q1 = m_orientation;
+    const jtk::vec3<float> w1 = m_angular_velocity;
+    const jtk::float4 dq1 = orientation_derivative(q1, w1);
+    const jtk::vec3<float> dw1 = _angular_acceleration(w1);
+
+    const jtk::float4 q2 = q1 + dq1 * half_dt;
+    const jtk::vec3<float> w2 = w1 + dw1 * half_dt;
+    const jtk::float4 dq2 = orientation_derivative(q2, w2);
+    const jtk::vec3<float> dw2 = _angular_acceleration(w2);
+
+    const jtk::float4 q3 = q1 + dq2 * half_dt;
+    const jtk::vec3<float> w3 = w1 + dw2 * half_dt;
+    const jtk::float4 dq3 = orientation_derivative(q3, w3);
+    const jtk::vec3<float> dw3 = _angular_acceleration(w3);
+
+    const jtk::float4 q4 = q1 + dq3 * dt;
+    const jtk::vec3<float> w4 = w1 + dw3 * dt;
+    const jtk::float4 dq4 = orientation_derivative(q4, w4);
+    const jtk::vec3<float> dw4 = _angular_acceleration(w4);
+
+    const float sixth_dt = dt / 6.f;
+    m_orientation = q1 + (dq1 + dq2 * 2.f + dq3 * 2.f + dq4) * sixth_dt;
+    m_orientation = jtk::quaternion_normalize(m_orientation);
+    m_angular_velocity = w1 + (dw1 + dw2 * 2.f + dw3 * 2.f + dw4) * sixth_dt;
+    }
+
+  void RigidBody::_integrate_exponential_map(seconds dt)
+    {
+    m_velocity = m_velocity + _linear_acceleration() * dt;
+    m_position = m_position + m_velocity * dt;
+
+    m_angular_velocity = m_angular_velocity + _angular_acceleration(m_angular_velocity) * dt;
+
+    // the angular velocity is in body space, so the incremental rotation is applied on the right
+    m_orientation = jtk::quaternion_multiply(m_orientation, exponential_map(m_angular_velocity * dt));
+    m_orientation = jtk::quaternion_normalize(m_orientation);
+    }
+
+  void RigidBody::update(seconds dt)
+    {
+    switch (m_integrator)
+      {
+      case integrator::semi_implicit_euler: _integrate_semi_implicit_euler(dt); break;
+      case integrator::explicit_euler: _integrate_explicit_euler(dt); break;
+      case integrator::rk4: _integrate_rk4(dt); break;
+      case integrator::exponential_map: _integrate_exponential_map(dt); break;
+      }
+
     // reset accumulators
     m_force = jtk::vec3<float>(0, 0, 0);
     m_torque = jtk::vec3<float>(0, 0, 0);
@@ -2,8 +2,8 @@
 
 #include "jtk/vec.h"
 #include "jtk/qbvh.h"
-#include "jtk/mat.h"
 
+#include <type_traits>
 #include <vector>
 
 namespace physics
@@ -14,7 +14,7 @@ namespace physics
   typedef float degrees;
 
   constexpr float g = 9.81f; // gravity of earth,  m/s^2
-  constexpr float rho = 1.225f;   // air density, kg/m^3
+  constexpr float rho = 1.225f;   // air density at sea level, kg/m^3, see atmosphere.h for other altitudes
   constexpr float epsilon = 1e-8f;
 
   // directions in body space
@@ -36,6 +36,78 @@ namespace physics
     return a * a;
     }
 
+  // fixed size 3x3 matrix, row major
+  struct alignas(16) mat3
+    {
+    float m[9];
+
+    constexpr float operator()(int row, int col) const
+      {
+      return m[row * 3 + col];
+      }
+
+    constexpr float& operator()(int row, int col)
+      {
+      return m[row * 3 + col];
+      }
+
+    constexpr bool is_diagonal() const
+      {
+      return m[1] == 0.f && m[2] == 0.f && m[3] == 0.f && m[5] == 0.f && m[6] == 0.f && m[7] == 0.f;
+      }
+
+    // hidden friend, so it does not shadow the quaternion operator in physics.cpp
+    friend constexpr mat3 operator * (const mat3& a, const mat3& b)
+      {
+      mat3 r{};
+      for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+          r(i, j) = a(i, 0) * b(0, j) + a(i, 1) * b(1, j) + a(i, 2) * b(2, j);
+      return r;
+      }
+    };
+
+  static_assert(std::is_trivially_copyable<mat3>::value, "mat3 should be trivially copyable");
+
+  constexpr mat3 make_mat3(float m00, float m01, float m02, float m10, float m11, float m12, float m20, float m21, float m22)
+    {
+    return mat3{ { m00, m01, m02, m10, m11, m12, m20, m21, m22 } };
+    }
+
+  constexpr mat3 diagonal(float x, float y, float z)
+    {
+    return make_mat3(x, 0.f, 0.f, 0.f, y, 0.f, 0.f, 0.f, z);
+    }
+
+  constexpr mat3 identity()
+    {
+    return diagonal(1.f, 1.f, 1.f);
+    }
+
+  constexpr mat3 transpose(const mat3& a)
+    {
+    return make_mat3(a(0, 0), a(1, 0), a(2, 0), a(0, 1), a(1, 1), a(2, 1), a(0, 2), a(1, 2), a(2, 2));
+    }
+
+  constexpr float determinant(const mat3& a)
+    {
+    return a(0, 0) * (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1))
+      - a(0, 1) * (a(1, 0) * a(2, 2) - a(1, 2) * a(2, 0))
+      + a(0, 2) * (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0));
+    }
+
+  // inverse of a non-singular matrix, exact reciprocals for diagonal matrices
+  constexpr mat3 invert(const mat3& a)
+    {
+    if (a.is_diagonal())
+      return diagonal(1.f / a(0, 0), 1.f / a(1, 1), 1.f / a(2, 2));
+    const float d = 1.f / determinant(a);
+    return make_mat3(
+      (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1)) * d, (a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2)) * d, (a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1)) * d,
+      (a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2)) * d, (a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0)) * d, (a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2)) * d,
+      (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0)) * d, (a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1)) * d, (a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0)) * d);
+    }
+
   namespace inertia
     {
 
@@ -49,53 +121,68 @@ namespace physics
 
     jtk::vec3<float> cube(const jtk::vec3<float>& size, float mass);
     jtk::vec3<float> cylinder(float radius, float length, float mass);
-    jtk::matf9 tensor(const jtk::vec3<float>& moment_of_inertia);
+    mat3 tensor(const jtk::vec3<float>& moment_of_inertia);
     element cube_element(const jtk::vec3<float>& position, const jtk::vec3<float>& size, float mass);
 
     // calculate inertia tensor from list of connected masses
-    jtk::matf9 tensor(std::vector<element>& elements, bool precomputed_offset = false);
+    mat3 tensor(std::vector<element>& elements, bool precomputed_offset = false);
 
     } // namespace inertia
 
   namespace utils 
     {
 
-    inline float scale(float input, float in_min, float in_max, float out_min, float out_max)
+    constexpr float scale(float input, float in_min, float in_max, float out_min, float out_max)
       {
       return (input - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
       }
 
-    inline float lerp(float a, float b, float t)
+    constexpr float lerp(float a, float b, float t)
       {
       return a + t * (b - a);
       }
 
     template <typename T>
-    inline T max(T a, T b)
+    constexpr T max(T a, T b)
       {
       return a > b ? a : b;
       }
 
     template <typename T>
-    inline T min(T a, T b)
+    constexpr T min(T a, T b)
       {
       return a < b ? a : b;
       }
 
-    inline float sign(float a)
+    constexpr float sign(float a)
       {
       return a >= 0.f ? 1.f : -1.f;
       }
 
     template <typename T>
-    inline T clamp(T v, T lo, T hi)
+    constexpr T clamp(T v, T lo, T hi)
       {
       return v < lo ? lo : v > hi ? hi : v;
       }
 
     jtk::vec3<float> transform_point(const jtk::float4x4& pose, const jtk::vec3<float>& pt);
     jtk::vec3<float> transform_vector(const jtk::float4x4& pose, const jtk::vec3<float>& v);
-    jtk::vec3<float> transform_vector(const jtk::matf9& pose, const jtk::vec3<float>& v);
+    inline jtk::vec3<float> transform_vector(const mat3& m, const jtk::vec3<float>& v)
+      {
+      return jtk::vec3<float>(
+        m.m[0] * v.x + m.m[1] * v.y + m.m[2] * v.z,
+        m.m[3] * v.x + m.m[4] * v.y + m.m[5] * v.z,
+        m.m[6] * v.x + m.m[7] * v.y + m.m[8] * v.z);
+      }
+
+    // only valid if m.is_diagonal()
+    inline jtk::vec3<float> transform_vector_diagonal(const mat3& m, const jtk::vec3<float>& v)
+      {
+      return jtk::vec3<float>(m.m[0] * v.x, m.m[4] * v.y, m.m[8] * v.z);
+      }
+
+    // rotate vector v by the unit quaternion q
+    jtk::vec3<float> rotate(const jtk::float4& q, const jtk::vec3<float>& v);
 
     } // namespace utils
 
@@ -135,18 +222,28 @@ namespace physics
     } // namespace units
 
 
+  enum class integrator
+    {
+    semi_implicit_euler, // velocities first, then positions and orientation with the new velocities (default)
+    explicit_euler,      // all state advanced with the velocities at the start of the step
+    rk4,                 // classic 4th order Runge-Kutta, forces and torques constant over the step
+    exponential_map      // semi-implicit Euler, orientation advanced with the exact rotation of the new angular velocity
+    };
+
   struct RigidBodyParams 
     {
     RigidBodyParams();
     float mass;
-    jtk::matf9 inertia;
+    mat3 inertia;
     jtk::vec3<float> position;
     jtk::vec3<float> velocity;
     jtk::vec3<float> angular_velocity;
     jtk::float4 orientation;
     bool apply_gravity;
+    integrator method;
     };
 
+  // RigidBody only holds plain data, so it can be copied with memcpy, e.g. for snapshots
   class RigidBody
     {
     public:
@@ -167,7 +264,11 @@ namespace physics
       // transform direction from world space to body space 
       jtk::vec3<float> inverse_transform_direction(const jtk::vec3<float>& direction) const;
 
-      void set_inertia(const jtk::matf9& inertia_tensor);
+      void set_inertia(const mat3& inertia_tensor);
+
+      mat3 get_inertia() const;
+
+      float get_mass() const;
 
       // force vector in world space
       void add_force(const jtk::vec3<float>& force);
@@ -193,14 +294,31 @@ namespace physics
 
       jtk::vec3<float> get_angular_velocity() const;
 
+      jtk::float4 get_orientation() const;
+
       void set_position(const jtk::vec3<float>& pos);
 
       void set_velocity(const jtk::vec3<float>& vel);
 
       void set_angular_velocity(const jtk::vec3<float>& vel);
 
+      void set_orientation(const jtk::float4& orientation);
+
+      void set_integrator(integrator method);
+
+      integrator get_integrator() const;
+
       void update(seconds dt);
 
+    private:
+      jtk::vec3<float> _linear_acceleration() const;
+      jtk::vec3<float> _angular_acceleration(const jtk::vec3<float>& angular_velocity) const;
+
+      void _integrate_semi_implicit_euler(seconds dt);
+      void _integrate_explicit_euler(seconds dt);
+      void _integrate_rk4(seconds dt);
+      void _integrate_exponential_map(seconds dt);
+
     private:
       jtk::vec3<float> m_force;
       jtk::vec3<float> m_torque;
@@ -209,8 +327,10 @@ namespace physics
       jtk::float4 m_orientation;
       jtk::vec3<float> m_velocity;
       jtk::vec3<float> m_angular_velocity;
-      jtk::matf9 m_inertia;
-      jtk::matf9 m_inertia_inverse;
+      mat3 m_inertia;
+      mat3 m_inertia_inverse;
       bool m_apply_gravity;
+      bool m_diagonal_inertia; // products of inertia are zero
+      integrator m_integrator;
     };
   }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "physics_batch.h"
+
+#include <stdexcept>
+
+namespace physics
+  {
+
+  namespace
+    {
+
+    template <class V>
+    void integrate(RigidBodyBatch::Arrays& a, std::size_t i, float dt)
+      {
+      const V h(dt);
+      const V half_h(0.5f * dt);
+
+      // linear motion
+      V inv_m = V::load(&a.inverse_mass[i]);
+      V vx = V::load(&a.velocity[0][i]) + V::load(&a.force[0][i]) * inv_m * h;
+      V vy = V::load(&a.velocity[1][i]) + (V::load(&a.force[1][i]) * inv_m - V::load(&a.gravity[i])) * h;
+      V vz = V::load(&a.velocity[2][i]) + V::load(&a.force[2][i]) * inv_m * h;
+      (V::load(&a.position[0][i]) + vx * h).store(&a.position[0][i]);
+      (V::load(&a.position[1][i]) + vy * h).store(&a.position[1][i]);
+      (V::load(&a.position[2][i]) + vz * h).store(&a.position[2][i]);
+      vx.store(&a.velocity[0][i]);
+      vy.store(&a.velocity[1][i]);
+      vz.store(&a.velocity[2][i]);
+
+      // angular motion: w += I^-1 (T - w x (I w)) dt
+      V wx = V::load(&a.angular_velocity[0][i]);
+      V wy = V::load(&a.angular_velocity[1][i]);
+      V wz = V::load(&a.angular_velocity[2][i]);
+      V Iwx = V::load(&a.inertia[0][i]) * wx + V::load(&a.inertia[1][i]) * wy + V::load(&a.inertia[2][i]) * wz;
+      V Iwy = V::load(&a.inertia[3][i]) * wx + V::load(&a.inertia[4][i]) * wy + V::load(&a.inertia[5][i]) * wz;
+      V Iwz = V::load(&a.inertia[6][i]) * wx + V::load(&a.inertia[7][i]) * wy + V::load(&a.inertia[8][i]) * wz;
+      V mx = V::load(&a.torque[0][i]) - (wy * Iwz - wz * Iwy);
+      V my = V::load(&a.torque[1][i]) - (wz * Iwx - wx * Iwz);
+      V mz = V::load(&a.torque[2][i]) - (wx * Iwy - wy * Iwx);
+      wx = wx + (V::load(&a.inertia_inverse[0][i]) * mx + V::load(&a.inertia_inverse[1][i]) * my + V::load(&a.inertia_inverse[2][i]) * mz) * h;
+      wy = wy + (V::load(&a.inertia_inverse[3][i]) * mx + V::load(&a.inertia_inverse[4][i]) * my + V::load(&a.inertia_inverse[5][i]) * mz) * h;
+      wz = wz + (V::load(&a.inertia_inverse[6][i]) * mx + V::load(&a.inertia_inverse[7][i]) * my + V::load(&a.inertia_inverse[8][i]) * mz) * h;
+      wx.store(&a.angular_velocity[0][i]);
+      wy.store(&a.angular_velocity[1][i]);
+      wz.store(&a.angular_velocity[2][i]);
+
+      // orientation: q += 0.5 dt q * (w, 0), followed by normalization
+      V qx = V::load(&a.orientation[0][i]);
+      V qy = V::load(&a.orientation[1][i]);
+      V qz = V::load(&a.orientation[2][i]);
+      V qw = V::load(&a.orientation[3][i]);
+      V nx = qx + (qw * wx + qy * wz - qz * wy) * half_h;
+      V ny = qy + (qw * wy + qz * wx - qx * wz) * half_h;
+      V nz = qz + (qw * wz + qx * wy - qy * wx) * half_h;
+      V nw = qw - (qx * wx + qy * wy + qz * wz) * half_h;
+      V len = simd::sqrt(nx * nx + ny * ny + nz * nz + nw * nw);
+      (nx / len).store(&a.orientation[0][i]);
+      (ny / len).store(&a.orientation[1][i]);
+      (nz / len).store(&a.orientation[2][i]);
+      (nw / len).store(&a.orientation[3][i]);
+
+      // reset accumulators
+      const V zero(0.f);
+      for (int j = 0; j < 3; ++j)
+        {
+        zero.store(&a.force[j][i]);
+        zero.store(&a.torque[j][i]);
+        }
+      }
+
+    template <class V>
+    std::size_t integrate_range(RigidBodyBatch::Arrays& a, std::size_t begin, std::size_t end, float dt)
+      {
+      std::size_t i = begin;
+      for (; i + V::width <= end; i += V::width)
+        integrate<V>(a, i, dt);
+      return i;
+      }
+
+    } // namespace
+
+  RigidBodyBatch::RigidBodyBatch() : m_size(0)
+    {
+    }
+
+  void RigidBodyBatch::_resize(std::size_t n)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      m_arrays.position[j].resize(n);
+      m_arrays.velocity[j].resize(n);
+      m_arrays.angular_velocity[j].resize(n);
+      m_arrays.force[j].resize(n);
+      m_arrays.torque[j].resize(n);
+      }
+    for (int j = 0; j < 4; ++j)
+      m_arrays.orientation[j].resize(n);
+    m_arrays.inverse_mass.resize(n);
+    m_arrays.gravity.resize(n);
+    for (int j = 0; j < 9; ++j)
+      {
+      m_arrays.inertia[j].resize(n);
+      m_arrays.inertia_inverse[j].resize(n);
+      }
+    m_size = n;
+    }
+
+  void RigidBodyBatch::reserve(std::size_t capacity)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      m_arrays.position[j].reserve(capacity);
+      m_arrays.velocity[j].reserve(capacity);
+      m_arrays.angular_velocity[j].reserve(capacity);
+      m_arrays.force[j].reserve(capacity);
+      m_arrays.torque[j].reserve(capacity);
+      }
+    for (int j = 0; j < 4; ++j)
+      m_arrays.orientation[j].reserve(capacity);
+    m_arrays.inverse_mass.reserve(capacity);
+    m_arrays.gravity.reserve(capacity);
+    for (int j = 0; j < 9; ++j)
+      {
+      m_arrays.inertia[j].reserve(capacity);
+      m_arrays.inertia_inverse[j].reserve(capacity);
+      }
+    }
+
+  void RigidBodyBatch::clear()
+    {
+    _resize(0);
+    }
+
+  std::size_t RigidBodyBatch::add(const RigidBodyParams& params)
+    {
+    if (params.method != integrator::semi_implicit_euler)
+      throw std::runtime_error("RigidBodyBatch only integrates with semi-implicit Euler");
+    const std::size_t i = m_size;
+    _resize(m_size + 1);
+    set_position(i, params.position);
+    set_velocity(i, params.velocity);
+    set_angular_velocity(i, params.angular_velocity);
+    set_orientation(i, params.orientation);
+    for (int j = 0; j < 3; ++j)
+      {
+      m_arrays.force[j][i] = 0.f;
+      m_arrays.torque[j][i] = 0.f;
+      }
+    m_arrays.inverse_mass[i] = 1.f / params.mass;
+    m_arrays.gravity[i] = params.apply_gravity ? g : 0.f;
+    const mat3 inertia_inverse = invert(params.inertia);
+    for (int j = 0; j < 9; ++j)
+      {
+      m_arrays.inertia[j][i] = params.inertia.m[j];
+      m_arrays.inertia_inverse[j][i] = inertia_inverse.m[j];
+      }
+    return i;
+    }
+
+  jtk::vec3<float> RigidBodyBatch::get_point_velocity(std::size_t i, const jtk::vec3<float>& point) const
+    {
+    return inverse_transform_direction(i, get_velocity(i)) + jtk::cross(get_angular_velocity(i), point);
+    }
+
+  void RigidBodyBatch::add_force_at_point(std::size_t i, const jtk::vec3<float>& force, const jtk::vec3<float>& point)
+    {
+    add_relative_force(i, force);
+    add_relative_torque(i, jtk::cross(point, force));
+    }
+
+  jtk::vec3<float> RigidBodyBatch::transform_direction(std::size_t i, const jtk::vec3<float>& direction) const
+    {
+    return utils::rotate(get_orientation(i), direction);
+    }
+
+  jtk::vec3<float> RigidBodyBatch::inverse_transform_direction(std::size_t i, const jtk::vec3<float>& direction) const
+    {
+    return utils::rotate(jtk::quaternion_inverse(get_orientation(i)), direction);
+    }
+
+  void RigidBodyBatch::add_force(std::size_t i, const jtk::vec3<float>& force)
+    {
+    m_arrays.force[0][i] += force.x;
+    m_arrays.force[1][i] += force.y;
+    m_arrays.force[2][i] += force.z;
+    }
+
+  void RigidBodyBatch::add_relative_force(std::size_t i, const jtk::vec3<float>& force)
+    {
+    add_force(i, transform_direction(i, force));
+    }
+
+  void RigidBodyBatch::add_torque(std::size_t i, const jtk::vec3<float>& torque)
+    {
+    add_relative_torque(i, inverse_transform_direction(i, torque));
+    }
+
+  void RigidBodyBatch::add_relative_torque(std::size_t i, const jtk::vec3<float>& torque)
+    {
+    m_arrays.torque[0][i] += torque.x;
+    m_arrays.torque[1][i] += torque.y;
+    m_arrays.torque[2][i] += torque.z;
+    }
+
+  jtk::vec3<float> RigidBodyBatch::get_position(std::size_t i) const
+    {
+    return jtk::vec3<float>(m_arrays.position[0][i], m_arrays.position[1][i], m_arrays.position[2][i]);
+    }
+
+  jtk::vec3<float> RigidBodyBatch::get_velocity(std::size_t i) const
+    {
+    return jtk::vec3<float>(m_arrays.velocity[0][i], m_arrays.velocity[1][i], m_arrays.velocity[2][i]);
+    }
+
+  jtk::vec3<float> RigidBodyBatch::get_angular_velocity(std::size_t i) const
+    {
+    return jtk::vec3<float>(m_arrays.angular_velocity[0][i], m_arrays.angular_velocity[1][i], m_arrays.angular_velocity[2][i]);
+    }
+
+  jtk::float4 RigidBodyBatch::get_orientation(std::size_t i) const
+    {
+    return jtk::float4(m_arrays.orientation[0][i], m_arrays.orientation[1][i], m_arrays.orientation[2][i], m_arrays.orientation[3][i]);
+    }
+
+  void RigidBodyBatch::set_position(std::size_t i, const jtk::vec3<float>& pos)
+    {
+    for (int j = 0; j < 3; ++j)
+      m_arrays.position[j][i] = pos[j];
+    }
+
+  void RigidBodyBatch::set_velocity(std::size_t i, const jtk::vec3<float>& vel)
+    {
+    for (int j = 0; j < 3; ++j)
+      m_arrays.velocity[j][i] = vel[j];
+    }
+
+  void RigidBodyBatch::set_angular_velocity(std::size_t i, const jtk::vec3<float>& vel)
+    {
+    for (int j = 0; j < 3; ++j)
+      m_arrays.angular_velocity[j][i] = vel[j];
+    }
+
+  void RigidBodyBatch::set_orientation(std::size_t i, const jtk::float4& orientation)
+    {
+    for (int j = 0; j < 4; ++j)
+      m_arrays.orientation[j][i] = orientation[j];
+    }
+
+  void RigidBodyBatch::update(seconds dt)
+    {
+    std::size_t i = integrate_range<simd::widest>(m_arrays, 0, m_size, dt);
+    integrate_range<simd::lane1>(m_arrays, i, m_size, dt);
+    }
+
+  void RigidBodyBatch::update_scalar(seconds dt)
+    {
+    integrate_range<simd::lane1>(m_arrays, 0, m_size, dt);
+    }
+
+  } // namespace physics
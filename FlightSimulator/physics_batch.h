@@ -0,0 +1,85 @@
+#pragma once
+
+#include "physics.h"
+#include "simd.h"
+
+namespace physics
+  {
+
+  // Structure-of-arrays container for many rigid bodies.
+  // update() integrates all bodies in one call with the widest SIMD kernel available, using semi-implicit Euler like
+  // RigidBody::update with the default integrator. The other integrators are not supported.
+  class RigidBodyBatch
+    {
+    public:
+      RigidBodyBatch();
+
+      // returns the index of the new body; throws std::runtime_error if params.method is not semi_implicit_euler
+      std::size_t add(const RigidBodyParams& params);
+
+      void reserve(std::size_t capacity);
+      void clear();
+      std::size_t size() const { return m_size; }
+
+      // get velocity of point in body space
+      jtk::vec3<float> get_point_velocity(std::size_t i, const jtk::vec3<float>& point) const;
+
+      // force and point vectors are in body space
+      void add_force_at_point(std::size_t i, const jtk::vec3<float>& force, const jtk::vec3<float>& point);
+
+      // transform direction from body space to world space
+      jtk::vec3<float> transform_direction(std::size_t i, const jtk::vec3<float>& direction) const;
+
+      // transform direction from world space to body space
+      jtk::vec3<float> inverse_transform_direction(std::size_t i, const jtk::vec3<float>& direction) const;
+
+      // force vector in world space
+      void add_force(std::size_t i, const jtk::vec3<float>& force);
+
+      // force vector in body space
+      void add_relative_force(std::size_t i, const jtk::vec3<float>& force);
+
+      // torque vector in world space
+      void add_torque(std::size_t i, const jtk::vec3<float>& torque);
+
+      // torque vector in body space
+      void add_relative_torque(std::size_t i, const jtk::vec3<float>& torque);
+
+      jtk::vec3<float> get_position(std::size_t i) const;
+      jtk::vec3<float> get_velocity(std::size_t i) const;
+      jtk::vec3<float> get_angular_velocity(std::size_t i) const;
+      jtk::float4 get_orientation(std::size_t i) const;
+
+      void set_position(std::size_t i, const jtk::vec3<float>& pos);
+      void set_velocity(std::size_t i, const jtk::vec3<float>& vel);
+      void set_angular_velocity(std::size_t i, const jtk::vec3<float>& vel);
+      void set_orientation(std::size_t i, const jtk::float4& orientation);
+
+      void update(seconds dt);
+
+      // integrate with the scalar kernel only, for validation of the SIMD kernels
+      void update_scalar(seconds dt);
+
+      struct Arrays
+        {
+        simd::aligned_vector<float> position[3];
+        simd::aligned_vector<float> velocity[3];
+        simd::aligned_vector<float> angular_velocity[3];
+        simd::aligned_vector<float> orientation[4]; // x, y, z, w
+        simd::aligned_vector<float> force[3];       // world space
+        simd::aligned_vector<float> torque[3];      // body space
+        simd::aligned_vector<float> inverse_mass;
+        simd::aligned_vector<float> gravity;        // g or 0
+        simd::aligned_vector<float> inertia[9];     // row major
+        simd::aligned_vector<float> inertia_inverse[9];
+        };
+
+    private:
+      void _resize(std::size_t n);
+
+    private:
+      Arrays m_arrays;
+      std::size_t m_size;
+    };
+
+  } // namespace physics
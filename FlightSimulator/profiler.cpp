@@ -0,0 +1,395 @@
+#include "profiler.h"
+#include "material.h"
+
+#include "RenderDoos/render_engine.h"
+#include "RenderDoos/types.h"
+
+#if !defined(RENDERDOOS_METAL)
+#include "glew/GL/glew.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+  {
+  using steady_clock = std::chrono::steady_clock;
+
+  double to_ms(steady_clock::duration d)
+    {
+    return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+  void write_json_string(FILE* f, const std::string& s)
+    {
+    fputc('"', f);
+    for (char c : s)
+      {
+      if (c == '"' || c == '\\')
+        fputc('\\', f);
+      fputc(c, f);
+      }
+    fputc('"', f);
+    }
+  }
+
+profiler::profiler() : m_trace_next(0), m_trace_wrapped(false), m_frame(0), m_gpu_available(false), m_frame_counter(0)
+  {
+  m_epoch = steady_clock::now();
+  m_frame_start = m_epoch;
+  m_scopes.reserve(max_scopes);
+  m_open.reserve(max_scopes);
+  m_trace.resize(max_trace_events);
+  std::fill(m_frame_ms, m_frame_ms + history_size, 0.f);
+  std::memset(m_queries, 0, sizeof(m_queries));
+  for (int i = 0; i < gpu_latency; ++i)
+    {
+    m_query_count[i] = 0;
+    m_query_frame[i] = -1;
+    m_query_start_us[i] = 0.0;
+    }
+  }
+
+profiler::~profiler()
+  {
+  }
+
+void profiler::init(RenderDoos::render_engine* engine)
+  {
+#if !defined(RENDERDOOS_METAL)
+  // timer queries are core since OpenGL 3.3, which is what view asks SDL for
+  if (engine->get_renderer_type() == RenderDoos::renderer_type::OPENGL && glGenQueries && glQueryCounter)
+    {
+    glGenQueries(gpu_latency * 2 * max_scopes, &m_queries[0][0]);
+    m_gpu_available = true;
+    }
+#else
+  (void)engine;
+#endif
+  }
+
+void profiler::destroy()
+  {
+#if !defined(RENDERDOOS_METAL)
+  if (m_gpu_available)
+    glDeleteQueries(gpu_latency * 2 * max_scopes, &m_queries[0][0]);
+#endif
+  m_gpu_available = false;
+  }
+
+double profiler::_us_since_epoch(steady_clock::time_point t) const
+  {
+  return std::chrono::duration<double, std::micro>(t - m_epoch).count();
+  }
+
+int32_t profiler::_find_or_add_scope(const char* name, bool gpu)
+  {
+  for (int32_t i = 0; i < (int32_t)m_scopes.size(); ++i)
+    {
+    if (m_scopes[i].name == name)
+      {
+      m_scopes[i].gpu |= gpu;
+      return i;
+      }
+    }
+  if (m_scopes.size() >= max_scopes)
+    return -1;
+  scope s;
+  s.name = name;
+  std::fill(s.cpu_ms, s.cpu_ms + history_size, 0.f);
+  std::fill(s.gpu_ms, s.gpu_ms + history_size, 0.f);
+  s.cpu_average = s.gpu_average = 0.f;
+  s.gpu = gpu;
+  m_scopes.push_back(s);
+  return (int32_t)m_scopes.size() - 1;
+  }
+
+void profiler::_add_trace_event(int32_t scope, uint32_t thread_id, double start_us, double duration_us)
+  {
+  trace_event& e = m_trace[m_trace_next];
+  e.scope = scope;
+  e.thread_id = thread_id;
+  e.start_us = start_us;
+  e.duration_us = duration_us;
+  if (++m_trace_next == m_trace.size())
+    {
+    m_trace_next = 0;
+    m_trace_wrapped = true;
+    }
+  }
+
+void profiler::_collect_gpu_results()
+  {
+#if !defined(RENDERDOOS_METAL)
+  const int slot = (int)(m_frame_counter % gpu_latency);
+  const int32_t count = m_query_count[slot];
+  const int32_t frame = m_query_frame[slot];
+  m_query_count[slot] = 0;
+  if (!m_gpu_available || count == 0 || frame < 0)
+    return;
+  // gpu_latency frames later the results are normally there, otherwise this waits for them
+  GLuint64 first = 0;
+  for (int32_t q = 0; q < count; ++q)
+    {
+    GLuint64 t0 = 0, t1 = 0;
+    glGetQueryObjectui64v(m_queries[slot][2 * q], GL_QUERY_RESULT, &t0);
+    glGetQueryObjectui64v(m_queries[slot][2 * q + 1], GL_QUERY_RESULT, &t1);
+    if (q == 0)
+      first = t0;
+    const int32_t s = m_query_scope[slot][q];
+    const double duration_us = t1 > t0 ? (double)(t1 - t0) * 1e-3 : 0.0;
+    m_scopes[s].gpu_ms[frame] += (float)(duration_us * 1e-3);
+    _add_trace_event(s, gpu_thread, m_query_start_us[slot] + (double)(t0 - first) * 1e-3, duration_us);
+    }
+#endif
+  }
+
+void profiler::frame_begin()
+  {
+  _collect_gpu_results();
+  const int slot = (int)(m_frame_counter % gpu_latency);
+  m_query_frame[slot] = m_frame;
+  for (auto& s : m_scopes)
+    {
+    s.cpu_ms[m_frame] = 0.f;
+    s.gpu_ms[m_frame] = 0.f;
+    }
+  m_open.clear();
+  m_frame_start = steady_clock::now();
+  }
+
+void profiler::frame_end()
+  {
+  m_frame_ms[m_frame] = (float)to_ms(steady_clock::now() - m_frame_start);
+  for (auto& s : m_scopes)
+    {
+    float cpu = 0.f, gpu = 0.f;
+    for (int i = 0; i < history_size; ++i)
+      {
+      cpu += s.cpu_ms[i];
+      gpu += s.gpu_ms[i];
+      }
+    s.cpu_average = cpu / history_size;
+    s.gpu_average = gpu / history_size;
+    }
+  m_frame = (m_frame + 1) % history_size;
+  ++m_frame_counter;
+  }
+
+int32_t profiler::begin(const char* name, bool gpu)
+  {
+  open_scope o;
+  o.scope = _find_or_add_scope(name, gpu);
+  o.query = -1;
+  if (o.scope < 0)
+    return -1;
+  o.start = steady_clock::now();
+#if !defined(RENDERDOOS_METAL)
+  const int slot = (int)(m_frame_counter % gpu_latency);
+  if (gpu && m_gpu_available && m_query_count[slot] < max_scopes)
+    {
+    o.query = m_query_count[slot]++;
+    if (o.query == 0)
+      m_query_start_us[slot] = _us_since_epoch(o.start);
+    m_query_scope[slot][o.query] = o.scope;
+    glQueryCounter(m_queries[slot][2 * o.query], GL_TIMESTAMP);
+    }
+#endif
+  m_open.push_back(o);
+  return (int32_t)m_open.size() - 1;
+  }
+
+void profiler::end(int32_t handle)
+  {
+  if (handle < 0 || handle >= (int32_t)m_open.size())
+    return;
+  const open_scope& o = m_open[handle];
+  const auto now = steady_clock::now();
+#if !defined(RENDERDOOS_METAL)
+  if (o.query >= 0)
+    glQueryCounter(m_queries[m_frame_counter % gpu_latency][2 * o.query + 1], GL_TIMESTAMP);
+#endif
+  const double ms = to_ms(now - o.start);
+  m_scopes[o.scope].cpu_ms[m_frame] += (float)ms;
+  _add_trace_event(o.scope, render_thread, _us_since_epoch(o.start), ms * 1e3);
+  }
+
+void profiler::record(const char* name, steady_clock::time_point start, double duration_ms, uint32_t thread_id)
+  {
+  const int32_t s = _find_or_add_scope(name, false);
+  if (s < 0)
+    return;
+  m_scopes[s].cpu_ms[m_frame] += (float)duration_ms;
+  _add_trace_event(s, thread_id, _us_since_epoch(start), duration_ms * 1e3);
+  }
+
+float profiler::get_gpu_frame_ms() const
+  {
+  if (!m_gpu_available || m_frame_counter <= gpu_latency)
+    return 0.f;
+  const int frame = (get_last_frame() + history_size - gpu_latency) % history_size;
+  float ms = 0.f;
+  for (const auto& s : m_scopes)
+    ms += s.gpu_ms[frame];
+  return ms;
+  }
+
+bool profiler::write_chrome_trace(const char* filename) const
+  {
+  FILE* f = fopen(filename, "w");
+  if (!f)
+    return false;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  const char* thread_names[] = { "render", "simulation", "gpu" };
+  for (int t = 0; t < 3; ++t)
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", t, thread_names[t]);
+  // oldest event first
+  const std::size_t count = m_trace_wrapped ? m_trace.size() : m_trace_next;
+  const std::size_t first = m_trace_wrapped ? m_trace_next : 0;
+  for (std::size_t i = 0; i < count; ++i)
+    {
+    const trace_event& e = m_trace[(first + i) % m_trace.size()];
+    fprintf(f, "{\"name\":");
+    write_json_string(f, m_scopes[e.scope].name);
+    fprintf(f, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n", e.thread_id, e.start_us, e.duration_us, i + 1 < count ? "," : "");
+    }
+  fprintf(f, "]}\n");
+  return fclose(f) == 0;
+  }
+
+profiler_overlay::profiler_overlay() : m_geometry_id(-1), m_palette_texture_id(-1)
+  {
+  }
+
+uint32_t profiler_overlay::get_color(int i)
+  {
+  static const uint32_t palette[7] = { 0xff4c4ce6, 0xff4cb4e6, 0xff4ce64c, 0xffe6b44c, 0xffe64c4c, 0xffe64cb4, 0xffb4b4b4 };
+  return palette[i % 7];
+  }
+
+namespace
+  {
+  // texel 0 is the background, texel 1 + i holds color i of the palette
+  enum { palette_size = 8 };
+
+  float palette_u(int texel)
+    {
+    return ((float)texel + 0.5f) / (float)palette_size;
+    }
+
+  void set_quad(RenderDoos::vertex_standard* vp, float x0, float y0, float x1, float y1, float u)
+    {
+    const float x[4] = { x0, x1, x1, x0 };
+    const float y[4] = { y0, y0, y1, y1 };
+    for (int i = 0; i < 4; ++i)
+      {
+      vp[i].x = x[i];
+      vp[i].y = y[i];
+      vp[i].z = 0.f;
+      vp[i].nx = 0.f;
+      vp[i].ny = 0.f;
+      vp[i].nz = 1.f;
+      vp[i].u = u;
+      vp[i].v = 0.5f;
+      }
+    }
+  }
+
+void profiler_overlay::init(RenderDoos::render_engine* engine)
+  {
+  uint32_t palette[palette_size];
+  palette[0] = 0xa0000000;
+  for (int i = 1; i < palette_size; ++i)
+    palette[i] = get_color(i - 1);
+  m_palette_texture_id = engine->add_texture(palette_size, 1, RenderDoos::texture_format_rgba8, (const uint8_t*)palette);
+  m_geometry_id = engine->add_geometry(VERTEX_STANDARD);
+  }
+
+void profiler_overlay::destroy(RenderDoos::render_engine* engine)
+  {
+  if (m_geometry_id >= 0)
+    engine->remove_geometry(m_geometry_id);
+  if (m_palette_texture_id >= 0)
+    engine->remove_texture(m_palette_texture_id);
+  m_geometry_id = -1;
+  m_palette_texture_id = -1;
+  }
+
+void profiler_overlay::update(RenderDoos::render_engine* engine, const profiler& p, float x, float y, float w, float h, float ms_full_scale)
+  {
+  // a background quad and two stacked bars, cpu left and gpu right, per frame and scope. The geometry always has this
+  // capacity, unused quads collapse to a point, so that the buffers are never reallocated.
+  const int quads = 1 + 2 * profiler::history_size * profiler::max_scopes;
+  RenderDoos::vertex_standard* vp;
+  uint32_t* ip;
+  engine->geometry_begin(m_geometry_id, quads * 4, quads * 6, (float**)&vp, (void**)&ip);
+  for (int q = 0; q < quads; ++q)
+    {
+    const uint32_t v = (uint32_t)q * 4;
+    uint32_t* i = ip + q * 6;
+    i[0] = v;
+    i[1] = v + 1;
+    i[2] = v + 2;
+    i[3] = v;
+    i[4] = v + 2;
+    i[5] = v + 3;
+    }
+  std::memset(vp, 0, sizeof(RenderDoos::vertex_standard) * quads * 4);
+
+  set_quad(vp, x, y, x + w, y + h, palette_u(0));
+  vp += 4;
+
+  const auto& scopes = p.get_scopes();
+  const float column = w / (float)profiler::history_size;
+  const float bar = p.has_gpu_timer() ? column * 0.5f : column;
+  const float scale = h / ms_full_scale;
+  // oldest frame on the left
+  const int newest = p.get_last_frame();
+  for (int c = 0; c < profiler::history_size; ++c)
+    {
+    const int frame = (newest + 1 + c) % profiler::history_size;
+    const float x0 = x + c * column;
+    float cpu_y = y, gpu_y = y;
+    for (std::size_t s = 0; s < scopes.size(); ++s)
+      {
+      const float u = palette_u(1 + (int)s % (palette_size - 1));
+      const float cpu_top = std::min(cpu_y + scopes[s].cpu_ms[frame] * scale, y + h);
+      set_quad(vp, x0, cpu_y, x0 + bar, cpu_top, u);
+      cpu_y = cpu_top;
+      vp += 4;
+      if (p.has_gpu_timer() && scopes[s].gpu)
+        {
+        const float gpu_top = std::min(gpu_y + scopes[s].gpu_ms[frame] * scale, y + h);
+        set_quad(vp, x0 + bar, gpu_y, x0 + column, gpu_top, u);
+        gpu_y = gpu_top;
+        }
+      vp += 4;
+      }
+    vp += 8 * (profiler::max_scopes - scopes.size());
+    }
+  engine->geometry_end(m_geometry_id);
+  }
+
+void profiler_overlay::draw(RenderDoos::render_engine* engine, sprite_material& mat, float* projection)
+  {
+  float identity[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+  mat.set_sprite(m_palette_texture_id, TEX_WRAP_REPEAT | TEX_FILTER_NEAREST);
+  mat.bind(engine, projection, identity, nullptr);
+  engine->geometry_draw(m_geometry_id);
+  }
+
+float profiler_overlay::add_text(font_material& fmat, const profiler& p, float x, float y, float sx, float sy) const
+  {
+  y = fmat.add_textf(x, y, sx, sy, 0xffffffff, "frame: %.2fms", p.get_frame_ms(p.get_last_frame()));
+  const auto& scopes = p.get_scopes();
+  for (std::size_t i = 0; i < scopes.size(); ++i)
+    {
+    const auto& s = scopes[i];
+    if (p.has_gpu_timer() && s.gpu)
+      y = fmat.add_textf(x, y, sx, sy, get_color((int)i), "%s: %.2fms gpu %.2fms", s.name.c_str(), s.cpu_average, s.gpu_average);
+    else
+      y = fmat.add_textf(x, y, sx, sy, get_color((int)i), "%s: %.2fms", s.name.c_str(), s.cpu_average);
+    }
+  return y;
+  }
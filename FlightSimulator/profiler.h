@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace RenderDoos
+  {
+  class render_engine;
+  }
+
+class font_material;
+class sprite_material;
+
+// Frame profiler. Named scopes record their CPU time, and optionally their GPU time via timestamp queries
+// (OpenGL only, Metal has no timestamp queries in RenderDoos), into a ring buffer with the last history_size
+// frames. All events are also kept for a Chrome trace dump (chrome://tracing or ui.perfetto.dev).
+//
+// All calls come from the render thread. Time measured on other threads, like the physics steps on the
+// simulation thread, is handed over by the render thread with record.
+class profiler
+  {
+  public:
+    enum { history_size = 128, max_scopes = 16, max_trace_events = 65536, gpu_latency = 3 };
+
+    // track ids in the Chrome trace
+    enum { render_thread = 0, simulation_thread = 1, gpu_thread = 2 };
+
+    struct scope
+      {
+      std::string name;
+      float cpu_ms[history_size];
+      float gpu_ms[history_size];
+      float cpu_average, gpu_average; // over the whole history
+      bool gpu;
+      };
+
+    profiler();
+    ~profiler();
+
+    // creates the timestamp queries, if the backend supports them
+    void init(RenderDoos::render_engine* engine);
+    void destroy();
+
+    void frame_begin();
+    void frame_end();
+
+    // returns a handle for end. Scopes with the same name share their history.
+    int32_t begin(const char* name, bool gpu = false);
+    void end(int32_t handle);
+
+    // time measured elsewhere, e.g. on the simulation thread. Adds up with other records of the same scope in this frame.
+    void record(const char* name, std::chrono::steady_clock::time_point start, double duration_ms, uint32_t thread_id);
+
+    const std::vector<scope>& get_scopes() const { return m_scopes; }
+    bool has_gpu_timer() const { return m_gpu_available; }
+
+    // index in the history of the last finished frame
+    int get_last_frame() const { return (m_frame + history_size - 1) % history_size; }
+    float get_frame_ms(int frame) const { return m_frame_ms[frame]; }
+
+    // summed gpu time of the most recent frame whose timestamps have been read back, 0 without gpu timer
+    float get_gpu_frame_ms() const;
+
+    bool write_chrome_trace(const char* filename) const;
+
+  private:
+    struct trace_event
+      {
+      int32_t scope;
+      uint32_t thread_id;
+      double start_us, duration_us;
+      };
+
+    struct open_scope
+      {
+      int32_t scope;
+      std::chrono::steady_clock::time_point start;
+      int32_t query; // index of the begin query in the current frame's query set, or -1
+      };
+
+    int32_t _find_or_add_scope(const char* name, bool gpu);
+    void _add_trace_event(int32_t scope, uint32_t thread_id, double start_us, double duration_us);
+    void _collect_gpu_results();
+    double _us_since_epoch(std::chrono::steady_clock::time_point t) const;
+
+  private:
+    std::vector<scope> m_scopes;
+    std::vector<open_scope> m_open;
+    std::vector<trace_event> m_trace; // ring buffer
+    std::size_t m_trace_next;
+    bool m_trace_wrapped;
+    std::chrono::steady_clock::time_point m_epoch;
+    std::chrono::steady_clock::time_point m_frame_start;
+    float m_frame_ms[history_size];
+    int m_frame;
+
+    // gpu timestamp queries, a set of 2 * max_scopes queries per frame, read back gpu_latency frames later
+    bool m_gpu_available;
+    uint32_t m_queries[gpu_latency][2 * max_scopes];
+    int32_t m_query_scope[gpu_latency][max_scopes];
+    int32_t m_query_count[gpu_latency];
+    int32_t m_query_frame[gpu_latency]; // history index the query set belongs to
+    double m_query_start_us[gpu_latency]; // cpu time of the first query of the set, anchors the gpu track in the trace
+    uint64_t m_frame_counter;
+  };
+
+// times the enclosing block
+class profile_scope
+  {
+  public:
+    profile_scope(profiler& p, const char* name, bool gpu = false) : m_profiler(p), m_handle(p.begin(name, gpu)) {}
+    ~profile_scope() { m_profiler.end(m_handle); }
+
+    profile_scope(const profile_scope&) = delete;
+    profile_scope& operator = (const profile_scope&) = delete;
+
+  private:
+    profiler& m_profiler;
+    int32_t m_handle;
+  };
+
+// Bar graph of the scope times of the last frames, stacked per frame, in one geometry drawn with sprite_material.
+class profiler_overlay
+  {
+  public:
+    profiler_overlay();
+
+    void init(RenderDoos::render_engine* engine);
+    void destroy(RenderDoos::render_engine* engine);
+
+    // x, y, w, h in normalized device coordinates, ms_full_scale is the frame time that fills the height
+    void update(RenderDoos::render_engine* engine, const profiler& p, float x, float y, float w, float h, float ms_full_scale);
+    void draw(RenderDoos::render_engine* engine, sprite_material& mat, float* projection);
+
+    // adds one line per scope with its average cpu and gpu time to the text batch of fmat, in the color of its bars.
+    // Returns the y coordinate below the last line.
+    float add_text(font_material& fmat, const profiler& p, float x, float y, float sx, float sy) const;
+
+    // palette color of scope i as 0xAABBGGRR
+    static uint32_t get_color(int i);
+
+  private:
+    int32_t m_geometry_id;
+    int32_t m_palette_texture_id;
+  };
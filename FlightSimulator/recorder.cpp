@@ -0,0 +1,339 @@
+#include "recorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+  {
+  constexpr char file_magic[4] = { 'F', 'S', 'R', 'P' };
+  constexpr char chunk_magic[4] = { 'C', 'H', 'N', 'K' };
+  constexpr uint32_t version = 2;
+  // longer names are surely not a type name but a broken file
+  constexpr uint32_t max_type_name_size = 4096;
+  constexpr uint64_t no_change = std::numeric_limits<uint64_t>::max();
+
+  struct FileHeader
+    {
+    char magic[4];
+    uint32_t version;
+    float step;
+    uint32_t chunk_steps;
+    uint32_t type_name_size; // the name follows the header, 0 in version 1
+    uint32_t reserved[3];
+    };
+
+  struct ChunkHeader
+    {
+    char magic[4];
+    uint32_t step_count;
+    uint64_t first_step;
+    uint32_t payload_size;
+    uint32_t reserved;
+    FlightKeyframe keyframe;
+    };
+
+  static_assert(sizeof(FlightKeyframe) == 72, "keyframes are stored as they are laid out in memory");
+  static_assert(sizeof(FileHeader) == 32 && sizeof(ChunkHeader) == 96, "headers are stored as they are laid out in memory");
+
+  void put_varint(std::vector<uint8_t>& out, uint64_t value)
+    {
+    while (value >= 0x80)
+      {
+      out.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+      }
+    out.push_back(static_cast<uint8_t>(value));
+    }
+
+  // returns false if the varint does not end before end
+  bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+    {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+      {
+      const uint8_t byte = *p++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        return true;
+      }
+    return false;
+    }
+
+  void get_controls(const AircraftState& state, float* controls)
+    {
+    controls[0] = state.joystick.x;
+    controls[1] = state.joystick.y;
+    controls[2] = state.joystick.z;
+    controls[3] = state.throttle;
+    }
+
+  void set_controls(AircraftState& state, const float* controls)
+    {
+    state.joystick = jtk::vec3<float>(controls[0], controls[1], controls[2]);
+    state.throttle = controls[3];
+    }
+  }
+
+FlightKeyframe::FlightKeyframe()
+  {
+  memset(this, 0, sizeof(FlightKeyframe));
+  orientation[3] = 1.f;
+  }
+
+FlightKeyframe::FlightKeyframe(const AircraftState& state)
+  {
+  const jtk::vec3<float>& p = state.position;
+  const jtk::float4& q = state.orientation;
+  const jtk::vec3<float>& v = state.velocity;
+  const jtk::vec3<float>& w = state.angular_velocity;
+  position[0] = p.x; position[1] = p.y; position[2] = p.z;
+  orientation[0] = q[0]; orientation[1] = q[1]; orientation[2] = q[2]; orientation[3] = q[3];
+  velocity[0] = v.x; velocity[1] = v.y; velocity[2] = v.z;
+  angular_velocity[0] = w.x; angular_velocity[1] = w.y; angular_velocity[2] = w.z;
+  joystick[0] = state.joystick.x; joystick[1] = state.joystick.y; joystick[2] = state.joystick.z;
+  throttle = state.throttle;
+  crashed = state.is_crashed() ? 1 : 0;
+  }
+
+void FlightKeyframe::restore(AircraftState& state) const
+  {
+  state.position = jtk::vec3<float>(position[0], position[1], position[2]);
+  state.orientation = jtk::float4(orientation[0], orientation[1], orientation[2], orientation[3]);
+  state.velocity = jtk::vec3<float>(velocity[0], velocity[1], velocity[2]);
+  state.angular_velocity = jtk::vec3<float>(angular_velocity[0], angular_velocity[1], angular_velocity[2]);
+  state.joystick = jtk::vec3<float>(joystick[0], joystick[1], joystick[2]);
+  state.throttle = throttle;
+  // the gear finds out again in the next step whether it touches the ground
+  state.flags = crashed ? static_cast<uint32_t>(gear_crashed) : 0u;
+  }
+
+FlightRecorder::FlightRecorder() : m_file(nullptr), m_chunk_steps(4096), m_step(0), m_chunk_first_step(0), m_last_change_step(0)
+  {
+  memset(m_controls, 0, sizeof(m_controls));
+  }
+
+FlightRecorder::~FlightRecorder()
+  {
+  close();
+  }
+
+bool FlightRecorder::open(const std::string& filename, physics::seconds step, const std::string& aircraft_type, uint32_t chunk_steps)
+  {
+  close();
+  m_file = fopen(filename.c_str(), "wb");
+  if (!m_file)
+    return false;
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, file_magic, sizeof(file_magic));
+  header.version = version;
+  header.step = step;
+  header.chunk_steps = std::max<uint32_t>(1, chunk_steps);
+  header.type_name_size = static_cast<uint32_t>(std::min<std::size_t>(aircraft_type.size(), max_type_name_size));
+  fwrite(&header, sizeof(header), 1, m_file);
+  fwrite(aircraft_type.data(), 1, header.type_name_size, m_file);
+  m_chunk_steps = header.chunk_steps;
+  m_step = 0;
+  m_chunk_first_step = 0;
+  m_payload.clear();
+  return true;
+  }
+
+void FlightRecorder::close()
+  {
+  if (!m_file)
+    return;
+  _write_chunk();
+  fclose(m_file);
+  m_file = nullptr;
+  }
+
+void FlightRecorder::record(const AircraftState& state)
+  {
+  if (!m_file)
+    return;
+  if (m_step - m_chunk_first_step == m_chunk_steps)
+    _write_chunk();
+
+  float controls[4];
+  get_controls(state, controls);
+  if (m_step == m_chunk_first_step)
+    {
+    m_keyframe = FlightKeyframe(state);
+    m_last_change_step = m_step;
+    }
+  else
+    {
+    // bit patterns are compared, so that the replay gets exactly the same floats
+    uint8_t mask = 0;
+    for (int i = 0; i < 4; ++i)
+      {
+      if (memcmp(&controls[i], &m_controls[i], sizeof(float)) != 0)
+        mask |= static_cast<uint8_t>(1 << i);
+      }
+    if (mask)
+      {
+      put_varint(m_payload, m_step - m_last_change_step);
+      m_payload.push_back(mask);
+      for (int i = 0; i < 4; ++i)
+        {
+        if (mask & (1 << i))
+          {
+          const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&controls[i]);
+          m_payload.insert(m_payload.end(), bytes, bytes + sizeof(float));
+          }
+        }
+      m_last_change_step = m_step;
+      }
+    }
+  memcpy(m_controls, controls, sizeof(controls));
+  ++m_step;
+  }
+
+void FlightRecorder::_write_chunk()
+  {
+  if (m_step == m_chunk_first_step)
+    return;
+  ChunkHeader header{};
+  memcpy(header.magic, chunk_magic, sizeof(chunk_magic));
+  header.step_count = static_cast<uint32_t>(m_step - m_chunk_first_step);
+  header.first_step = m_chunk_first_step;
+  header.payload_size = static_cast<uint32_t>(m_payload.size());
+  header.keyframe = m_keyframe;
+  fwrite(&header, sizeof(header), 1, m_file);
+  if (!m_payload.empty())
+    fwrite(m_payload.data(), 1, m_payload.size(), m_file);
+  // a recording that is cut off keeps all complete chunks
+  fflush(m_file);
+  m_payload.clear();
+  m_chunk_first_step = m_step;
+  }
+
+FlightReplay::FlightReplay() : m_step_size(0.f), m_steps(0), m_position(0), m_chunk(std::numeric_limits<std::size_t>::max()),
+  m_read(nullptr), m_next_change_step(no_change), m_next_change_mask(0), m_max_divergence(0.f)
+  {
+  memset(m_next_change, 0, sizeof(m_next_change));
+  memset(m_controls, 0, sizeof(m_controls));
+  }
+
+bool FlightReplay::open(const std::string& filename)
+  {
+  m_chunks.clear();
+  m_steps = 0;
+  m_position = 0;
+  m_chunk = std::numeric_limits<std::size_t>::max();
+  m_max_divergence = 0.f;
+  if (!m_file.open(filename) || m_file.size() < sizeof(FileHeader))
+    return false;
+  FileHeader header;
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (memcmp(header.magic, file_magic, sizeof(file_magic)) != 0 || header.version < 1 || header.version > version || !(header.step > 0.f))
+    return false;
+  m_step_size = header.step;
+  const uint32_t type_name_size = header.version >= 2 ? header.type_name_size : 0;
+  if (type_name_size > max_type_name_size || sizeof(FileHeader) + type_name_size > m_file.size())
+    return false;
+  m_aircraft_type.assign(reinterpret_cast<const char*>(m_file.data()) + sizeof(FileHeader), type_name_size);
+
+  // the chunk headers form the index, stepping over the payloads
+  std::size_t offset = sizeof(FileHeader) + type_name_size;
+  while (offset + sizeof(ChunkHeader) <= m_file.size())
+    {
+    ChunkHeader chunk_header;
+    memcpy(&chunk_header, m_file.data() + offset, sizeof(chunk_header));
+    const std::size_t end = offset + sizeof(ChunkHeader) + chunk_header.payload_size;
+    if (memcmp(chunk_header.magic, chunk_magic, sizeof(chunk_magic)) != 0 || end > m_file.size() ||
+      chunk_header.step_count == 0 || chunk_header.first_step != m_steps)
+      break;
+    Chunk chunk;
+    chunk.first_step = chunk_header.first_step;
+    chunk.step_count = chunk_header.step_count;
+    chunk.keyframe = chunk_header.keyframe;
+    chunk.payload = m_file.data() + offset + sizeof(ChunkHeader);
+    chunk.payload_end = m_file.data() + end;
+    m_chunks.push_back(chunk);
+    m_steps += chunk.step_count;
+    offset = end;
+    }
+  return !m_chunks.empty();
+  }
+
+void FlightReplay::seek(Aircraft& aircraft, uint64_t step, const TerrainField* terrain)
+  {
+  if (m_chunks.empty())
+    return;
+  step = std::min(step, m_steps);
+  // last chunk that starts at or before step
+  auto it = std::upper_bound(m_chunks.begin(), m_chunks.end(), step, [](uint64_t s, const Chunk& c) { return s < c.first_step; });
+  _enter_chunk(aircraft, static_cast<std::size_t>(it - m_chunks.begin()) - 1);
+  while (m_position < step)
+    advance(aircraft, terrain);
+  }
+
+bool FlightReplay::advance(Aircraft& aircraft, const TerrainField* terrain)
+  {
+  if (m_position >= m_steps)
+    return false;
+  if (m_chunk == std::numeric_limits<std::size_t>::max())
+    _enter_chunk(aircraft, 0);
+  else if (m_chunk + 1 < m_chunks.size() && m_position == m_chunks[m_chunk + 1].first_step)
+    {
+    const float* p = m_chunks[m_chunk + 1].keyframe.position;
+    const float divergence = jtk::length(aircraft.state.position - jtk::vec3<float>(p[0], p[1], p[2]));
+    m_max_divergence = physics::utils::max(m_max_divergence, divergence);
+    _enter_chunk(aircraft, m_chunk + 1);
+    }
+
+  if (m_position == m_next_change_step)
+    {
+    for (int i = 0; i < 4; ++i)
+      {
+      if (m_next_change_mask & (1 << i))
+        m_controls[i] = m_next_change[i];
+      }
+    _read_change();
+    }
+  set_controls(aircraft.state, m_controls);
+  aircraft.update(m_step_size, terrain);
+  ++m_position;
+  return true;
+  }
+
+void FlightReplay::_enter_chunk(Aircraft& aircraft, std::size_t chunk)
+  {
+  const Chunk& c = m_chunks[chunk];
+  m_chunk = chunk;
+  m_position = c.first_step;
+  c.keyframe.restore(aircraft.state);
+  get_controls(aircraft.state, m_controls);
+  m_read = c.payload;
+  m_next_change_step = c.first_step;
+  _read_change();
+  }
+
+void FlightReplay::_read_change()
+  {
+  const uint8_t* end = m_chunks[m_chunk].payload_end;
+  uint64_t delta;
+  if (m_read >= end || !get_varint(m_read, end, delta) || m_read >= end)
+    {
+    m_next_change_step = no_change;
+    return;
+    }
+  m_next_change_mask = *m_read++;
+  for (int i = 0; i < 4; ++i)
+    {
+    if (m_next_change_mask & (1 << i))
+      {
+      if (end - m_read < (std::ptrdiff_t)sizeof(float))
+        {
+        m_next_change_step = no_change;
+        return;
+        }
+      memcpy(&m_next_change[i], m_read, sizeof(float));
+      m_read += sizeof(float);
+      }
+    }
+  m_next_change_step += delta;
+  }
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "flightmodel.h"
+#include "mapped_file.h"
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Flight recordings: the control inputs of every physics step and a keyframe of the aircraft state every chunk_steps
+// steps. Replaying the inputs with the same step reproduces the flight; the keyframes make seeking cost at most one
+// chunk of physics steps, and bound the drift when the replaying binary does not compute bit-identical results.
+//
+// File layout, little endian:
+//   header  "FSRP", version, step (float seconds), chunk_steps, length of the aircraft type name, the name
+//   chunks  "CHNK", step count, first step, payload size, keyframe, payload
+// The payload holds only the changes of the controls: per change the number of steps since the previous change (or
+// the start of the chunk) as a varint, a bit mask of the changed channels (pitch, yaw, roll, throttle), and the new
+// values as raw floats. A chunk is written when it is complete, so a recording that was cut off loses at most the
+// last chunk. The replay has to fly the aircraft type the recording was made with, or the flight diverges; version 1
+// files do not name their type.
+
+// aircraft state at the start of a chunk
+struct FlightKeyframe
+  {
+  float position[3];
+  float orientation[4];
+  float velocity[3];
+  float angular_velocity[3];
+  float joystick[3];
+  float throttle;
+  uint32_t crashed;
+
+  FlightKeyframe();
+  FlightKeyframe(const AircraftState& state);
+
+  void restore(AircraftState& state) const;
+  };
+
+class FlightRecorder
+  {
+  public:
+    FlightRecorder();
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator = (const FlightRecorder&) = delete;
+
+    // returns false if the file cannot be created
+    // aircraft_type is the name of the AircraftType that is flown
+    bool open(const std::string& filename, physics::seconds step, const std::string& aircraft_type, uint32_t chunk_steps = 4096);
+    // writes the last, partial chunk
+    void close();
+    bool is_open() const { return m_file != nullptr; }
+
+    // call right before every physics step, with the controls of that step already applied to the aircraft
+    void record(const AircraftState& state);
+
+    uint64_t get_steps() const { return m_step; }
+
+  private:
+    void _write_chunk();
+
+  private:
+    FILE* m_file;
+    uint32_t m_chunk_steps;
+    uint64_t m_step;             // steps recorded so far
+    uint64_t m_chunk_first_step;
+    uint64_t m_last_change_step;
+    FlightKeyframe m_keyframe;
+    float m_controls[4];         // pitch, yaw, roll, throttle of the last recorded step
+    std::vector<uint8_t> m_payload;
+  };
+
+class FlightReplay
+  {
+  public:
+    FlightReplay();
+
+    // returns false if the file is not a recording; a cut off last chunk is ignored
+    bool open(const std::string& filename);
+
+    physics::seconds get_step() const { return m_step_size; }
+    // name of the AircraftType the recording was made with, empty if the file does not say
+    const std::string& get_aircraft_type() const { return m_aircraft_type; }
+    // number of recorded steps
+    uint64_t get_steps() const { return m_steps; }
+    physics::seconds get_duration() const { return static_cast<float>(m_steps) * m_step_size; }
+
+    // the step advance() computes next
+    uint64_t get_position() const { return m_position; }
+
+    // Brings the aircraft to its recorded state at step: restores the keyframe of the chunk and replays the controls
+    // up to step.
+    void seek(Aircraft& aircraft, uint64_t step, const TerrainField* terrain = nullptr);
+
+    // Steps the aircraft once with the recorded controls. At a chunk boundary the aircraft is first set to the
+    // keyframe. Returns false at the end of the recording.
+    bool advance(Aircraft& aircraft, const TerrainField* terrain = nullptr);
+
+    // largest distance, in m, between the replayed position and a keyframe that advance() passed
+    float get_max_divergence() const { return m_max_divergence; }
+
+  private:
+    struct Chunk
+      {
+      uint64_t first_step;
+      uint32_t step_count;
+      FlightKeyframe keyframe;
+      const uint8_t* payload;
+      const uint8_t* payload_end;
+      };
+
+    void _enter_chunk(Aircraft& aircraft, std::size_t chunk);
+    void _read_change();
+
+  private:
+    mapped_file m_file;
+    std::vector<Chunk> m_chunks;
+    physics::seconds m_step_size;
+    std::string m_aircraft_type;
+    uint64_t m_steps;
+    uint64_t m_position;
+    std::size_t m_chunk;
+    const uint8_t* m_read;
+    uint64_t m_next_change_step; // UINT64_MAX when the chunk has no more changes
+    uint8_t m_next_change_mask;
+    float m_next_change[4];
+    float m_controls[4];
+    float m_max_divergence;
+  };
@@ -0,0 +1,50 @@
+#include "render_scale.h"
+
+#include <cmath>
+
+namespace
+  {
+  const float scale_step = 1.f / 16.f;
+  const int cooldown_frames = 30;
+  const float average_weight = 0.1f;
+  // scale up only below this fraction of the budget, so the scale does not flip back and forth
+  const float headroom = 0.8f;
+  // at most this factor up per change, going down may be as fast as needed
+  const float max_increase = 1.25f;
+  }
+
+render_scale_controller::render_scale_controller(float budget_ms, float initial_scale, float min_scale, float max_scale) :
+  m_budget_ms(budget_ms), m_min_scale(min_scale), m_max_scale(max_scale), m_scale(initial_scale), m_average_ms(-1.f), m_cooldown(0)
+  {
+  }
+
+bool render_scale_controller::update(float frame_ms)
+  {
+  if (m_cooldown > 0)
+    {
+    --m_cooldown;
+    return false;
+    }
+  if (frame_ms <= 0.f)
+    return false;
+  if (m_average_ms < 0.f)
+    m_average_ms = frame_ms;
+  else
+    m_average_ms += (frame_ms - m_average_ms) * average_weight;
+
+  float scale = m_scale;
+  if (m_average_ms > m_budget_ms)
+    scale = std::floor(m_scale * std::sqrt(m_budget_ms / m_average_ms) / scale_step) * scale_step;
+  else if (m_average_ms < m_budget_ms * headroom)
+    {
+    const float factor = std::fmin(std::sqrt(m_budget_ms * headroom / m_average_ms), max_increase);
+    scale = std::round(m_scale * factor / scale_step) * scale_step;
+    }
+  scale = std::fmin(std::fmax(scale, m_min_scale), m_max_scale);
+  if (scale == m_scale)
+    return false;
+  m_scale = scale;
+  m_average_ms = -1.f;
+  m_cooldown = cooldown_frames;
+  return true;
+  }
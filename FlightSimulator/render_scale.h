@@ -0,0 +1,24 @@
+#pragma once
+
+// Picks the resolution scale of the terrain raymarch from the measured GPU frame time: lower when the frame is over
+// budget, higher when it is well under. The cost of the raymarch grows with the number of pixels, so the scale moves
+// with the square root of the time ratio. Scales are quantized and every change is followed by a cooldown, as a
+// change reallocates the terrain framebuffer and the measurements lag a few frames behind.
+class render_scale_controller
+  {
+  public:
+    render_scale_controller(float budget_ms, float initial_scale = 0.5f, float min_scale = 0.25f, float max_scale = 1.f);
+
+    // returns true if the scale changed
+    bool update(float frame_ms);
+
+    float get_scale() const { return m_scale; }
+    float get_average_ms() const { return m_average_ms; }
+
+  private:
+    float m_budget_ms;
+    float m_min_scale, m_max_scale;
+    float m_scale;
+    float m_average_ms; // negative until the first measurement after a change
+    int m_cooldown;
+  };
@@ -5,9 +5,8 @@
 #include "RenderDoos/render_engine.h"
 #include "RenderDoos/types.h"
 
-#include "stb/stb_image.h"
-
 #include "physics.h"
+#include "terrain.h"
 
 jtk::float4x4 perspective(float angle, float ratio, float n, float f)
   {
@@ -112,6 +111,18 @@ void mesh::cleanup(RenderDoos::render_engine& engine)
 
 void mesh::init_from_ply_file(RenderDoos::render_engine& engine, const std::string& filename, float rx, float ry, float rz)
   {
+  decode_ply_file(filename, rx, ry, rz);
+  upload(engine);
+  }
+
+void mesh::decode_ply_file(const std::string& filename, float rx, float ry, float rz)
+  {
+  // the baked mesh next to the PLY file is loaded without parsing the PLY, in which case the cpu side arrays stay empty
+  const std::string cache_filename = filename + ".mesh";
+  const uint64_t key = mesh_cache_key(filename, rx, ry, rz);
+  if (baked.map(cache_filename, key))
+    return;
+
   jtk::float4x4 rotx = jtk::make_rotation(physics::ORIGIN, physics::X_AXIS, rx);
   jtk::float4x4 roty = jtk::make_rotation(physics::ORIGIN, physics::Y_AXIS, ry);
   jtk::float4x4 rotz = jtk::make_rotation(physics::ORIGIN, physics::Z_AXIS, rz);
@@ -135,33 +146,40 @@ void mesh::init_from_ply_file(RenderDoos::render_engine& engine, const std::stri
         uv_per_vertex[triangles[i][j]] = uv[i][j];
         }
       }
-    geometry_id = engine.add_geometry(VERTEX_STANDARD);
-    RenderDoos::vertex_standard* vp;
-    uint32_t* ip;
-    engine.geometry_begin(geometry_id, vertices.size(), triangles.size()*3, (float**)&vp, (void**)&ip);
+    std::vector<RenderDoos::vertex_standard> gpu_vertices(vertices.size());
     for (uint32_t i = 0; i < vertices.size(); ++i)
       {
-      vp->x = vertices[i].x;
-      vp->y = vertices[i].y;
-      vp->z = vertices[i].z;
-      vp->nx = normals[i].x;
-      vp->ny = normals[i].y;
-      vp->nz = normals[i].z;
-      vp->u = uv_per_vertex[i].x;
-      vp->v = 1-uv_per_vertex[i].y;
-      ++vp;
+      RenderDoos::vertex_standard& vs = gpu_vertices[i];
+      vs.x = vertices[i].x;
+      vs.y = vertices[i].y;
+      vs.z = vertices[i].z;
+      vs.nx = normals[i].x;
+      vs.ny = normals[i].y;
+      vs.nz = normals[i].z;
+      vs.u = uv_per_vertex[i].x;
+      vs.v = 1-uv_per_vertex[i].y;
       }
+    std::vector<uint32_t> indices(triangles.size() * 3);
     for (uint32_t i = 0; i < triangles.size(); ++i)
       {
-      *ip++ = triangles[i][0];
-      *ip++ = triangles[i][1];
-      *ip++ = triangles[i][2];
+      indices[i * 3 + 0] = triangles[i][0];
+      indices[i * 3 + 1] = triangles[i][1];
+      indices[i * 3 + 2] = triangles[i][2];
       }
-    engine.geometry_end(geometry_id);
+    baked.assign(std::move(gpu_vertices), std::move(indices));
+    // a read-only asset folder just means the PLY is parsed again next time
+    if (key)
+      baked.write(cache_filename, key);
     }
   }
 
-texture::texture() : texture_id(-1), im(nullptr)
+void mesh::upload(RenderDoos::render_engine& engine)
+  {
+  geometry_id = baked.upload(engine);
+  baked.clear();
+  }
+
+texture::texture() : texture_id(-1), w(0), h(0)
   {
   }
 
@@ -169,15 +187,24 @@ texture::~texture()
   {
   }
 
-void texture::init_from_file(RenderDoos::render_engine& engine, const std::string& filename)
+void texture::init_from_file(RenderDoos::render_engine& engine, const std::string& filename, RenderDoos::texture_format format)
   {
-  int nr_of_channels;
-  im = stbi_load(filename.c_str(), &w, &h, &nr_of_channels, 4);  
-  if (im)
-    {
-    texture_id = engine.add_texture(w, h, RenderDoos::texture_format_rgba8, im);
-    stbi_image_free(im);
-    }
+  decode_file(filename, format);
+  upload(engine);
+  }
+
+void texture::decode_file(const std::string& filename, RenderDoos::texture_format format)
+  {
+  baked.load(filename, format);
+  w = baked.width();
+  h = baked.height();
+  }
+
+void texture::upload(RenderDoos::render_engine& engine)
+  {
+  if (!baked.empty())
+    texture_id = baked.upload(engine);
+  baked.clear();
   }
 
 void texture::init_from_noise(RenderDoos::render_engine& engine, int width, int height, uint32_t seed)
@@ -198,12 +225,20 @@ void texture::init_from_noise(RenderDoos::render_engine& engine, int width, int
   delete [] tmp;
   }
 
+void texture::init_from_height_pyramid(RenderDoos::render_engine& engine, const HeightPyramid& pyramid)
+  {
+  std::vector<uint32_t> packed = pyramid.pack_rgba8();
+  w = 2 * (int)pyramid.get_size();
+  h = (int)pyramid.get_size();
+  texture_id = engine.add_texture(w, h, RenderDoos::texture_format_rgba8, (const uint8_t*)packed.data());
+  }
+
 void texture::cleanup(RenderDoos::render_engine& engine)
   {
   engine.remove_texture(texture_id);
   }
 
-cubemap::cubemap()
+cubemap::cubemap() : texture_id(-1), geometry_id(-1)
   {
   }
 
@@ -220,27 +255,41 @@ void cubemap::init_from_file(RenderDoos::render_engine& engine,
   const std::string& bottom
 )
   {
-  int w, h, nr_of_channels;
-  unsigned char* im_front = stbi_load(front.c_str(), &w, &h, &nr_of_channels, 4);
-  unsigned char* im_back = stbi_load(back.c_str(), &w, &h, &nr_of_channels, 4);
-  unsigned char* im_left = stbi_load(left.c_str(), &w, &h, &nr_of_channels, 4);
-  unsigned char* im_right = stbi_load(right.c_str(), &w, &h, &nr_of_channels, 4);
-  unsigned char* im_top = stbi_load(top.c_str(), &w, &h, &nr_of_channels, 4);
-  unsigned char* im_bottom = stbi_load(bottom.c_str(), &w, &h, &nr_of_channels, 4);
-  texture_id = engine.add_cubemap_texture(w, h, RenderDoos::texture_format_rgba8,
-    (const uint8_t*)im_front,
-    (const uint8_t*)im_back,
-    (const uint8_t*)im_left,
-    (const uint8_t*)im_right,
-    (const uint8_t*)im_top,
-    (const uint8_t*)im_bottom
+  decode_files(front, back, left, right, top, bottom);
+  upload(engine);
+  }
+
+void cubemap::decode_files(
+  const std::string& front,
+  const std::string& back,
+  const std::string& left,
+  const std::string& right,
+  const std::string& top,
+  const std::string& bottom
+)
+  {
+  faces[0].load(front, RenderDoos::texture_format_rgba8);
+  faces[1].load(back, RenderDoos::texture_format_rgba8);
+  faces[2].load(left, RenderDoos::texture_format_rgba8);
+  faces[3].load(right, RenderDoos::texture_format_rgba8);
+  faces[4].load(top, RenderDoos::texture_format_rgba8);
+  faces[5].load(bottom, RenderDoos::texture_format_rgba8);
+  }
+
+void cubemap::upload(RenderDoos::render_engine& engine)
+  {
+  texture_id = engine.add_cubemap_texture(faces[0].width(), faces[0].height(), RenderDoos::texture_format_rgba8,
+    faces[0].data(),
+    faces[1].data(),
+    faces[2].data(),
+    faces[3].data(),
+    faces[4].data(),
+    faces[5].data()
   );
-  stbi_image_free(im_front);
-  stbi_image_free(im_back);
-  stbi_image_free(im_left);
-  stbi_image_free(im_right);
-  stbi_image_free(im_top);
-  stbi_image_free(im_bottom);
+  for (auto& face : faces)
+    {
+    face.clear();
+    }
 
   geometry_id = engine.add_geometry(VERTEX_STANDARD);
 
@@ -3,11 +3,18 @@
 #include "jtk/qbvh.h"
 #include "jtk/vec.h"
 
+#include "mesh_cache.h"
+#include "texture_cache.h"
+
+#include <array>
+
 namespace RenderDoos
   {
   class render_engine;
   }
 
+class HeightPyramid;
+
 jtk::float4x4 perspective(float angle, float ratio, float n, float f);
 
 class camera
@@ -37,6 +44,10 @@ struct mesh
   ~mesh();
 
   void init_from_ply_file(RenderDoos::render_engine& engine, const std::string& filename, float rx, float ry, float rz);
+  // init_from_ply_file in two steps: decode_ply_file does not use the render engine and can run on any thread,
+  // upload has to run on the render thread
+  void decode_ply_file(const std::string& filename, float rx, float ry, float rz);
+  void upload(RenderDoos::render_engine& engine);
   void cleanup(RenderDoos::render_engine& engine);
 
   std::vector<jtk::vec3<float>> vertices;
@@ -44,6 +55,7 @@ struct mesh
   std::vector<jtk::vec3<uint32_t>> triangles; 
   std::vector<jtk::vec3<jtk::vec2<float>>> uv;
 
+  baked_mesh baked; // between decode_ply_file and upload
   int32_t geometry_id;
   };
 
@@ -52,12 +64,18 @@ struct texture
   texture();
   ~texture();
 
-  void init_from_file(RenderDoos::render_engine& engine, const std::string& filename);
+  // format is texture_format_rgba8, or texture_format_rgba16 for 16 bit images
+  void init_from_file(RenderDoos::render_engine& engine, const std::string& filename, RenderDoos::texture_format format = RenderDoos::texture_format_rgba8);
+  // init_from_file in two steps: decode_file can run on any thread, upload has to run on the render thread
+  void decode_file(const std::string& filename, RenderDoos::texture_format format = RenderDoos::texture_format_rgba8);
+  void upload(RenderDoos::render_engine& engine);
   void init_from_noise(RenderDoos::render_engine& engine, int width, int height, uint32_t seed);
+  // all levels of the pyramid side by side, see HeightPyramid::pack_rgba8
+  void init_from_height_pyramid(RenderDoos::render_engine& engine, const HeightPyramid& pyramid);
   void cleanup(RenderDoos::render_engine& engine);
 
   int32_t texture_id;
-  unsigned char* im;
+  baked_texture baked; // between decode_file and upload
   int w, h;
   };
 
@@ -74,8 +92,19 @@ struct cubemap
     const std::string& top,
     const std::string& bottom
     );
+  // init_from_file in two steps: decode_files can run on any thread, upload has to run on the render thread
+  void decode_files(
+    const std::string& front,
+    const std::string& back,
+    const std::string& left,
+    const std::string& right,
+    const std::string& top,
+    const std::string& bottom
+    );
+  void upload(RenderDoos::render_engine& engine);
   void cleanup(RenderDoos::render_engine& engine);
 
   int32_t texture_id;
   int32_t geometry_id;
+  std::array<baked_texture, 6> faces; // front, back, left, right, top, bottom, between decode_files and upload
   };
\ No newline at end of file
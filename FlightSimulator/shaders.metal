@@ -76,6 +76,8 @@ struct TerrainMaterialUniforms {
   int normalmap_handle;
   int colormap_handle;
   int noise_handle;
+  float4 jitter;
+  int maxheightmap_handle;
 };
 
 struct TerrainVertexOut {
@@ -131,18 +133,104 @@ float map( float3 p,  texture2d<float> Heightmap, sampler sampler2d)
     return p.y - terrain(p.xz, Heightmap, sampler2d);
 }
 
-float intersect( float3 ro, float3 rd, texture2d<float> Heightmap, sampler sampler2d)
+constant float terrain_max_depth = 800.0;
+constant float terrain_max_height = 5.0;
+
+// maximum terrain height in the cell of the given level of the pyramid
+float maxHeight( int level, float2 cell, int size, texture2d<float> MaxHeightmap)
+{
+  int offset = 2*size - 2*(size >> level);
+  return MaxHeightmap.read(uint2(offset + int(cell.x), int(cell.y))).r*terrain_max_height;
+}
+
+// first sign change of map between t0 and t1, within a single texel
+float refine( float3 ro, float3 rd, float t0, float t1, texture2d<float> Heightmap, sampler sampler2d)
 {
-    const float maxd = 80.0;
-    const float precis = 0.001;
-    float t = 0.0;
-    for( int i=0; i<256; i++ )
+  if( map( ro+rd*t0, Heightmap, sampler2d) < 0.0 ) return t0;
+  const int steps = 4;
+  float dt = (t1-t0)/float(steps);
+  for( int i=1; i<=steps; i++ )
+  {
+    float t = t0 + dt*float(i);
+    if( map( ro+rd*t, Heightmap, sampler2d) < 0.0 )
     {
-        float h = map( ro+rd*t, Heightmap, sampler2d);
-        if( abs(h)<precis || t>maxd ) break;
-        t += h*0.5;
+      float a = t-dt;
+      float b = t;
+      for( int j=0; j<5; j++ )
+      {
+        float m = 0.5*(a+b);
+        if( map( ro+rd*m, Heightmap, sampler2d) < 0.0 ) b = m; else a = m;
+      }
+      return b;
     }
-    return (t>maxd)?-1.0:t;
+  }
+  return -1.0;
+}
+
+// Maximum mipmap traversal: a cell whose maximum stays below the ray is skipped as a whole and the next cell is
+// tested one level coarser, otherwise the ray descends a level. Only texels at level 0 are marched.
+float intersect( float3 ro, float3 rd, texture2d<float> Heightmap, texture2d<float> MaxHeightmap, sampler sampler2d)
+{
+  int size = int(MaxHeightmap.get_height());
+  int top = int( log2( float(size) ) + 0.5 );
+  float fsize = float(size);
+
+  // the ray in texel coordinates of the heightmap, see scalePosition
+  float2 qo = (ro.xz*0.005 + 0.5)*fsize;
+  float2 qd = rd.xz*0.005*fsize;
+  float2 dir = float2( qd.x >= 0.0 ? 1.0 : -1.0, qd.y >= 0.0 ? 1.0 : -1.0 );
+  float2 inv = dir / max( abs(qd), float2(1e-8) );
+
+  // outside the map and below its lowest point the ground is flat at height 0
+  float t_ground = rd.y < 0.0 ? -ro.y/rd.y : -1.0;
+  if( t_ground > terrain_max_depth ) t_ground = -1.0;
+
+  // clip against the box of the map, between height 0 and terrain_max_height
+  float tmin = 0.0;
+  float tmax = terrain_max_depth;
+  if( rd.y < 0.0 )
+  {
+    tmin = max( tmin, (terrain_max_height-ro.y)/rd.y );
+    tmax = min( tmax, -ro.y/rd.y );
+  }
+  else if( ro.y >= terrain_max_height ) return -1.0;
+  else if( rd.y > 0.0 ) tmax = min( tmax, (terrain_max_height-ro.y)/rd.y );
+  float2 t0 = (float2(0.0)-qo)*inv;
+  float2 t1 = (float2(fsize)-qo)*inv;
+  tmin = max( tmin, max( min(t0.x, t1.x), min(t0.y, t1.y) ) );
+  tmax = min( tmax, min( max(t0.x, t1.x), max(t0.y, t1.y) ) );
+
+  int level = top;
+  float t = tmin;
+  for( int i=0; i<256 && t<tmax; i++ )
+  {
+    float cell_size = float(1 << level);
+    // a nudge in the direction of travel, so that a ray on the border of two cells is in the next one
+    float2 cell = clamp( floor( (qo + qd*t + dir*1e-3)/cell_size ), float2(0.0), float2(float(size >> level) - 1.0) );
+    float h = maxHeight( level, cell, size, MaxHeightmap);
+    float2 bound = (cell + max(dir, float2(0.0)))*cell_size;
+    float2 tb = (bound - qo)*inv;
+    float t_exit = min( min(tb.x, tb.y), tmax );
+    float y = ro.y + rd.y*t;
+    if( min( y, ro.y + rd.y*t_exit ) > h )
+    {
+      t = t_exit;
+      level = min( level+1, top );
+      continue;
+    }
+    // the ray comes down to the maximum within this cell
+    if( y > h ) t = (h-ro.y)/rd.y;
+    if( level > 0 )
+    {
+      level--;
+      continue;
+    }
+    float th = refine( ro, rd, t, t_exit, Heightmap, sampler2d);
+    if( th >= 0.0 ) return th;
+    t = t_exit;
+    level = min( level+1, top );
+  }
+  return t_ground;
 }
 
 float3 calcNormal( float3 pos, float t, texture2d<float> Normalmap, sampler sampler2d)
@@ -161,9 +249,10 @@ float4 getColor(float3 pos, texture2d<float> Colormap, sampler sampler2d)
   return Colormap.sample(sampler2d, p);
 }
 
-fragment float4 terrain_material_fragment_shader(const TerrainVertexOut vertexIn [[stage_in]], texture2d<float> heightmap [[texture(0)]], texture2d<float> normalmap [[texture(1)]], texture2d<float> colormap [[texture(2)]], texture2d<float> noise [[texture(3)]], sampler sampler2d [[sampler(0)]], constant TerrainMaterialUniforms& input [[buffer(10)]]) {
+fragment float4 terrain_material_fragment_shader(const TerrainVertexOut vertexIn [[stage_in]], texture2d<float> heightmap [[texture(0)]], texture2d<float> normalmap [[texture(1)]], texture2d<float> colormap [[texture(2)]], texture2d<float> noise [[texture(3)]], texture2d<float> maxheightmap [[texture(4)]], sampler sampler2d [[sampler(0)]], constant TerrainMaterialUniforms& input [[buffer(10)]]) {
   //return colormap.sample(sampler2d, vertexIn.position.xy/input.resolution.xy);
-  float2 xy = vertexIn.position.xy / input.resolution.xy;
+  // y runs down in Metal, the jitter is given with y up
+  float2 xy = (vertexIn.position.xy + float2(input.jitter.x, -input.jitter.y)) / input.resolution.xy;
   xy.y = 1-xy.y;
 	float2 s = (-1.0 + 2.0* xy) * float2(input.resolution.x/input.resolution.y, 1.0);
     
@@ -181,7 +270,7 @@ fragment float4 terrain_material_fragment_shader(const TerrainVertexOut vertexIn
   float3 rd = normalize( s.x*rx + s.y*ry + 2.0*rz );
     
   float3 sunDir = normalize(float3(-0.8, 0.4, -0.3));
-  float t = intersect(ro, rd, heightmap, sampler2d);
+  float t = intersect(ro, rd, heightmap, maxheightmap, sampler2d);
     
   if(t > 0.0)
     {
@@ -221,7 +310,7 @@ fragment float4 terrain_material_fragment_shader(const TerrainVertexOut vertexIn
       
       
       //fog
-      float fo = 1-exp(-pow(clamp((t-80.0*0.5)/80.0, 0.0, 1.0), 1)*10.0);
+      float fo = 1-exp(-pow(clamp((t-terrain_max_depth*0.5)/terrain_max_depth, 0.0, 1.0), 1)*10.0);
       float3 fco = float3(0.7);
       col = mix(col, fco, fo);
       //sun scatter
@@ -260,6 +349,51 @@ fragment float4 blit_material_fragment_shader(const BlitVertexOut vertexIn [[sta
   return float4(clr, 1);
 }
 
+struct TemporalUpsampleMaterialUniforms {
+  float4x4 projection_matrix;
+  float4x4 camera_matrix;
+  float4x4 reprojection_matrix;
+  float4 jitter;
+  float4 params;
+};
+
+vertex BlitVertexOut temporal_upsample_material_vertex_shader(const device VertexIn *vertices [[buffer(0)]], uint vertexId [[vertex_id]], constant TemporalUpsampleMaterialUniforms& input [[buffer(10)]]) {
+  float4 pos(vertices[vertexId].position, 1);
+  BlitVertexOut out;
+  out.position = input.projection_matrix * input.camera_matrix * pos;
+  out.texcoord = vertices[vertexId].textureCoordinates;
+  return out;
+}
+
+// see get_temporal_upsample_material_fragment_shader, the terrain shader flips y, so the rays are computed with y up
+fragment float4 temporal_upsample_material_fragment_shader(const BlitVertexOut vertexIn [[stage_in]], texture2d<float> texture0 [[texture(0)]], texture2d<float> texture1 [[texture(1)]], sampler sampler2d [[sampler(0)]], constant TemporalUpsampleMaterialUniforms& input [[buffer(10)]]) {
+  float2 texel = 1.0 / input.jitter.zw;
+  float2 uv = vertexIn.texcoord - float2(input.jitter.x, -input.jitter.y) * texel;
+  float4 current = texture0.sample(sampler2d, uv);
+  float4 n0 = texture0.sample(sampler2d, uv + float2(texel.x, 0.0));
+  float4 n1 = texture0.sample(sampler2d, uv - float2(texel.x, 0.0));
+  float4 n2 = texture0.sample(sampler2d, uv + float2(0.0, texel.y));
+  float4 n3 = texture0.sample(sampler2d, uv - float2(0.0, texel.y));
+  float4 lo = min(current, min(min(n0, n1), min(n2, n3)));
+  float4 hi = max(current, max(max(n0, n1), max(n2, n3)));
+
+  float2 xy = float2(vertexIn.texcoord.x, 1.0 - vertexIn.texcoord.y);
+  float2 s = (-1.0 + 2.0 * xy) * float2(input.params.x, 1.0);
+  float3 d = (input.reprojection_matrix * float4(s, 2.0, 0.0)).xyz;
+  float weight = 0.0;
+  float4 history = current;
+  if (d.z > 0.0)
+    {
+    float2 previous = (2.0 * d.xy / d.z / float2(input.params.x, 1.0) + 1.0) * 0.5;
+    if (previous.x >= 0.0 && previous.x <= 1.0 && previous.y >= 0.0 && previous.y <= 1.0)
+      {
+      history = clamp(texture1.sample(sampler2d, float2(previous.x, 1.0 - previous.y)), lo, hi);
+      weight = input.params.y;
+      }
+    }
+  return mix(current, history, weight);
+}
+
 struct FontVertexIn {
   packed_float2 position;
   packed_float2 textureCoordinates;
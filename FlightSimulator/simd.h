@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <new>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#define FLIGHTSIM_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLIGHTSIM_SSE2
+#endif
+
+#if defined(FLIGHTSIM_AVX2)
+#include <immintrin.h>
+#elif defined(FLIGHTSIM_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Thin wrappers around the SIMD registers of the target, so that kernels can be written once as a template
+// and instantiated for the widest available lane type plus the scalar fallback for the remainder.
+namespace simd
+  {
+
+  template <class T, std::size_t Alignment>
+  struct aligned_allocator
+    {
+    typedef T value_type;
+
+    template <class U>
+    struct rebind
+      {
+      typedef aligned_allocator<U, Alignment> other;
+      };
+
+    aligned_allocator() = default;
+
+    template <class U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n)
+      {
+      return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+      }
+
+    void deallocate(T* p, std::size_t)
+      {
+      ::operator delete(p, std::align_val_t(Alignment));
+      }
+
+    template <class U>
+    bool operator == (const aligned_allocator<U, Alignment>&) const { return true; }
+
+    template <class U>
+    bool operator != (const aligned_allocator<U, Alignment>&) const { return false; }
+    };
+
+  template <class T>
+  using aligned_vector = std::vector<T, aligned_allocator<T, 64>>;
+
+  struct lane1
+    {
+    static constexpr std::size_t width = 1;
+    float v;
+
+    lane1() {}
+    lane1(float f) : v(f) {}
+
+    static lane1 load(const float* p) { return lane1(*p); }
+    static lane1 loadu(const float* p) { return lane1(*p); }
+    void store(float* p) const { *p = v; }
+    void storeu(float* p) const { *p = v; }
+    };
+
+  inline lane1 operator + (lane1 a, lane1 b) { return lane1(a.v + b.v); }
+  inline lane1 operator - (lane1 a, lane1 b) { return lane1(a.v - b.v); }
+  inline lane1 operator * (lane1 a, lane1 b) { return lane1(a.v * b.v); }
+  inline lane1 operator / (lane1 a, lane1 b) { return lane1(a.v / b.v); }
+  inline lane1 sqrt(lane1 a) { return lane1(std::sqrt(a.v)); }
+  // like minps and maxps: b when a or b is NaN, so that min(max(x, lo), hi) maps a NaN x to lo
+  inline lane1 min(lane1 a, lane1 b) { return lane1(a.v < b.v ? a.v : b.v); }
+  inline lane1 max(lane1 a, lane1 b) { return lane1(a.v > b.v ? a.v : b.v); }
+  // rounds towards zero
+  inline lane1 truncate(lane1 a) { return lane1(static_cast<float>(static_cast<int32_t>(a.v))); }
+  // index holds non negative integral values, e.g. the result of truncate
+  inline lane1 gather(const float* base, lane1 index) { return lane1(base[static_cast<int32_t>(index.v)]); }
+
+#if defined(FLIGHTSIM_SSE2)
+  struct lane4
+    {
+    static constexpr std::size_t width = 4;
+    __m128 v;
+
+    lane4() {}
+    lane4(__m128 m) : v(m) {}
+    lane4(float f) : v(_mm_set1_ps(f)) {}
+
+    static lane4 load(const float* p) { return lane4(_mm_load_ps(p)); }
+    static lane4 loadu(const float* p) { return lane4(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_store_ps(p, v); }
+    void storeu(float* p) const { _mm_storeu_ps(p, v); }
+    };
+
+  inline lane4 operator + (lane4 a, lane4 b) { return lane4(_mm_add_ps(a.v, b.v)); }
+  inline lane4 operator - (lane4 a, lane4 b) { return lane4(_mm_sub_ps(a.v, b.v)); }
+  inline lane4 operator * (lane4 a, lane4 b) { return lane4(_mm_mul_ps(a.v, b.v)); }
+  inline lane4 operator / (lane4 a, lane4 b) { return lane4(_mm_div_ps(a.v, b.v)); }
+  inline lane4 sqrt(lane4 a) { return lane4(_mm_sqrt_ps(a.v)); }
+  inline lane4 min(lane4 a, lane4 b) { return lane4(_mm_min_ps(a.v, b.v)); }
+  inline lane4 max(lane4 a, lane4 b) { return lane4(_mm_max_ps(a.v, b.v)); }
+  inline lane4 truncate(lane4 a) { return lane4(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v))); }
+#if defined(FLIGHTSIM_AVX2)
+  inline lane4 gather(const float* base, lane4 index) { return lane4(_mm_i32gather_ps(base, _mm_cvttps_epi32(index.v), 4)); }
+#else
+  // no gather instruction before AVX2
+  inline lane4 gather(const float* base, lane4 index)
+    {
+    alignas(16) int32_t i[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(i), _mm_cvttps_epi32(index.v));
+    return lane4(_mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]));
+    }
+#endif
+#endif
+
+#if defined(FLIGHTSIM_AVX2)
+  struct lane8
+    {
+    static constexpr std::size_t width = 8;
+    __m256 v;
+
+    lane8() {}
+    lane8(__m256 m) : v(m) {}
+    lane8(float f) : v(_mm256_set1_ps(f)) {}
+
+    static lane8 load(const float* p) { return lane8(_mm256_load_ps(p)); }
+    static lane8 loadu(const float* p) { return lane8(_mm256_loadu_ps(p)); }
+    void store(float* p) const { _mm256_store_ps(p, v); }
+    void storeu(float* p) const { _mm256_storeu_ps(p, v); }
+    };
+
+  inline lane8 operator + (lane8 a, lane8 b) { return lane8(_mm256_add_ps(a.v, b.v)); }
+  inline lane8 operator - (lane8 a, lane8 b) { return lane8(_mm256_sub_ps(a.v, b.v)); }
+  inline lane8 operator * (lane8 a, lane8 b) { return lane8(_mm256_mul_ps(a.v, b.v)); }
+  inline lane8 operator / (lane8 a, lane8 b) { return lane8(_mm256_div_ps(a.v, b.v)); }
+  inline lane8 sqrt(lane8 a) { return lane8(_mm256_sqrt_ps(a.v)); }
+  inline lane8 min(lane8 a, lane8 b) { return lane8(_mm256_min_ps(a.v, b.v)); }
+  inline lane8 max(lane8 a, lane8 b) { return lane8(_mm256_max_ps(a.v, b.v)); }
+  inline lane8 truncate(lane8 a) { return lane8(_mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)); }
+  inline lane8 gather(const float* base, lane8 index) { return lane8(_mm256_i32gather_ps(base, _mm256_cvttps_epi32(index.v), 4)); }
+#endif
+
+#if defined(FLIGHTSIM_AVX2)
+  typedef lane8 widest;
+#elif defined(FLIGHTSIM_SSE2)
+  typedef lane4 widest;
+#else
+  typedef lane1 widest;
+#endif
+
+  } // namespace simd
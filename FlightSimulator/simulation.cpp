@@ -0,0 +1,197 @@
+#include "simulation.h"
+#include "recorder.h"
+#include "determinism.h"
+
+namespace
+  {
+  // we never catch up more than this amount of simulated wall clock time, e.g. after a breakpoint or a window drag
+  constexpr float max_frame_time = 0.25f;
+
+  jtk::float4 nlerp(const jtk::float4& a, const jtk::float4& b, float t)
+    {
+    // take the shortest arc
+    float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    float s = d < 0.f ? -1.f : 1.f;
+    jtk::float4 q(
+      physics::utils::lerp(a[0], s * b[0], t),
+      physics::utils::lerp(a[1], s * b[1], t),
+      physics::utils::lerp(a[2], s * b[2], t),
+      physics::utils::lerp(a[3], s * b[3], t));
+    return jtk::quaternion_normalize(q);
+    }
+
+  jtk::vec3<float> lerp(const jtk::vec3<float>& a, const jtk::vec3<float>& b, float t)
+    {
+    return a + (b - a) * t;
+    }
+  }
+
+AircraftSnapshot::AircraftSnapshot() :
+  position(0.f), orientation(0, 0, 0, 1), velocity(0.f), angular_velocity(0.f), throttle(0.f), crashed(false)
+  {
+  }
+
+AircraftSnapshot::AircraftSnapshot(const Aircraft& aircraft) :
+  position(aircraft.state.position),
+  orientation(aircraft.state.orientation),
+  velocity(aircraft.state.velocity),
+  angular_velocity(aircraft.state.angular_velocity),
+  throttle(aircraft.state.throttle),
+  crashed(aircraft.state.is_crashed())
+  {
+  }
+
+jtk::vec3<float> AircraftSnapshot::transform_direction(const jtk::vec3<float>& direction) const
+  {
+  return physics::utils::rotate(orientation, direction);
+  }
+
+jtk::vec3<float> AircraftSnapshot::inverse_transform_direction(const jtk::vec3<float>& direction) const
+  {
+  return physics::utils::rotate(jtk::quaternion_inverse(orientation), direction);
+  }
+
+jtk::vec3<float> AircraftSnapshot::get_body_velocity() const
+  {
+  return inverse_transform_direction(velocity);
+  }
+
+AircraftSnapshot interpolate(const AircraftSnapshot& a, const AircraftSnapshot& b, float t)
+  {
+  AircraftSnapshot s;
+  s.position = lerp(a.position, b.position, t);
+  s.orientation = nlerp(a.orientation, b.orientation, t);
+  s.velocity = lerp(a.velocity, b.velocity, t);
+  s.angular_velocity = lerp(a.angular_velocity, b.angular_velocity, t);
+  s.throttle = b.throttle;
+  s.crashed = b.crashed;
+  return s;
+  }
+
+Simulation::Simulation(Aircraft& aircraft, float rate, const TerrainField* terrain) :
+  m_aircraft(aircraft),
+  m_terrain(terrain),
+  m_recorder(nullptr),
+  m_step(1.f / rate),
+  m_stop(false),
+  m_frames(make_initial_frame(aircraft, 1.f / rate))
+  {
+  }
+
+Simulation::Frame Simulation::make_initial_frame(const Aircraft& aircraft, float step)
+  {
+  Frame frame;
+  frame.previous = AircraftSnapshot(aircraft);
+  frame.current = frame.previous;
+  frame.published = std::chrono::steady_clock::now();
+  frame.step_duration = step;
+  return frame;
+  }
+
+Simulation::~Simulation()
+  {
+  stop();
+  }
+
+void Simulation::start()
+  {
+  if (m_thread.joinable())
+    return;
+  m_stop = false;
+  m_thread = std::thread(&Simulation::run, this);
+  }
+
+void Simulation::stop()
+  {
+  m_stop = true;
+  if (m_thread.joinable())
+    m_thread.join();
+  }
+
+void Simulation::set_controls(const Controls& controls)
+  {
+  m_controls.back() = controls;
+  m_controls.publish();
+  }
+
+AircraftSnapshot Simulation::get_snapshot()
+  {
+  m_frames.update();
+  const Frame& frame = m_frames.front();
+  float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - frame.published).count();
+  float t = physics::utils::clamp(elapsed / frame.step_duration, 0.f, 1.f);
+  return interpolate(frame.previous, frame.current, t);
+  }
+
+SimulationStatistics Simulation::get_statistics() const
+  {
+  return m_frames.front().statistics;
+  }
+
+void Simulation::run()
+  {
+  using clock = std::chrono::steady_clock;
+
+  physics::fp_environment fp;
+  Controls controls;
+  AircraftSnapshot previous(m_aircraft);
+  AircraftSnapshot current = previous;
+  float accumulator = 0.f;
+  auto last_tic = clock::now();
+  uint64_t batch = 0;
+  double total_ms = 0.0;
+  uint64_t total_steps = 0;
+
+  while (!m_stop)
+    {
+    if (m_controls.update())
+      {
+      controls = m_controls.front();
+      m_aircraft.state.joystick = controls.joystick;
+      m_aircraft.state.throttle = controls.throttle;
+      }
+    const float speedup = static_cast<float>(controls.time_speedup);
+
+    auto tic = clock::now();
+    float frame_time = std::chrono::duration<float>(tic - last_tic).count();
+    last_tic = tic;
+
+    accumulator += physics::utils::min(frame_time, max_frame_time) * speedup;
+
+    int steps = 0;
+    const auto batch_start = clock::now();
+    while (accumulator >= m_step)
+      {
+      previous = current;
+      if (m_recorder)
+        m_recorder->record(m_aircraft.state);
+      m_aircraft.update(m_step, m_terrain);
+      current = AircraftSnapshot(m_aircraft);
+      accumulator -= m_step;
+      ++steps;
+      }
+
+    if (steps > 0)
+      {
+      const auto batch_end = clock::now();
+      Frame& frame = m_frames.back();
+      frame.previous = previous;
+      frame.current = current;
+      frame.published = batch_end;
+      frame.step_duration = m_step / speedup;
+      frame.statistics.batch_start = batch_start;
+      frame.statistics.batch_ms = std::chrono::duration<float, std::milli>(batch_end - batch_start).count();
+      frame.statistics.steps = static_cast<uint32_t>(steps);
+      frame.statistics.batch = ++batch;
+      total_ms += std::chrono::duration<double, std::milli>(batch_end - batch_start).count();
+      total_steps += static_cast<uint64_t>(steps);
+      frame.statistics.total_ms = total_ms;
+      frame.statistics.total_steps = total_steps;
+      m_frames.publish();
+      }
+
+    // sleep until the next step is due
+    float remaining = (m_step - accumulator) / speedup;
+    std::this_thread::sleep_for(std::chrono::duration<float>(remaining));
+    }
+  }
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "flightmodel.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+
+class FlightRecorder;
+
+// Lock-free triple buffer for a single producer and a single consumer.
+// The producer fills back() and calls publish(), the consumer calls update() and reads front().
+// Neither side ever waits for the other: the third buffer is always free to swap with.
+template <class T>
+class TripleBuffer
+  {
+  public:
+    TripleBuffer() : m_middle(1), m_back(2), m_front(0)
+      {
+      }
+
+    TripleBuffer(const T& initial) : m_middle(1), m_back(2), m_front(0)
+      {
+      m_buffers[0] = m_buffers[1] = m_buffers[2] = initial;
+      }
+
+    T& back()
+      {
+      return m_buffers[m_back];
+      }
+
+    void publish()
+      {
+      m_back = m_middle.exchange(static_cast<uint8_t>(m_back | fresh_bit), std::memory_order_acq_rel) & index_mask;
+      }
+
+    // returns true if a newly published value was swapped to the front
+    bool update()
+      {
+      if ((m_middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+        return false;
+      m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & index_mask;
+      return true;
+      }
+
+    const T& front() const
+      {
+      return m_buffers[m_front];
+      }
+
+  private:
+    enum : uint8_t
+      {
+      index_mask = 3,
+      fresh_bit = 4
+      };
+
+    T m_buffers[3];
+    std::atomic<uint8_t> m_middle;
+    uint8_t m_back;  // only touched by the producer
+    uint8_t m_front; // only touched by the consumer
+  };
+
+// Render-side copy of the aircraft state
+struct AircraftSnapshot
+  {
+  jtk::vec3<float> position;
+  jtk::float4 orientation;
+  jtk::vec3<float> velocity;
+  jtk::vec3<float> angular_velocity;
+  float throttle;
+  bool crashed;
+
+  AircraftSnapshot();
+  AircraftSnapshot(const Aircraft& aircraft);
+
+  // transform direction from body space to world space
+  jtk::vec3<float> transform_direction(const jtk::vec3<float>& direction) const;
+
+  // transform direction from world space to body space
+  jtk::vec3<float> inverse_transform_direction(const jtk::vec3<float>& direction) const;
+
+  jtk::vec3<float> get_body_velocity() const;
+  };
+
+AircraftSnapshot interpolate(const AircraftSnapshot& a, const AircraftSnapshot& b, float t);
+
+struct Controls
+  {
+  jtk::vec3<float> joystick = jtk::vec3<float>(0.f); // pitch, yaw, roll
+  float throttle = 0.f;
+  int time_speedup = 1;
+  };
+
+// timing of the physics steps on the simulation thread. The render thread only sees the last published batch, the
+// batches in between are dropped, so the totals since the start are what adds up to the physics cost of a frame.
+struct SimulationStatistics
+  {
+  std::chrono::steady_clock::time_point batch_start;
+  float batch_ms = 0.f;     // wall clock time of the last batch
+  uint32_t steps = 0;       // number of steps in the last batch
+  uint64_t batch = 0;       // increases with every published batch
+  double total_ms = 0.0;    // wall clock time of all batches so far
+  uint64_t total_steps = 0; // steps of all batches so far
+  };
+
+// Steps an Aircraft on its own thread at a fixed rate, independent of the render loop.
+class Simulation
+  {
+  public:
+    // terrain may be nullptr for a flat ground at height 0, it should outlive the simulation
+    Simulation(Aircraft& aircraft, float rate = 500.f, const TerrainField* terrain = nullptr);
+    ~Simulation();
+
+    void start();
+    void stop();
+
+    // records every physics step, set before start(); the recorder should outlive the simulation
+    void set_recorder(FlightRecorder* recorder) { m_recorder = recorder; }
+
+    // render thread: hand over the latest control inputs
+    void set_controls(const Controls& controls);
+
+    // render thread: aircraft state interpolated between the last two physics steps
+    AircraftSnapshot get_snapshot();
+
+    // render thread: timing of the batch of steps behind the last snapshot, and of all steps so far
+    SimulationStatistics get_statistics() const;
+
+    physics::seconds get_step() const { return m_step; }
+
+  private:
+    void run();
+
+    struct Frame
+      {
+      AircraftSnapshot previous, current;
+      std::chrono::steady_clock::time_point published; // wall clock time at which current was computed
+      float step_duration;                             // wall clock duration of one physics step
+      SimulationStatistics statistics;
+      };
+
+    static Frame make_initial_frame(const Aircraft& aircraft, float step);
+
+    Aircraft& m_aircraft;
+    const TerrainField* m_terrain;
+    FlightRecorder* m_recorder;
+    physics::seconds m_step;
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    TripleBuffer<Controls> m_controls;
+    TripleBuffer<Frame> m_frames;
+  };
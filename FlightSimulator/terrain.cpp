@@ -0,0 +1,320 @@
+#include "terrain.h"
+
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+HeightPyramid::HeightPyramid() : m_size(0)
+  {
+  }
+
+void HeightPyramid::build(const uint16_t* heights, uint32_t size)
+  {
+  if (size == 0 || (size & (size - 1)) != 0)
+    throw std::runtime_error("height pyramid needs a power of two size");
+  m_size = size;
+  m_levels.clear();
+
+  // level 0: maximum over the 3x3 neighbourhood, first along x, then along y
+  std::vector<uint16_t> row_max(size * size);
+  for (uint32_t y = 0; y < size; ++y)
+    {
+    const uint16_t* row = heights + y * size;
+    for (uint32_t x = 0; x < size; ++x)
+      row_max[y * size + x] = std::max(row[x], std::max(row[(x + size - 1) % size], row[(x + 1) % size]));
+    }
+  std::vector<uint16_t> level(size * size);
+  for (uint32_t y = 0; y < size; ++y)
+    {
+    const uint16_t* above = row_max.data() + ((y + size - 1) % size) * size;
+    const uint16_t* here = row_max.data() + y * size;
+    const uint16_t* below = row_max.data() + ((y + 1) % size) * size;
+    for (uint32_t x = 0; x < size; ++x)
+      level[y * size + x] = std::max(here[x], std::max(above[x], below[x]));
+    }
+  m_levels.push_back(std::move(level));
+
+  for (uint32_t s = size / 2; s >= 1; s /= 2)
+    {
+    const std::vector<uint16_t>& fine = m_levels.back();
+    std::vector<uint16_t> coarse(s * s);
+    for (uint32_t y = 0; y < s; ++y)
+      {
+      const uint16_t* r0 = fine.data() + (2 * y) * (2 * s);
+      const uint16_t* r1 = r0 + 2 * s;
+      for (uint32_t x = 0; x < s; ++x)
+        coarse[y * s + x] = std::max(std::max(r0[2 * x], r0[2 * x + 1]), std::max(r1[2 * x], r1[2 * x + 1]));
+      }
+    m_levels.push_back(std::move(coarse));
+    }
+  }
+
+std::vector<uint32_t> HeightPyramid::pack_rgba8() const
+  {
+  const uint32_t width = 2 * m_size;
+  std::vector<uint32_t> image(width * m_size, 0);
+  for (uint32_t k = 0; k < m_levels.size(); ++k)
+    {
+    const uint32_t s = m_size >> k;
+    const uint32_t offset = width - 2 * s;
+    for (uint32_t y = 0; y < s; ++y)
+      {
+      for (uint32_t x = 0; x < s; ++x)
+        {
+        const uint32_t v = (uint32_t)m_levels[k][y * s + x];
+        const uint32_t r = (v + 256) / 257; // round up, 65535 maps to 255
+        image[y * width + offset + x] = 0xff000000 | r;
+        }
+      }
+    }
+  return image;
+  }
+
+bool load_heightmap(const std::string& filename, std::vector<uint16_t>& heights, uint32_t& width, uint32_t& height)
+  {
+  int w, h, nr_of_channels;
+  uint16_t* im = stbi_load_16(filename.c_str(), &w, &h, &nr_of_channels, 4);
+  if (!im)
+    return false;
+  width = (uint32_t)w;
+  height = (uint32_t)h;
+  heights.resize((std::size_t)w * h);
+  for (std::size_t i = 0; i < heights.size(); ++i)
+    heights[i] = im[i * 4];
+  stbi_image_free(im);
+  return true;
+  }
+
+namespace
+  {
+  const uint32_t tile_bits = 3;
+  const uint32_t tile_size = 1 << tile_bits;
+  const uint32_t tile_mask = tile_size - 1;
+  // see scalePosition and terrain() in the terrain shader: 0.005 per km over the map, heights up to 5 km
+  const float map_extent = 200000.f; // m
+  const float height_scale = 5000.f / 65535.f; // m per height unit
+  }
+
+TerrainField::TerrainField() : m_size(0), m_tiles_per_row(0), m_texels_per_meter(0.f)
+  {
+  }
+
+void TerrainField::build(const uint16_t* heights, uint32_t size)
+  {
+  m_pyramid.build(heights, size);
+  m_size = size;
+  m_tiles_per_row = (size + tile_mask) >> tile_bits;
+  m_texels_per_meter = (float)size / map_extent;
+  m_tiles.assign((std::size_t)m_tiles_per_row * m_tiles_per_row * tile_size * tile_size, 0);
+  for (uint32_t y = 0; y < size; ++y)
+    for (uint32_t x = 0; x < size; ++x)
+      m_tiles[(((y >> tile_bits) * m_tiles_per_row + (x >> tile_bits)) << (2 * tile_bits)) | ((y & tile_mask) << tile_bits) | (x & tile_mask)] = heights[y * size + x];
+  }
+
+uint16_t TerrainField::_texel(int32_t x, int32_t y) const
+  {
+  // the heightmap repeats like the texture in the shader, the size is a power of two
+  const uint32_t ux = (uint32_t)x & (m_size - 1);
+  const uint32_t uy = (uint32_t)y & (m_size - 1);
+  return m_tiles[(((uy >> tile_bits) * m_tiles_per_row + (ux >> tile_bits)) << (2 * tile_bits)) | ((uy & tile_mask) << tile_bits) | (ux & tile_mask)];
+  }
+
+float TerrainField::height(float x, float z) const
+  {
+  const float half = 0.5f * (float)m_size;
+  const float qx = x * m_texels_per_meter + half;
+  const float qy = z * m_texels_per_meter + half;
+  if (!(qx >= 0.f && qx < (float)m_size && qy >= 0.f && qy < (float)m_size))
+    return 0.f;
+  // texel centers are at half integer coordinates
+  const float px = std::floor(qx - 0.5f);
+  const float py = std::floor(qy - 0.5f);
+  const float fx = qx - 0.5f - px;
+  const float fy = qy - 0.5f - py;
+  const int32_t ix = (int32_t)px;
+  const int32_t iy = (int32_t)py;
+  const float h00 = (float)_texel(ix, iy);
+  const float h10 = (float)_texel(ix + 1, iy);
+  const float h01 = (float)_texel(ix, iy + 1);
+  const float h11 = (float)_texel(ix + 1, iy + 1);
+  const float h0 = h00 + (h10 - h00) * fx;
+  const float h1 = h01 + (h11 - h01) * fx;
+  return (h0 + (h1 - h0) * fy) * height_scale;
+  }
+
+void TerrainField::height(const float* x, const float* z, float* heights, std::size_t count) const
+  {
+  for (std::size_t i = 0; i < count; ++i)
+    heights[i] = height(x[i], z[i]);
+  }
+
+jtk::vec3<float> TerrainField::normal(float x, float z) const
+  {
+  const float half = 0.5f * (float)m_size;
+  const float qx = x * m_texels_per_meter + half;
+  const float qy = z * m_texels_per_meter + half;
+  if (!(qx >= 0.f && qx < (float)m_size && qy >= 0.f && qy < (float)m_size))
+    return jtk::vec3<float>(0.f, 1.f, 0.f);
+  const float px = std::floor(qx - 0.5f);
+  const float py = std::floor(qy - 0.5f);
+  const float fx = qx - 0.5f - px;
+  const float fy = qy - 0.5f - py;
+  const int32_t ix = (int32_t)px;
+  const int32_t iy = (int32_t)py;
+  const float h00 = (float)_texel(ix, iy);
+  const float h10 = (float)_texel(ix + 1, iy);
+  const float h01 = (float)_texel(ix, iy + 1);
+  const float h11 = (float)_texel(ix + 1, iy + 1);
+  // derivatives of the bilinear patch, from height units per texel to meters per meter
+  const float scale = height_scale * m_texels_per_meter;
+  const float dx = ((h10 - h00) * (1.f - fy) + (h11 - h01) * fy) * scale;
+  const float dz = ((h01 - h00) * (1.f - fx) + (h11 - h10) * fx) * scale;
+  const float inv_length = 1.f / std::sqrt(dx * dx + 1.f + dz * dz);
+  return jtk::vec3<float>(-dx * inv_length, inv_length, -dz * inv_length);
+  }
+
+float TerrainField::_patch_intersect(const TerrainRay& ray, const jtk::vec2<float>& qo, const jtk::vec2<float>& qd, float t0, float t1) const
+  {
+  // the segment stays within one texel, which touches at most four bilinear patches: split it where it crosses the
+  // texel centers, so every part lies in a single patch
+  const float cx = std::floor(qo.x + qd.x * (0.5f * (t0 + t1))) + 0.5f;
+  const float cy = std::floor(qo.y + qd.y * (0.5f * (t0 + t1))) + 0.5f;
+  float splits[4] = { t0, t1, t1, t1 };
+  if (qd.x != 0.f)
+    splits[1] = (cx - qo.x) / qd.x;
+  if (qd.y != 0.f)
+    splits[2] = (cy - qo.y) / qd.y;
+  for (int i = 1; i < 3; ++i)
+    if (!(splits[i] > t0 && splits[i] < t1))
+      splits[i] = t1;
+  if (splits[2] < splits[1])
+    std::swap(splits[1], splits[2]);
+
+  for (int i = 0; i < 3; ++i)
+    {
+    const float a = splits[i];
+    const float b = splits[i + 1];
+    if (b <= a && i > 0)
+      continue;
+    const float m = 0.5f * (a + b);
+    const float px = std::floor(qo.x + qd.x * m - 0.5f);
+    const float py = std::floor(qo.y + qd.y * m - 0.5f);
+    const int32_t ix = (int32_t)px;
+    const int32_t iy = (int32_t)py;
+    const float h00 = (float)_texel(ix, iy) * height_scale;
+    const float h10 = (float)_texel(ix + 1, iy) * height_scale;
+    const float h01 = (float)_texel(ix, iy + 1) * height_scale;
+    const float h11 = (float)_texel(ix + 1, iy + 1) * height_scale;
+    const float ca = h10 - h00;
+    const float cb = h01 - h00;
+    const float cc = h00 - h10 - h01 + h11;
+    // height above the patch as a quadratic in s = t - a
+    const float fx = qo.x + qd.x * a - 0.5f - px;
+    const float fy = qo.y + qd.y * a - 0.5f - py;
+    const float c0 = ray.origin.y + ray.direction.y * a - (h00 + ca * fx + cb * fy + cc * fx * fy);
+    if (c0 <= 0.f)
+      return a;
+    const float c1 = ray.direction.y - ca * qd.x - cb * qd.y - cc * (fx * qd.y + fy * qd.x);
+    const float c2 = -cc * qd.x * qd.y;
+    const float d = c1 * c1 - 4.f * c2 * c0;
+    if (d < 0.f)
+      continue;
+    const float q = -0.5f * (c1 + (c1 < 0.f ? -std::sqrt(d) : std::sqrt(d)));
+    if (q == 0.f)
+      continue;
+    // both roots in a numerically stable form, the first one may be infinite when the quadratic is linear
+    float r0 = c0 / q;
+    float r1 = q / c2;
+    if (r1 < r0)
+      std::swap(r0, r1);
+    const float length = b - a;
+    if (r0 >= 0.f && r0 <= length)
+      return a + r0;
+    if (r1 >= 0.f && r1 <= length)
+      return a + r1;
+    }
+  return -1.f;
+  }
+
+float TerrainField::intersect(const TerrainRay& ray) const
+  {
+  const jtk::vec3<float>& ro = ray.origin;
+  const jtk::vec3<float>& rd = ray.direction;
+  // terrain heights are never negative
+  if (ro.y <= 0.f)
+    return 0.f;
+  const float max_height = (float)m_pyramid.get_max(m_pyramid.get_levels() - 1, 0, 0) * height_scale;
+
+  // outside the map and below its lowest point the ground is flat at height 0
+  float t_ground = rd.y < 0.f ? -ro.y / rd.y : -1.f;
+  if (t_ground > ray.max_distance)
+    t_ground = -1.f;
+
+  // the ray in texel coordinates of the heightmap, clipped against the box of the map
+  const int32_t size = (int32_t)m_size;
+  const float fsize = (float)m_size;
+  const jtk::vec2<float> qo(ro.x * m_texels_per_meter + 0.5f * fsize, ro.z * m_texels_per_meter + 0.5f * fsize);
+  const jtk::vec2<float> qd(rd.x * m_texels_per_meter, rd.z * m_texels_per_meter);
+  const jtk::vec2<float> dir(qd.x >= 0.f ? 1.f : -1.f, qd.y >= 0.f ? 1.f : -1.f);
+  const jtk::vec2<float> inv(dir.x / std::max(std::abs(qd.x), 1e-12f), dir.y / std::max(std::abs(qd.y), 1e-12f));
+  float tmin = 0.f;
+  float tmax = ray.max_distance;
+  if (rd.y < 0.f)
+    {
+    tmin = std::max(tmin, (max_height - ro.y) / rd.y);
+    tmax = std::min(tmax, -ro.y / rd.y);
+    }
+  else if (ro.y > max_height)
+    return -1.f;
+  else if (rd.y > 0.f)
+    tmax = std::min(tmax, (max_height - ro.y) / rd.y);
+  tmin = std::max(tmin, std::max(std::min(-qo.x * inv.x, (fsize - qo.x) * inv.x), std::min(-qo.y * inv.y, (fsize - qo.y) * inv.y)));
+  tmax = std::min(tmax, std::min(std::max(-qo.x * inv.x, (fsize - qo.x) * inv.x), std::max(-qo.y * inv.y, (fsize - qo.y) * inv.y)));
+
+  // maximum mipmap traversal, see intersect in the terrain shader
+  const int32_t top = (int32_t)m_pyramid.get_levels() - 1;
+  int32_t level = top;
+  float t = tmin;
+  const int32_t max_iterations = 16 * size;
+  for (int32_t i = 0; i < max_iterations && t < tmax; ++i)
+    {
+    const float cell_size = (float)(1 << level);
+    const int32_t last = (size >> level) - 1;
+    // a nudge in the direction of travel, so that a ray on the border of two cells is in the next one
+    const int32_t cx = std::min(std::max((int32_t)std::floor((qo.x + qd.x * t + dir.x * 1e-3f) / cell_size), 0), last);
+    const int32_t cy = std::min(std::max((int32_t)std::floor((qo.y + qd.y * t + dir.y * 1e-3f) / cell_size), 0), last);
+    const float h = (float)m_pyramid.get_max(level, cx, cy) * height_scale;
+    const float bx = (float)(cx + (dir.x > 0.f ? 1 : 0)) * cell_size;
+    const float by = (float)(cy + (dir.y > 0.f ? 1 : 0)) * cell_size;
+    const float t_exit = std::min(std::min((bx - qo.x) * inv.x, (by - qo.y) * inv.y), tmax);
+    const float y = ro.y + rd.y * t;
+    if (std::min(y, ro.y + rd.y * t_exit) > h)
+      {
+      t = t_exit;
+      level = std::min(level + 1, top);
+      continue;
+      }
+    // the ray comes down to the maximum within this cell
+    if (y > h)
+      t = (h - ro.y) / rd.y;
+    if (level > 0)
+      {
+      --level;
+      continue;
+      }
+    const float th = _patch_intersect(ray, qo, qd, t, t_exit);
+    if (th >= 0.f)
+      return th;
+    t = t_exit;
+    level = std::min(level + 1, top);
+    }
+  return t_ground;
+  }
+
+void TerrainField::intersect(const TerrainRay* rays, std::size_t count, float* distances) const
+  {
+  for (std::size_t i = 0; i < count; ++i)
+    distances[i] = intersect(rays[i]);
+  }
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "jtk/vec.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Maximum height of the terrain over ever coarser cells of the heightmap, so that rays can skip over low terrain in
+// large steps. Level 0 holds per texel the maximum over the texel and its 8 neighbours, which bounds the linearly
+// interpolated terrain anywhere within the texel. Level k holds the maximum over 2x2 cells of level k-1, up to a
+// single cell for the whole heightmap.
+class HeightPyramid
+  {
+  public:
+    HeightPyramid();
+
+    // heights is a square grid with a power of two size, that wraps around at the borders like a texture with
+    // TEX_WRAP_REPEAT
+    void build(const uint16_t* heights, uint32_t size);
+
+    uint32_t get_size() const { return m_size; }
+    uint32_t get_levels() const { return (uint32_t)m_levels.size(); }
+    uint16_t get_max(uint32_t level, uint32_t x, uint32_t y) const { return m_levels[level][y * (m_size >> level) + x]; }
+
+    // All levels side by side in one image of 2 * size by size, level k at x offset 2 * size - 2 * (size >> k), the
+    // maximum in the red channel. 8 bit values are rounded up, so the image stays a conservative bound.
+    std::vector<uint32_t> pack_rgba8() const;
+
+  private:
+    std::vector<std::vector<uint16_t>> m_levels;
+    uint32_t m_size;
+  };
+
+// Loads the red channel of an image as 16 bit heights, 8 bit images are scaled to the full 16 bit range.
+// Returns false if the file cannot be read.
+bool load_heightmap(const std::string& filename, std::vector<uint16_t>& heights, uint32_t& width, uint32_t& height);
+
+struct TerrainRay
+  {
+  jtk::vec3<float> origin;
+  jtk::vec3<float> direction; // unit length
+  float max_distance;
+  };
+
+// The terrain on the CPU, for ground collision, radar altitude and terrain following. Positions and heights are in
+// meters in world space and map onto the heightmap like scalePosition and terrain() in the terrain shader: the map
+// covers [-100, 100] km in x and z, outside it the ground is flat at height 0. Heights are kept as 16 bit values in
+// tiles of 8x8 texels, so the four texels of a bilinear lookup mostly share 128 bytes. All queries are const and can
+// be called from many threads at once.
+class TerrainField
+  {
+  public:
+    TerrainField();
+
+    // heights as given by load_heightmap, a square grid with a power of two size
+    void build(const uint16_t* heights, uint32_t size);
+
+    uint32_t get_size() const { return m_size; }
+    const HeightPyramid& get_pyramid() const { return m_pyramid; }
+
+    // bilinearly interpolated height
+    float height(float x, float z) const;
+    void height(const float* x, const float* z, float* heights, std::size_t count) const;
+
+    // unit normal of the bilinearly interpolated heights
+    jtk::vec3<float> normal(float x, float z) const;
+
+    // Distance along the ray to the ground, 0 if the origin is below the ground, or a negative value if the ground is
+    // not hit within max_distance. Low terrain is skipped with the height pyramid, the bilinear patches that remain are
+    // intersected exactly.
+    float intersect(const TerrainRay& ray) const;
+    void intersect(const TerrainRay* rays, std::size_t count, float* distances) const;
+
+  private:
+    uint16_t _texel(int32_t x, int32_t y) const;
+    float _patch_intersect(const TerrainRay& ray, const jtk::vec2<float>& qo, const jtk::vec2<float>& qd, float t0, float t1) const;
+
+  private:
+    std::vector<uint16_t> m_tiles;
+    HeightPyramid m_pyramid;
+    uint32_t m_size;
+    uint32_t m_tiles_per_row;
+    float m_texels_per_meter;
+  };
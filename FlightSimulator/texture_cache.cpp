@@ -0,0 +1,168 @@
+#include "texture_cache.h"
+#include "determinism.h"
+
+#include "RenderDoos/render_engine.h"
+
+#include "stb/stb_image.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+  {
+  constexpr char magic[4] = { 'F', 'S', 'T', 'X' };
+  // bump when the baked layout or the way images are decoded changes
+  constexpr uint32_t version = 1;
+
+  struct header
+    {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t pixel_size;
+    uint32_t reserved[8];
+    };
+
+  static_assert(sizeof(header) == 64, "the pixel data should start 64 byte aligned");
+  }
+
+RenderDoos::texture_format native_texture_format(const std::string& image_filename)
+  {
+  return stbi_is_16_bit(image_filename.c_str()) ? RenderDoos::texture_format_rgba16 : RenderDoos::texture_format_rgba8;
+  }
+
+uint64_t texture_cache_key(const std::string& image_filename, RenderDoos::texture_format format)
+  {
+  const uint32_t f = static_cast<uint32_t>(format);
+  uint64_t h = physics::hash(&version, sizeof(version));
+  h = physics::hash(&f, sizeof(f), h);
+  return hash_file_stamp(image_filename, h);
+  }
+
+uint32_t baked_pixel_size(RenderDoos::texture_format format)
+  {
+  switch (format)
+    {
+    case RenderDoos::texture_format_rgba8: return 4;
+    case RenderDoos::texture_format_rgba16: return 8;
+    default: return 0;
+    }
+  }
+
+baked_texture::baked_texture() : m_data(nullptr), m_width(0), m_height(0), m_format(RenderDoos::texture_format_rgba8)
+  {
+  }
+
+bool baked_texture::load(const std::string& image_filename, RenderDoos::texture_format format)
+  {
+  const std::string cache_filename = image_filename + ".tex";
+  const uint64_t key = texture_cache_key(image_filename, format);
+  if (map(cache_filename, key))
+    return true;
+  if (!decode(image_filename, format))
+    return false;
+  // a read-only asset folder just means the image is decoded again next time
+  if (key)
+    write(cache_filename, key);
+  return true;
+  }
+
+bool baked_texture::map(const std::string& filename, uint64_t key)
+  {
+  clear();
+  if (key == 0 || !m_file.open(filename))
+    return false;
+  header h;
+  if (m_file.size() >= sizeof(header))
+    memcpy(&h, m_file.data(), sizeof(h));
+  if (m_file.size() < sizeof(header) || memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version || h.key != key ||
+    h.pixel_size == 0 || h.pixel_size != baked_pixel_size(static_cast<RenderDoos::texture_format>(h.format)) ||
+    m_file.size() != sizeof(header) + uint64_t(h.width) * h.height * h.pixel_size)
+    {
+    m_file.close();
+    return false;
+    }
+  m_data = m_file.data() + sizeof(header);
+  m_width = static_cast<int>(h.width);
+  m_height = static_cast<int>(h.height);
+  m_format = static_cast<RenderDoos::texture_format>(h.format);
+  return true;
+  }
+
+bool baked_texture::decode(const std::string& image_filename, RenderDoos::texture_format format)
+  {
+  clear();
+  const uint32_t pixel_size = baked_pixel_size(format);
+  if (pixel_size == 0)
+    return false;
+  int w, h, nr_of_channels;
+  void* im = (format == RenderDoos::texture_format_rgba16) ?
+    (void*)stbi_load_16(image_filename.c_str(), &w, &h, &nr_of_channels, 4) :
+    (void*)stbi_load(image_filename.c_str(), &w, &h, &nr_of_channels, 4);
+  if (!im)
+    return false;
+  m_pixels.resize(std::size_t(w) * h * pixel_size);
+  memcpy(m_pixels.data(), im, m_pixels.size());
+  stbi_image_free(im);
+  m_data = m_pixels.data();
+  m_width = w;
+  m_height = h;
+  m_format = format;
+  return true;
+  }
+
+bool baked_texture::write(const std::string& filename, uint64_t key) const
+  {
+  if (empty())
+    return false;
+  header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.key = key;
+  h.width = static_cast<uint32_t>(m_width);
+  h.height = static_cast<uint32_t>(m_height);
+  h.format = static_cast<uint32_t>(m_format);
+  h.pixel_size = baked_pixel_size(m_format);
+
+  // written under a temporary name, so that a reader never maps a partially written cache
+  const std::string tmp_filename = filename + ".tmp";
+  FILE* f = fopen(tmp_filename.c_str(), "wb");
+  if (!f)
+    return false;
+  const std::size_t size = std::size_t(m_width) * m_height * h.pixel_size;
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  ok = ok && fwrite(m_data, 1, size, f) == size;
+  ok = (fclose(f) == 0) && ok;
+  if (ok)
+    {
+    // rename does not replace an existing file on Windows
+    remove(filename.c_str());
+    ok = rename(tmp_filename.c_str(), filename.c_str()) == 0;
+    }
+  if (!ok)
+    remove(tmp_filename.c_str());
+  return ok;
+  }
+
+int32_t baked_texture::upload(RenderDoos::render_engine& engine) const
+  {
+  if (empty())
+    return -1;
+  if (m_format == RenderDoos::texture_format_rgba16)
+    return engine.add_texture(m_width, m_height, m_format, reinterpret_cast<const uint16_t*>(m_data));
+  return engine.add_texture(m_width, m_height, m_format, m_data);
+  }
+
+void baked_texture::clear()
+  {
+  m_file.close();
+  m_pixels = std::vector<uint8_t>();
+  m_data = nullptr;
+  m_width = 0;
+  m_height = 0;
+  m_format = RenderDoos::texture_format_rgba8;
+  }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include "RenderDoos/types.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace RenderDoos
+  {
+  class render_engine;
+  }
+
+// Baked textures: decoded pixels exactly as they are handed to add_texture, so loading an image is a memory mapped
+// file instead of a PNG or JPG decode. Supported formats are texture_format_rgba8 and texture_format_rgba16, the latter
+// keeps the full precision of 16 bit images, e.g. a 16 bit terrain heightmap.
+//
+// Layout: a 64 byte header, then width * height pixels, rows top to bottom.
+// The header stores a key of the source (see texture_cache_key). A cache file with another key or version, or a size
+// that does not match the header, is ignored and baked again.
+
+// texture_format_rgba16 for an image with 16 bits per channel, texture_format_rgba8 otherwise, so that 8 bit images
+// do not take twice the memory for no precision
+RenderDoos::texture_format native_texture_format(const std::string& image_filename);
+
+// Key of an image file decoded to format. Returns 0 if the file does not exist.
+uint64_t texture_cache_key(const std::string& image_filename, RenderDoos::texture_format format);
+
+// bytes per pixel of the formats that can be baked, 0 for the others
+uint32_t baked_pixel_size(RenderDoos::texture_format format);
+
+// Pixels laid out for add_texture, either mapped from a cache file or decoded in memory.
+// Filling the pixels does not touch the render engine, only upload does.
+class baked_texture
+  {
+  public:
+    baked_texture();
+
+    // Maps the cache next to the image (image_filename + ".tex"), or decodes the image and writes the cache when there
+    // is no valid one. Returns false if the image cannot be read.
+    bool load(const std::string& image_filename, RenderDoos::texture_format format);
+
+    // returns false if filename is not a valid cache for key
+    bool map(const std::string& filename, uint64_t key);
+    // decodes the image with stb_image, returns false if it cannot be read or format cannot be baked
+    bool decode(const std::string& image_filename, RenderDoos::texture_format format);
+    // returns false if the file could not be written
+    bool write(const std::string& filename, uint64_t key) const;
+
+    // Adds a texture to the engine with the pixels.
+    // Returns the texture id, or -1 if there are no pixels.
+    int32_t upload(RenderDoos::render_engine& engine) const;
+    void clear();
+
+    bool empty() const { return m_data == nullptr; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    RenderDoos::texture_format format() const { return m_format; }
+    const uint8_t* data() const { return m_data; }
+
+  private:
+    mapped_file m_file;
+    std::vector<uint8_t> m_pixels;
+    const uint8_t* m_data; // into m_file or m_pixels
+    int m_width, m_height;
+    RenderDoos::texture_format m_format;
+  };
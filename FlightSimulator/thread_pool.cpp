@@ -0,0 +1,161 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+ThreadPool::ThreadPool(std::size_t workers) : m_queued(0), m_next_queue(0), m_stop(false)
+  {
+  for (std::size_t i = 0; i < workers; ++i)
+    m_queues.emplace_back(new Queue());
+  m_workers.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i)
+    m_workers.emplace_back(&ThreadPool::_run, this, i);
+  }
+
+ThreadPool::~ThreadPool()
+  {
+    {
+    std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    m_stop = true;
+    }
+  m_wake.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+  }
+
+std::size_t ThreadPool::default_workers()
+  {
+  const std::size_t hardware = std::thread::hardware_concurrency();
+  return hardware > 1 ? hardware - 1 : 0;
+  }
+
+void ThreadPool::_push(std::size_t queue, std::function<void()> task)
+  {
+    {
+    // counted before the task becomes visible, so a thief that takes it right away cannot wrap m_queued below 0
+    std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+    ++m_queued;
+    m_queues[queue]->tasks.push_back(std::move(task));
+    }
+    {
+    // a worker checks m_queued under this mutex before it sleeps, so the notification cannot get lost
+    std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    }
+  m_wake.notify_one();
+  }
+
+bool ThreadPool::_pop(std::size_t queue, std::function<void()>& task)
+  {
+  std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+  if (m_queues[queue]->tasks.empty())
+    return false;
+  task = std::move(m_queues[queue]->tasks.back());
+  m_queues[queue]->tasks.pop_back();
+  --m_queued;
+  return true;
+  }
+
+bool ThreadPool::_steal(std::size_t thief, std::function<void()>& task)
+  {
+  const std::size_t n = m_queues.size();
+  for (std::size_t k = 1; k <= n; ++k)
+    {
+    const std::size_t victim = (thief + k) % n;
+    std::lock_guard<std::mutex> lock(m_queues[victim]->mutex);
+    if (m_queues[victim]->tasks.empty())
+      continue;
+    task = std::move(m_queues[victim]->tasks.front());
+    m_queues[victim]->tasks.pop_front();
+    --m_queued;
+    return true;
+    }
+  return false;
+  }
+
+void ThreadPool::_run(std::size_t index)
+  {
+  for (;;)
+    {
+    std::function<void()> task;
+    if (_pop(index, task) || _steal(index, task))
+      {
+      task();
+      continue;
+      }
+    std::unique_lock<std::mutex> lock(m_sleep_mutex);
+    m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+    if (m_stop && m_queued == 0)
+      return;
+    }
+  }
+
+void ThreadPool::submit(std::function<void()> task)
+  {
+  if (m_workers.empty())
+    {
+    task();
+    return;
+    }
+  _push(m_next_queue++ % m_queues.size(), std::move(task));
+  }
+
+void ThreadPool::parallel_for(std::size_t n, std::size_t chunk_size, const std::function<void(std::size_t, std::size_t)>& fn)
+  {
+  if (chunk_size == 0)
+    chunk_size = 1;
+  const std::size_t chunks = (n + chunk_size - 1) / chunk_size;
+  if (m_workers.empty() || chunks <= 1)
+    {
+    for (std::size_t begin = 0; begin < n; begin += chunk_size)
+      fn(begin, std::min(begin + chunk_size, n));
+    return;
+    }
+
+  struct State
+    {
+    std::size_t remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+    } state;
+  state.remaining = chunks;
+
+  // deal the chunks out round robin, idle workers rebalance by stealing
+  const std::size_t first_queue = m_next_queue++;
+  for (std::size_t c = 0; c < chunks; ++c)
+    {
+    const std::size_t begin = c * chunk_size;
+    const std::size_t end = std::min(begin + chunk_size, n);
+    _push((first_queue + c) % m_queues.size(), [&state, &fn, begin, end]
+      {
+      std::exception_ptr error;
+      try
+        {
+        fn(begin, end);
+        }
+      catch (...)
+        {
+        error = std::current_exception();
+        }
+      // the decrement happens under the lock, so state outlives every task that still touches it
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (error && !state.error)
+        state.error = error;
+      if (--state.remaining == 0)
+        state.done.notify_all();
+      });
+    }
+
+  // the calling thread helps out until there is nothing left to steal
+  std::function<void()> task;
+  while (_steal(m_queues.size() - 1, task))
+    {
+    task();
+    task = nullptr;
+    }
+
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.done.wait(lock, [&state] { return state.remaining == 0; });
+  if (state.error)
+    std::rethrow_exception(state.error);
+  }
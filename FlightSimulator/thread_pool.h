@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a task queue: it pops its own tasks from the back,
+// and steals from the front of the other queues when it runs out of work.
+class ThreadPool
+  {
+  public:
+    // workers is the number of threads besides the calling thread, which also executes tasks in parallel_for
+    explicit ThreadPool(std::size_t workers = default_workers());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    // number of threads that execute tasks in parallel_for, including the caller
+    std::size_t concurrency() const { return m_workers.size() + 1; }
+
+    // calls fn(begin, end) for consecutive chunks of [0, n) of at most chunk_size elements, and returns when all
+    // chunks are done. The first exception thrown by fn is rethrown in the calling thread.
+    void parallel_for(std::size_t n, std::size_t chunk_size, const std::function<void(std::size_t, std::size_t)>& fn);
+
+    // runs task on one of the workers, or immediately when the pool has no workers
+    void submit(std::function<void()> task);
+
+    static std::size_t default_workers();
+
+  private:
+    struct Queue
+      {
+      std::mutex mutex;
+      std::deque<std::function<void()>> tasks;
+      };
+
+    void _push(std::size_t queue, std::function<void()> task);
+    bool _pop(std::size_t queue, std::function<void()>& task);
+    bool _steal(std::size_t thief, std::function<void()>& task);
+    void _run(std::size_t index);
+
+  private:
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<std::size_t> m_queued;
+    std::atomic<std::size_t> m_next_queue;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+    bool m_stop;
+  };
@@ -1,6 +1,9 @@
 #include "view.h"
 #include <stdexcept>
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <string>
 
 #if defined(RENDERDOOS_METAL)
 #define NS_PRIVATE_IMPLEMENTATION
@@ -16,13 +19,38 @@
 
 #include <thread>
 
+#include "aircraft_type.h"
+#include "asset_loader.h"
 #include "scene.h"
 #include "flightmodel.h"
 #include "material.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "render_scale.h"
+#include "simulation.h"
+#include "terrain.h"
+#include "thread_pool.h"
 
 #include "RenderDoos/types.h"
 #include "RenderDoos/float.h"
 
+namespace
+  {
+  // low discrepancy sequence for the subpixel jitter of the terrain rays
+  float halton(uint32_t index, uint32_t base)
+    {
+    float f = 1.f;
+    float r = 0.f;
+    while (index > 0)
+      {
+      f /= (float)base;
+      r += f * (float)(index % base);
+      index /= base;
+      }
+    return r;
+    }
+  }
+
 struct Joystick
   {
   float roll = 0;
@@ -31,8 +59,24 @@ struct Joystick
   float throttle = 0;
   };
 
-view::view(int /*argc*/, char** /*argv*/) : _w(1600), _h(900), _quit(false)
+view::view(int argc, char** argv) : _w(1600), _h(900), _quit(false), _physics_rate(500.f), _frame_budget_ms(12.f), _aircraft_filename("assets/aircraft/default.json")
   {
+  for (int i = 1; i < argc; ++i)
+    {
+    if (std::string(argv[i]) == "--physics-rate" && i + 1 < argc)
+      _physics_rate = (float)std::atof(argv[++i]);
+    else if (std::string(argv[i]) == "--frame-budget" && i + 1 < argc)
+      _frame_budget_ms = (float)std::atof(argv[++i]);
+    else if (std::string(argv[i]) == "--record" && i + 1 < argc)
+      _record_filename = argv[++i];
+    else if (std::string(argv[i]) == "--aircraft" && i + 1 < argc)
+      _aircraft_filename = argv[++i];
+    }
+  if (_physics_rate <= 0.f)
+    throw std::runtime_error("physics rate should be positive");
+  if (_frame_budget_ms < 0.f)
+    throw std::runtime_error("frame budget should not be negative");
+
   // Setup window
 #if defined(RENDERDOOS_METAL)
   SDL_SetHint(SDL_HINT_RENDER_DRIVER, "metal");
@@ -93,63 +137,71 @@ view::~view()
 
 void view::loop()
   {
-  const float mass = 10000.0f;
-  const float thrust = 20000.0f;
-
-  std::vector<physics::inertia::element> elements = {
-    physics::inertia::cube_element({-2.7f,  0.0f, -0.5f}, {3.50f, 0.10f, 6.96f}, mass * 0.25f),               // left wing
-    physics::inertia::cube_element({-2.0f,  0.0f,  0.0f}, {1.26f, 0.10f, 3.80f}, mass * 0.05f),               // left aileron
-    physics::inertia::cube_element({ 2.0f,  0.0f,  0.0f}, {1.26f, 0.10f, 3.80f}, mass * 0.05f),               // right aileron
-    physics::inertia::cube_element({ 2.7f,  0.0f, -0.5f}, {3.50f, 0.10f, 6.96f}, mass * 0.25f),               // right wing
-    physics::inertia::cube_element({ 0.0f, -0.1f, -6.6f}, {2.70f, 0.10f, 6.54f}, mass * 0.2f),                // elevator
-    physics::inertia::cube_element({ 0.0f,  0.0f, -6.6f}, {0.10f, 3.10f, 5.31f}, mass * 0.2f),                // rudder
-    };
-
-  auto inertia = physics::inertia::tensor({ 500000.f, 400000.f, 100000.f });
-  auto inertia_tensor = physics::inertia::tensor(elements, true);
-
-  std::vector<Wing> wings = {
-  Wing({-2.7f,   0.0f, -0.5f}, 6.96f, 3.50f, &NACA_2412),              // left wing
-  Wing({-2.0f,   0.0f,  0.0f},  3.80f, 1.26f, &NACA_0012),              // left aileron
-  Wing({ 2.0f,   0.0f,  0.0f},  3.80f, 1.26f, &NACA_0012),              // right aileron
-  Wing({ 2.7f,   0.0f, -0.5f}, 6.96f, 3.50f, &NACA_2412),              // right wing
-  Wing({ 0.0f, -0.1f, -6.6f},  6.54f, 2.70f, &NACA_0012),              // elevator
-  Wing({ 0.0f,  0.0f, -6.6f},  5.31f, 3.10f, &NACA_0012, physics::RIGHT),  // rudder
-    };
-
-  jtk::vec3<float> position = jtk::vec3<float>(0.0f, 4000.0f, 0.0f);
-  jtk::vec3<float> velocity = jtk::vec3<float>(0.0f, 0.0f, physics::units::meter_per_second(600.0f));
-
-  Aircraft aircraft(mass, thrust, inertia_tensor, wings);
-  aircraft.rigid_body.set_position(position);
-  aircraft.rigid_body.set_velocity(velocity);
-
-  mesh fuselage;
-  fuselage.init_from_ply_file(_engine, "assets/models/fuselage.ply", 0, physics::units::radians(90.f), 0.f);
-  mesh propeller;
-  propeller.init_from_ply_file(_engine, "assets/models/propeller.ply", 0, physics::units::radians(90.f), 0.f);
-
-  texture colors;
-  colors.init_from_file(_engine, "assets/textures/colors.png");
-
-  texture cross;
-  cross.init_from_file(_engine, "assets/textures/cross.png");
-
-  texture fpm;
-  fpm.init_from_file(_engine, "assets/textures/fpm.png");
-
-  sprite_material sprite_mat;
-  sprite_mat.compile(&_engine);
+  Aircraft aircraft = create_default_aircraft(load_aircraft_type(_aircraft_filename));
 
+  TerrainField terrain_field;
+  mesh fuselage, propeller;
+  texture colors, cross, fpm;
   cubemap skybox;
-  skybox.init_from_file(_engine,
+  texture heightmap, normalmap, colormap, noise, max_heightmap;
+
+  // files are decoded on the pool while the shaders compile, the uploads happen on this thread.
+  // The loader comes after the assets, so that it waits for its tasks before the assets go out of scope.
+  ThreadPool pool;
+  asset_loader loader(pool);
+
+  // the heightmap is decoded once, for the shader and for the terrain field. A 16 bit image keeps its precision on the
+  // GPU, an 8 bit image stays at 8 bits there; the terrain field gets 16 bit heights either way, like load_heightmap.
+  loader.load([&]
+    {
+    const std::string heightmap_filename = "assets/textures/terrain/heightmap.png";
+    const RenderDoos::texture_format heightmap_format = native_texture_format(heightmap_filename);
+    heightmap.decode_file(heightmap_filename, heightmap_format);
+    if (heightmap.baked.empty() || heightmap.w != heightmap.h)
+      throw std::runtime_error("the terrain heightmap should be a square image");
+    std::vector<uint16_t> heights((std::size_t)heightmap.w * heightmap.h);
+    if (heightmap_format == RenderDoos::texture_format_rgba16)
+      {
+      const uint16_t* rgba = reinterpret_cast<const uint16_t*>(heightmap.baked.data());
+      for (std::size_t i = 0; i < heights.size(); ++i)
+        heights[i] = rgba[i * 4];
+      }
+    else
+      {
+      // 255 maps to 65535, as stbi_load_16 widens 8 bit images
+      const uint8_t* rgba = heightmap.baked.data();
+      for (std::size_t i = 0; i < heights.size(); ++i)
+        heights[i] = static_cast<uint16_t>(rgba[i * 4] * 257);
+      }
+    terrain_field.build(heights.data(), heightmap.w);
+    },
+    [&](RenderDoos::render_engine& engine)
+    {
+    heightmap.upload(engine);
+    max_heightmap.init_from_height_pyramid(engine, terrain_field.get_pyramid());
+    });
+
+  loader.load(fuselage, "assets/models/fuselage.ply", 0, physics::units::radians(90.f), 0.f);
+  loader.load(propeller, "assets/models/propeller.ply", 0, physics::units::radians(90.f), 0.f);
+
+  loader.load(colors, "assets/textures/colors.png");
+  loader.load(cross, "assets/textures/cross.png");
+  loader.load(fpm, "assets/textures/fpm.png");
+
+  loader.load(skybox, {
     "assets/textures/skybox/front.jpg",
     "assets/textures/skybox/back.jpg",
     "assets/textures/skybox/left.jpg",
     "assets/textures/skybox/right.jpg",
     "assets/textures/skybox/top.jpg",
     "assets/textures/skybox/bottom.jpg"
-  );
+    });
+
+  loader.load(normalmap, "assets/textures/terrain/normalmap.png");
+  loader.load(colormap, "assets/textures/terrain/colormap.png");
+
+  sprite_material sprite_mat;
+  sprite_mat.compile(&_engine);
 
   simple_material mat;
   mat.compile(&_engine);
@@ -160,26 +212,45 @@ void view::loop()
   font_material fmat;
   fmat.compile(&_engine);
 
+  loader.wait_all(_engine);
+
+  FlightRecorder recorder;
+  Simulation simulation(aircraft, _physics_rate, &terrain_field);
+  if (!_record_filename.empty())
+    {
+    if (!recorder.open(_record_filename, simulation.get_step(), aircraft.type->name))
+      throw std::runtime_error("cannot create flight recording " + _record_filename);
+    simulation.set_recorder(&recorder);
+    }
+
   terrain_material tmat;
-  texture heightmap, normalmap, colormap, noise;
-  heightmap.init_from_file(_engine, "assets/textures/terrain/heightmap.png");
-  normalmap.init_from_file(_engine, "assets/textures/terrain/normalmap.png");
-  colormap.init_from_file(_engine, "assets/textures/terrain/colormap.png");
   noise.init_from_noise(_engine, heightmap.w, heightmap.h, 0);
   tmat.set_texture_colormap(colormap.texture_id);
   tmat.set_texture_heightmap(heightmap.texture_id);
   tmat.set_texture_normalmap(normalmap.texture_id);
   tmat.set_texture_noise(noise.texture_id);
+  tmat.set_texture_max_heightmap(max_heightmap.texture_id);
   tmat.set_resolution(_w / 2, _h / 2);
   tmat.compile(&_engine);
 
   blit_material bmat;
   bmat.compile(&_engine);
 
+  temporal_upsample_material umat;
+  umat.compile(&_engine);
+
   uint32_t framebuffer_id = _engine.add_frame_buffer(_w, _h, true);
 
   uint32_t framebuffer_heightmap_id = _engine.add_frame_buffer(tmat.get_resolution_width(), tmat.get_resolution_height(), false);
 
+  // full resolution terrain reconstructed by umat, ping-ponged between this frame and the previous one
+  uint32_t framebuffer_terrain_ids[2] = { (uint32_t)_engine.add_frame_buffer(_w, _h, false), (uint32_t)_engine.add_frame_buffer(_w, _h, false) };
+  int terrain_history = 0;
+  bool terrain_history_valid = false;
+  jtk::float4x4 previous_terrain_camera = jtk::get_identity();
+  render_scale_controller terrain_scale(_frame_budget_ms, (float)tmat.get_resolution_width() / (float)_w);
+  uint32_t frame_index = 0;
+
   uint32_t quad_id = _engine.add_geometry(VERTEX_STANDARD);
   RenderDoos::vertex_standard* vp;
   uint32_t* ip;
@@ -246,6 +317,13 @@ void view::loop()
   cam.set_position(0, 1, 0);
   cam.set_rotation(0, 0.f, 0.f);
 
+  profiler prof;
+  prof.init(&_engine);
+  profiler_overlay prof_overlay;
+  prof_overlay.init(&_engine);
+  bool show_profiler = false;
+  double last_physics_total_ms = 0.0;
+
   float orbit_yaw = 0.f;
   float orbit_pitch = 0.f;
 
@@ -253,14 +331,9 @@ void view::loop()
   float propeller_rotation = 0.f;
   int time_speedup = 1;
 
-  auto last_tic = std::chrono::high_resolution_clock::now();
-  auto start = last_tic;
+  simulation.start();
   while (!_quit)
     {
-    auto tic = std::chrono::high_resolution_clock::now();
-    float dt = (float)(std::chrono::duration_cast<std::chrono::microseconds>(tic - last_tic).count()) / 1000000.f;
-    if (dt > 0.02f)
-      dt = 0.02f;
     SDL_Event event;
     while (SDL_PollEvent(&event))
       {
@@ -298,6 +371,12 @@ void view::loop()
           time_speedup += 1;
           break;
           }
+          case SDLK_p:
+            show_profiler = !show_profiler;
+            break;
+          case SDLK_t:
+            prof.write_chrome_trace("profile.json");
+            break;
           case SDLK_o:
             cam.set_position(0, 1, 0);
             cam.set_rotation(0, 0, 0.f);
@@ -352,11 +431,29 @@ void view::loop()
       joystick.throttle = physics::utils::clamp(joystick.throttle, 0.0f, 1.0f);
       }
 
-    aircraft.joystick = jtk::vec3<float>(joystick.pitch, joystick.yaw, joystick.roll);
-    aircraft.engine.throttle = joystick.throttle;
+    Controls controls;
+    controls.joystick = jtk::vec3<float>(joystick.pitch, joystick.yaw, joystick.roll);
+    controls.throttle = joystick.throttle;
+    controls.time_speedup = time_speedup;
+    simulation.set_controls(controls);
+
+    prof.frame_begin();
+
+    const AircraftSnapshot state = simulation.get_snapshot();
+    const SimulationStatistics physics_statistics = simulation.get_statistics();
+    // all steps since the last frame, also those of batches that the triple buffer dropped; in the trace they show
+    // as one event that ends with the last batch
+    if (physics_statistics.total_ms > last_physics_total_ms)
+      {
+      using std::chrono::duration_cast;
+      typedef std::chrono::duration<double, std::milli> milliseconds;
+      const double physics_ms = physics_statistics.total_ms - last_physics_total_ms;
+      const auto physics_end = physics_statistics.batch_start + duration_cast<std::chrono::steady_clock::duration>(milliseconds(physics_statistics.batch_ms));
+      const auto physics_start = physics_end - duration_cast<std::chrono::steady_clock::duration>(milliseconds(physics_ms));
+      prof.record("physics", physics_start, physics_ms, profiler::simulation_thread);
+      last_physics_total_ms = physics_statistics.total_ms;
+      }
 
-    for (int i = 0; i < time_speedup; ++i)
-      aircraft.update(dt);
     if (orbit)
       {
       const jtk::vec3<float> center(0);
@@ -365,17 +462,17 @@ void view::loop()
       jtk::vec3<float> front = jtk::get_z_axis(orientation);
       auto offset = jtk::normalize(front) * radius;
       jtk::vec3<float> pos = center + offset;
-      pos = aircraft.rigid_body.inverse_transform_direction(pos);
+      pos = state.inverse_transform_direction(pos);
       cam.set_position(pos.x, pos.y, -pos.z);
       jtk::vec3<float> up(0, 1, 0);
-      up = aircraft.rigid_body.inverse_transform_direction(up);
+      up = state.inverse_transform_direction(up);
       up.z *= -1;
       cam.set_up(up);
       cam.look_at(center);
       }
     else
       {
-      cam.set_position(0.0f, 3.0f + aircraft.rigid_body.get_angular_velocity().x * 1.0f, 15.0f);
+      cam.set_position(0.0f, 3.0f + state.angular_velocity.x * 1.0f, 15.0f);
       }
 
     RenderDoos::render_drawables drawables;
@@ -393,11 +490,23 @@ void view::loop()
     jtk::float4x4 view_matrix = jtk::get_identity();
     jtk::vec3<float> light(0);
 
+    if (_frame_budget_ms > 0.f && prof.has_gpu_timer() && terrain_scale.update(prof.get_gpu_frame_ms()))
+      {
+      _engine.remove_frame_buffer(framebuffer_heightmap_id);
+      tmat.set_resolution(std::max<uint32_t>(1, (uint32_t)(_w * terrain_scale.get_scale())), std::max<uint32_t>(1, (uint32_t)(_h * terrain_scale.get_scale())));
+      framebuffer_heightmap_id = _engine.add_frame_buffer(tmat.get_resolution_width(), tmat.get_resolution_height(), false);
+      }
+    const float jitter_x = halton(frame_index % 8 + 1, 2) - 0.5f;
+    const float jitter_y = halton(frame_index % 8 + 1, 3) - 0.5f;
+    tmat.set_jitter(jitter_x, jitter_y);
+
     //////////////////////
     /// Terrain pass
     //////////////////////
     _engine.frame_begin(drawables);
 
+    int32_t pass = prof.begin("terrain", true);
+
     RenderDoos::renderpass_descriptor descr;
     descr.clear_color = 0xff203040;
     descr.clear_flags = CLEAR_COLOR | CLEAR_DEPTH;
@@ -428,26 +537,26 @@ void view::loop()
       view_matrix[10] *= -1;
 
       float scale = 1.f / 1000.f;
-      view_matrix[12] = aircraft.rigid_body.get_position().x * scale;
-      view_matrix[13] = aircraft.rigid_body.get_position().y * scale;
-      view_matrix[14] = aircraft.rigid_body.get_position().z * scale;
+      view_matrix[12] = state.position.x * scale;
+      view_matrix[13] = state.position.y * scale;
+      view_matrix[14] = state.position.z * scale;
       }
     else
       {
       xa = jtk::vec3<float>(1, 0, 0);
       ya = jtk::vec3<float>(0, 1, 0);
       za = jtk::vec3<float>(0, 0, 1);
-      xa = aircraft.rigid_body.transform_direction(xa);
-      ya = aircraft.rigid_body.transform_direction(ya);
-      za = aircraft.rigid_body.transform_direction(za);
+      xa = state.transform_direction(xa);
+      ya = state.transform_direction(ya);
+      za = state.transform_direction(za);
       jtk::set_x_axis(view_matrix, xa);
       jtk::set_y_axis(view_matrix, ya);
       jtk::set_z_axis(view_matrix, za);
       //view_matrix = jtk::matrix_matrix_multiply(cam.get_view_matrix(), view_matrix);
       float scale = 1.f / 1000.f;
-      view_matrix[12] = aircraft.rigid_body.get_position().x * scale;
-      view_matrix[13] = aircraft.rigid_body.get_position().y * scale;
-      view_matrix[14] = aircraft.rigid_body.get_position().z * scale;
+      view_matrix[12] = state.position.x * scale;
+      view_matrix[13] = state.position.y * scale;
+      view_matrix[14] = state.position.z * scale;
       }
 
     //tmat.bind(&_engine, &cam.get_projection_matrix()[0], &view_matrix[0], &light[0]);
@@ -455,10 +564,32 @@ void view::loop()
     _engine.geometry_draw(quad_id);
 
     _engine.renderpass_end();
+    prof.end(pass);
+    jtk::float4x4 terrain_camera = view_matrix;
+
+    //////////////////////
+    /// Terrain upsample pass
+    //////////////////////
+    pass = prof.begin("terrain upsample", true);
+    descr.clear_flags = 0;
+    descr.w = _w;
+    descr.h = _h;
+    descr.frame_buffer_handle = framebuffer_terrain_ids[terrain_history];
+    _engine.renderpass_begin(descr);
+    umat.set_textures(_engine.get_frame_buffer(framebuffer_heightmap_id)->texture_handle, _engine.get_frame_buffer(framebuffer_terrain_ids[1 - terrain_history])->texture_handle);
+    umat.set_reprojection(&terrain_camera[0], &previous_terrain_camera[0]);
+    umat.set_jitter(jitter_x, jitter_y, tmat.get_resolution_width(), tmat.get_resolution_height());
+    umat.set_history_weight(terrain_history_valid ? 0.9f : 0.f);
+    view_matrix = jtk::get_identity();
+    umat.bind(&_engine, &projection_ortho[0], &view_matrix[0], nullptr);
+    _engine.geometry_draw(quad_id);
+    _engine.renderpass_end();
+    prof.end(pass);
 
     //////////////////////
     /// Skybox pass
     //////////////////////
+    pass = prof.begin("skybox", true);
     descr.clear_color = 0xff203040;
     descr.clear_flags = CLEAR_COLOR | CLEAR_DEPTH;
     descr.w = _w;
@@ -490,9 +621,9 @@ void view::loop()
       xa = jtk::vec3<float>(1, 0, 0);
       ya = jtk::vec3<float>(0, -1, 0);
       za = jtk::vec3<float>(0, 0, 1);
-      xa = aircraft.rigid_body.inverse_transform_direction(xa);
-      ya = aircraft.rigid_body.inverse_transform_direction(ya);
-      za = aircraft.rigid_body.inverse_transform_direction(za);
+      xa = state.inverse_transform_direction(xa);
+      ya = state.inverse_transform_direction(ya);
+      za = state.inverse_transform_direction(za);
       jtk::set_x_axis(view_matrix, xa);
       jtk::set_y_axis(view_matrix, ya);
       jtk::set_z_axis(view_matrix, za);
@@ -502,43 +633,49 @@ void view::loop()
     cmat.bind(&_engine, &projection_skybox[0], &view_matrix[0], &light[0]);
     _engine.geometry_draw(skybox.geometry_id);
     _engine.renderpass_end();
+    prof.end(pass);
 
     //////////////////////
     /// Blit terrain pass
     //////////////////////
+    pass = prof.begin("blit terrain", true);
 
     descr.frame_buffer_handle = framebuffer_id;
     descr.clear_flags = CLEAR_DEPTH;
 
     _engine.renderpass_begin(descr);
 
-    bmat.set_textures(_engine.get_frame_buffer(framebuffer_heightmap_id)->texture_handle, _engine.get_frame_buffer(framebuffer_id)->texture_handle, TEX_WRAP_REPEAT | TEX_FILTER_NEAREST);
+    bmat.set_textures(_engine.get_frame_buffer(framebuffer_terrain_ids[terrain_history])->texture_handle, _engine.get_frame_buffer(framebuffer_id)->texture_handle, TEX_WRAP_REPEAT | TEX_FILTER_NEAREST);
     view_matrix = jtk::get_identity();
     light = jtk::vec3<float>(0, 0, 1);
     bmat.bind(&_engine, &projection_ortho[0], &view_matrix[0], &light[0]);
     _engine.geometry_draw(quad_id);
 
     _engine.renderpass_end();
+    prof.end(pass);
 
     //////////////////////
     /// Aircraft pass
     //////////////////////
+    pass = prof.begin("aircraft", true);
 
     mat.set_texture(colors.texture_id, TEX_WRAP_REPEAT | TEX_FILTER_LINEAR);
     descr.clear_flags = CLEAR_DEPTH;
     _engine.renderpass_begin(descr);
     view_matrix = cam.get_view_matrix();
     light = jtk::normalize(jtk::vec3<float>(0, 1, 0));
-    light = aircraft.rigid_body.inverse_transform_direction(light);
+    light = state.inverse_transform_direction(light);
     light = physics::utils::transform_vector(view_matrix, light);
     mat.bind(&_engine, &cam.get_projection_matrix()[0], &view_matrix[0], &light[0]);
     _engine.geometry_draw(fuselage.geometry_id);
     _engine.renderpass_end();
+    prof.end(pass);
 
 
     //////////////////////
     /// Propeller pass
     //////////////////////
+    pass = prof.begin("propeller", true);
 
     descr.clear_flags = 0;
     _engine.renderpass_begin(descr);
@@ -553,6 +690,7 @@ void view::loop()
     _engine.geometry_draw(propeller.geometry_id);
 
     _engine.renderpass_end();
+    prof.end(pass);
 
     if (!orbit)
       {
@@ -561,6 +699,7 @@ void view::loop()
       //////////////////////
 
       const float cross_scale = 0.05;
+      pass = prof.begin("cross", true);
       descr.clear_flags = CLEAR_DEPTH;
       _engine.renderpass_begin(descr);
       view_matrix = jtk::get_identity();
@@ -570,11 +709,13 @@ void view::loop()
       sprite_mat.bind(&_engine, &projection_ortho[0], &view_matrix[0], nullptr);
       _engine.geometry_draw(quad_id);
       _engine.renderpass_end();
+      prof.end(pass);
+      pass = prof.begin("fpm", true);
       _engine.renderpass_begin(descr);
       view_matrix = jtk::get_identity();
       view_matrix[0] *= cross_scale;
       view_matrix[5] *= cross_scale;
-      jtk::vec3<float> dir = jtk::normalize(aircraft.rigid_body.get_body_velocity());
+      jtk::vec3<float> dir = jtk::normalize(state.get_body_velocity());
       view_matrix[12] = dir.x*1.0;
       view_matrix[13] = dir.y*1.0;
       //view_matrix[14] = dir.z;      
@@ -582,6 +723,7 @@ void view::loop()
       sprite_mat.bind(&_engine, &projection_ortho[0], &view_matrix[0], nullptr);
       _engine.geometry_draw(quad_id);
       _engine.renderpass_end();
+      prof.end(pass);
 
       _engine.set_blending_enabled(false);
 
@@ -591,12 +733,20 @@ void view::loop()
     /// Text info pass
     //////////////////////
 
-    std::stringstream feedback_text_str;
-    feedback_text_str << "speed: " << (int)physics::units::kilometer_per_hour(jtk::length(aircraft.rigid_body.get_velocity())) << "km/h\n";
-    feedback_text_str << "alt: " << (int)aircraft.rigid_body.get_position().y << "m\n";
-    feedback_text_str << "throttle: " << (double)((int)(aircraft.engine.throttle * 100)) / 100.0;
-    std::string feedback_text = feedback_text_str.str();
-    fmat.prepare_text(&_engine, feedback_text.c_str(), -1.0, -0.9, 2.0 / (double)_w, 2.0 / (double)_h, 0xffffffff);
+    pass = prof.begin("text", true);
+    const float text_sx = 2.f / (float)_w;
+    const float text_sy = 2.f / (float)_h;
+    fmat.clear_text();
+    float text_y = -0.9f;
+    text_y = fmat.add_textf(-1.f, text_y, text_sx, text_sy, 0xffffffff, "speed: %dkm/h", (int)physics::units::kilometer_per_hour(jtk::length(state.velocity)));
+    text_y = fmat.add_textf(-1.f, text_y, text_sx, text_sy, 0xffffffff, "alt: %dm", (int)state.position.y);
+    text_y = fmat.add_textf(-1.f, text_y, text_sx, text_sy, 0xffffffff, "radar alt: %dm", (int)(state.position.y - terrain_field.height(state.position.x, state.position.z)));
+    if (state.crashed)
+      text_y = fmat.add_textf(-1.f, text_y, text_sx, text_sy, 0xff0000ff, "CRASHED");
+    text_y = fmat.add_textf(-1.f, text_y, text_sx, text_sy, 0xffffffff, "throttle: %.2f", (double)((int)(state.throttle * 100)) / 100.0);
+    if (show_profiler)
+      prof_overlay.add_text(fmat, prof, -1.f, text_y, text_sx, text_sy);
+    fmat.upload_text(&_engine);
 
     descr.clear_flags = CLEAR_DEPTH;
     _engine.renderpass_begin(descr);
@@ -605,11 +755,29 @@ void view::loop()
     fmat.render_text(&_engine);
     _engine.renderpass_end();
     _engine.set_blending_enabled(false);
+    prof.end(pass);
+
+    if (show_profiler)
+      {
+      //////////////////////
+      /// Profiler pass
+      //////////////////////
+
+      pass = prof.begin("profiler", true);
+      prof_overlay.update(&_engine, prof, 0.2f, -0.95f, 0.75f, 0.4f, 33.3f);
+      descr.clear_flags = 0;
+      _engine.renderpass_begin(descr);
+      prof_overlay.draw(&_engine, sprite_mat, &projection_ortho[0]);
+      _engine.renderpass_end();
+      _engine.set_blending_enabled(false);
+      prof.end(pass);
+      }
 
     //////////////////////
     /// Blit to screen pass
     //////////////////////
 
+    pass = prof.begin("blit to screen", true);
     descr.frame_buffer_handle = -1;
     descr.clear_color = 0xff00ffff;
     descr.clear_flags = CLEAR_COLOR | CLEAR_DEPTH;
@@ -623,28 +791,39 @@ void view::loop()
     _engine.geometry_draw(quad_id);
 
     _engine.renderpass_end();
+    prof.end(pass);
 
     _engine.frame_end();
 
 
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(10.0));
-
 #if defined(RENDERDOOS_OPENGL)
     SDL_GL_SwapWindow(_window);
 #endif
-    last_tic = tic;
+    prof.frame_end();
+
+    previous_terrain_camera = terrain_camera;
+    terrain_history = 1 - terrain_history;
+    terrain_history_valid = true;
+    ++frame_index;
     }
 
+  simulation.stop();
+
+  prof_overlay.destroy(&_engine);
+  prof.destroy();
+
   mat.destroy(&_engine);
   cmat.destroy(&_engine);
   tmat.destroy(&_engine);
   bmat.destroy(&_engine);
+  umat.destroy(&_engine);
   fmat.destroy(&_engine);
   sprite_mat.destroy(&_engine);
   heightmap.cleanup(_engine);
   normalmap.cleanup(_engine);
   colormap.cleanup(_engine);
   noise.cleanup(_engine);
+  max_heightmap.cleanup(_engine);
   skybox.cleanup(_engine);
   fuselage.cleanup(_engine);
   propeller.cleanup(_engine);
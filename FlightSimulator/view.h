@@ -7,6 +7,8 @@
 #include "RenderDoos/render_engine.h"
 #include "RenderDoos/material.h"
 
+#include <string>
+
 class view
   {
   public:
@@ -22,5 +24,9 @@ class view
     #endif
     uint32_t _w, _h;
     bool _quit;
+    float _physics_rate; // Hz
+    float _frame_budget_ms; // gpu time per frame the terrain resolution adapts to, 0 for a fixed resolution
+    std::string _record_filename; // flight recording, empty for none
+    std::string _aircraft_filename; // aircraft definition, see aircraft_type.h
     RenderDoos::render_engine _engine;   
   };
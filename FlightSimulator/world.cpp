@@ -0,0 +1,63 @@
+#include "world.h"
+#include "determinism.h"
+
+namespace
+  {
+  // the state of an aircraft takes less than a hundred bytes, and the shared type data stays in the cache of the
+  // core that steps a chunk, so chunks of this size still fit in the L1/L2 cache
+  constexpr std::size_t max_chunk_size = 256;
+
+  // enough chunks per thread for stealing to even out aircraft that take longer, e.g. while tumbling
+  constexpr std::size_t chunks_per_thread = 4;
+  }
+
+World::World(ThreadPool& pool, std::size_t chunk_size) : m_pool(pool), m_chunk_size(chunk_size), m_terrain(nullptr)
+  {
+  }
+
+std::size_t World::add(const Aircraft& aircraft)
+  {
+  return add(aircraft.type, aircraft.state);
+  }
+
+std::size_t World::add(std::shared_ptr<const AircraftType> type, const AircraftState& state)
+  {
+  // fleets have a few dozen types at most
+  bool known = false;
+  for (const auto& t : m_types)
+    known = known || t == type;
+  if (!known)
+    m_types.push_back(type);
+  m_states.push_back(state);
+  m_type.push_back(type.get());
+  return m_states.size() - 1;
+  }
+
+void World::reserve(std::size_t capacity)
+  {
+  m_states.reserve(capacity);
+  m_type.reserve(capacity);
+  }
+
+std::size_t World::_chunk_size() const
+  {
+  if (m_chunk_size > 0)
+    return m_chunk_size;
+  const std::size_t chunks = m_pool.concurrency() * chunks_per_thread;
+  const std::size_t size = (m_states.size() + chunks - 1) / chunks;
+  return physics::utils::clamp<std::size_t>(size, 1, max_chunk_size);
+  }
+
+void World::step(physics::seconds dt)
+  {
+  m_pool.parallel_for(m_states.size(), _chunk_size(), [this, dt](std::size_t begin, std::size_t end)
+    {
+    // the pool threads do not inherit the floating point environment of the caller
+    physics::fp_environment fp;
+    // one scratch per thread, which keeps its buffers from step to step and from chunk to chunk; step_aircraft
+    // resizes them to the type of each aircraft
+    thread_local AircraftScratch scratch;
+    for (std::size_t i = begin; i < end; ++i)
+      step_aircraft(*m_type[i], m_states[i], dt, m_terrain, scratch);
+    });
+  }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "flightmodel.h"
+#include "thread_pool.h"
+
+#include <memory>
+#include <vector>
+
+// Owns many independent aircraft and steps them in parallel on a thread pool.
+// The states of the aircraft are stored in one flat array next to a pointer to their type, which all aircraft of a
+// type share, so a fleet of 100k aircraft takes a few MB.
+// Every aircraft only reads and writes its own state, so the result of step() is the same
+// for any number of threads and any distribution of the chunks over the threads.
+class World
+  {
+  public:
+    // chunk_size 0 picks a chunk size from the number of aircraft and the concurrency of the pool
+    World(ThreadPool& pool, std::size_t chunk_size = 0);
+
+    // ground for all aircraft, nullptr for a flat ground at height 0; the terrain should outlive the world
+    void set_terrain(const TerrainField* terrain) { m_terrain = terrain; }
+
+    // returns the index of the new aircraft; the world keeps the type of the aircraft alive
+    std::size_t add(const Aircraft& aircraft);
+    std::size_t add(std::shared_ptr<const AircraftType> type, const AircraftState& state);
+    void reserve(std::size_t capacity);
+    std::size_t size() const { return m_states.size(); }
+
+    AircraftState& operator [] (std::size_t i) { return m_states[i]; }
+    const AircraftState& operator [] (std::size_t i) const { return m_states[i]; }
+    const AircraftType& get_type(std::size_t i) const { return *m_type[i]; }
+
+    // all states, e.g. for a snapshot with a single copy
+    AircraftState* data() { return m_states.data(); }
+    const AircraftState* data() const { return m_states.data(); }
+
+    void step(physics::seconds dt);
+
+  private:
+    std::size_t _chunk_size() const;
+
+  private:
+    ThreadPool& m_pool;
+    std::vector<AircraftState> m_states;
+    std::vector<const AircraftType*> m_type;                  // per aircraft
+    std::vector<std::shared_ptr<const AircraftType>> m_types; // every type once, owns them
+    std::size_t m_chunk_size;
+    const TerrainField* m_terrain;
+  };